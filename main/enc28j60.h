@@ -21,6 +21,7 @@ extern "C" {
 #include "esp_eth_mac.h"
 #include "esp_eth_phy.h"
 #include "driver/spi_master.h"
+#include "esp_netif.h"
 
 /**
  * @brief SPI Instruction Set
@@ -137,6 +138,15 @@ extern "C" {
 #define ENC28J60_EPAUSL   (0x0318) // Pause Timer Value Low Byte (EPAUS<7:0>)
 #define ENC28J60_EPAUSH   (0x0319) // Pause Timer Value High Byte (EPAUS<15:8>)
 
+/**
+ * @brief Decode the register address constants above
+ *
+ */
+#define ENC28J60_REG_BANK(reg)       (((reg) & 0x0F00) >> 8)                   // Bank address of a per-bank register
+#define ENC28J60_REG_INDEX(reg)      ((reg) & 0xFF)                            // Register index inside the bank
+#define ENC28J60_REG_IS_MAC_MII(reg) (((reg) & 0xF000) != 0)                   // MAC/MII register, read with a dummy byte
+#define ENC28J60_REG_IS_SHARED(reg)  (ENC28J60_REG_INDEX(reg) >= ENC28J60_EIE) // Accessible on each bank
+
 /**
  * @brief status and flag of ENC28J60 specific registers
  *
@@ -237,6 +247,70 @@ extern "C" {
 #define EFLOCON_FCEN1    (1<<1) // Flow Control Enable 1
 #define EFLOCON_FCEN0    (1<<0) // Flow Control Enable 0
 
+// Transmit status vector bit definitions, byte 2
+#define TSV_DONE            (1<<7) // Transmit Done
+#define TSV_LEN_RANGE_ERR   (1<<6) // Length Out of Range
+#define TSV_LEN_CHECK_ERR   (1<<5) // Length Check Error
+#define TSV_CRC_ERR         (1<<4) // CRC Error
+#define TSV_COLLISION_COUNT (0x0F) // Collisions during the transmission attempts
+
+// Transmit status vector bit definitions, byte 3
+#define TSV_UNDERRUN        (1<<7) // Transmit Underrun
+#define TSV_GIANT           (1<<6) // Transmit Giant
+#define TSV_LATE_COLLISION  (1<<5) // Transmit Late Collision
+#define TSV_EXCESS_COLLISION (1<<4) // Transmit Excessive Collision, aborted after 15 retries
+#define TSV_EXCESS_DEFER    (1<<3) // Transmit Excessive Defer
+#define TSV_DEFER           (1<<2) // Transmit Packet Defer
+
+/**
+ * @brief PHY registers, accessed through the MII management interface
+ *
+ */
+#define ENC28J60_PHCON1  (0x00) // PHY Control Register 1
+#define ENC28J60_PHCON2  (0x10) // PHY Control Register 2
+#define ENC28J60_PHIE    (0x12) // PHY Interrupt Enable Register
+#define ENC28J60_PHIR    (0x13) // PHY Interrupt Request (Flag) Register
+
+// PHCON1 bit definitions
+#define PHCON1_PRST      (1<<15) // PHY Software Reset
+#define PHCON1_PLOOPBK   (1<<14) // PHY Loopback
+#define PHCON1_PPWRSV    (1<<11) // PHY Power-Down
+#define PHCON1_PDPXMD    (1<<8)  // PHY Duplex Mode, must match MACON3.FULDPX
+
+// PHCON2 bit definitions
+#define PHCON2_FRCLNK    (1<<14) // PHY Force Linkup
+#define PHCON2_TXDIS     (1<<13) // Twisted-Pair Transmitter Disable
+#define PHCON2_JABBER    (1<<10) // Jabber Correction Disable
+#define PHCON2_HDLDIS    (1<<8)  // PHY Half-Duplex Loopback Disable
+
+// PHIE bit definitions
+#define PHIE_PLNKIE      (1<<4) // PHY Link Change Interrupt Enable
+#define PHIE_PGEIE       (1<<1) // PHY Global Interrupt Enable
+
+// PHIR bit definitions
+#define PHIR_PLNKIF      (1<<4) // PHY Link Change Interrupt Flag
+#define PHIR_PGIF        (1<<2) // PHY Global Interrupt Flag
+
+/**
+ * @brief Where received frames are stored before they are passed to the TCP/IP stack
+ *
+ */
+typedef enum {
+    ENC28J60_RX_MODE_HEAP, /*!< Frame is read into a heap buffer and passed through the mediator (stack_input) */
+    ENC28J60_RX_MODE_POOL, /*!< Frame is read into a pre-allocated pool buffer, handed to lwIP as custom pbuf */
+    ENC28J60_RX_MODE_PBUF, /*!< Frame is read into the payload of a PBUF_RAM pbuf, handed to lwIP without further copy */
+} eth_enc28j60_rx_mode_t;
+
+/**
+ * @brief Checksum offload directions
+ * @note TX offload only fills in IP/TCP/UDP checksum fields that lwIP left zero (NETIF_SET_CHECKSUM_CTRL,
+ *       needs LWIP_CHECKSUM_CTRL_PER_NETIF), checksums already set are sent unchanged;
+ *       with RX offload frames with bad checksums are dropped by the driver
+ *
+ */
+#define ENC28J60_CSUM_OFFLOAD_TX (1 << 0)
+#define ENC28J60_CSUM_OFFLOAD_RX (1 << 1)
+
 /**
  * @brief ENC28J60 specific configuration
  *
@@ -244,6 +318,29 @@ extern "C" {
 typedef struct {
     spi_device_handle_t spi_hdl; /*!< Handle of SPI device driver */
     int int_gpio_num;            /*!< Interrupt GPIO number */
+    uint32_t rx_batch_max;       /*!< Frames received per EPKTCNT read at most, receive buffer space is freed at the end of each batch */
+    uint32_t napi_threshold;     /*!< Frames received on one interrupt that switch the driver to polling, 0 disables polling */
+    uint32_t napi_budget;        /*!< Frames received in polling mode at most, before the interrupt is re-armed */
+    uint32_t napi_window_us;     /*!< Time spent in polling mode at most, before the interrupt is re-armed */
+    uint32_t spi_dma_threshold;  /*!< Buffer memory transfers of at least this many bytes are queued to the SPI driver (DMA),
+                                      so the driver task sleeps instead of polling. 0 keeps all transfers on the polling path */
+    uint16_t rx_buf_size;        /*!< Bytes of the 8 KB buffer memory used for the receive ring (even number), the rest is transmit buffer.
+                                      2048 to 6652, 0 selects the default 6 KB receive / 2 KB transmit split */
+    eth_enc28j60_rx_mode_t rx_mode; /*!< Receive buffer mode */
+    uint16_t rx_pool_small_num;  /*!< Number of pre-allocated receive buffers for short frames (e.g. ARP, TCP ACK), ENC28J60_RX_MODE_POOL only */
+    uint16_t rx_pool_large_num;  /*!< Number of pre-allocated receive buffers for full size frames, ENC28J60_RX_MODE_POOL only */
+    esp_netif_t *netif;          /*!< Network interface the driver gets attached to, pool and pbuf frames are passed to its lwIP netif directly.
+                                      Required by ENC28J60_RX_MODE_POOL and ENC28J60_RX_MODE_PBUF, frames are allocated from heap otherwise
+                                      and while the lwIP netif is not up yet */
+    uint8_t csum_offload;        /*!< IPv4 checksums calculated by the DMA engine, combination of ENC28J60_CSUM_OFFLOAD_xxx */
+    int spi_host_id;             /*!< SPI host spi_hdl was added to, lets controllers sharing a bus take turns fairly; -1 if unknown */
+    const spi_device_interface_config_t *spi_devcfg; /*!< Config spi_hdl was added with, needed to change the SPI clock.
+                                      NULL keeps the clock fixed, otherwise its clock is the lowest the driver falls back to */
+    uint32_t spi_trace_depth;    /*!< Entries of the SPI operation trace ring (ENC28J60_CMD_G_SPI_TRACE), 0 disables tracing */
+    bool rx_latency;             /*!< Time stamp every received frame along the receive path (ENC28J60_CMD_G_RX_LATENCY) */
+    bool tx_status;              /*!< Read the transmit status vector of every frame on TXIF (ENC28J60_CMD_G_TX_STATUS) */
+    uint8_t tx_latecol_retries;  /*!< Retransmissions of a frame aborted by a late collision, up to ENC28J60_TX_RETRANSMIT_MAX, 0 drops it */
+    uint32_t tx_wait_ms;         /*!< Time transmit waits for room in the transmit buffer at most, 0 fails right away when it is full */
 } eth_enc28j60_config_t;
 
 /**
@@ -254,8 +351,374 @@ typedef struct {
     {                                           \
         .spi_hdl = spi_device,                  \
         .int_gpio_num = 4,                      \
+        .rx_batch_max = 4,                      \
+        .napi_threshold = 0,                    \
+        .napi_budget = 64,                      \
+        .napi_window_us = 5000,                 \
+        .spi_dma_threshold = 64,                \
+        .rx_buf_size = 0x1800,                  \
+        .rx_mode = ENC28J60_RX_MODE_HEAP,       \
+        .rx_pool_small_num = 0,                 \
+        .rx_pool_large_num = 0,                 \
+        .netif = NULL,                          \
+        .csum_offload = 0,                      \
+        .spi_host_id = -1,                      \
+        .spi_devcfg = NULL,                     \
+        .spi_trace_depth = 0,                   \
+        .rx_latency = false,                    \
+        .tx_status = false,                     \
+        .tx_latecol_retries = 2,                \
+        .tx_wait_ms = 1000,                     \
     }
 
+/**
+ * @brief Command list for ENC28J60 specific ioctl API
+ *
+ */
+typedef enum {
+    ENC28J60_CMD_G_BANK_STATS,  /*!< Get register bank switch and SPI transaction statistics, data type: eth_enc28j60_bank_stats_t* */
+    ENC28J60_CMD_SHADOW_RESYNC, /*!< Reload shadow register cache from chip (e.g. after soft reset), data type: uint32_t* (number of stale entries, optional) */
+    ENC28J60_CMD_G_RX_POOL_STATS, /*!< Get receive buffer pool statistics, data type: eth_enc28j60_rx_pool_stats_t* */
+    ENC28J60_CMD_G_RX_ALLOC_STATS, /*!< Get heap receive path statistics and DMA heap usage, data type: eth_enc28j60_rx_alloc_stats_t* */
+    ENC28J60_CMD_S_PARTITION,     /*!< Set receive buffer size, rest of buffer memory is used for transmit. MAC must be stopped, data type: uint32_t* */
+    ENC28J60_CMD_G_BUF_USAGE,     /*!< Get buffer partition and receive buffer occupancy, data type: eth_enc28j60_buf_usage_t* */
+    ENC28J60_CMD_RESET_BUF_USAGE, /*!< Reset receive buffer occupancy high water mark, data type: NULL */
+    ENC28J60_CMD_G_LOCK_STATS,    /*!< Get SPI lock wait and hold time statistics, data type: eth_enc28j60_lock_stats_t* */
+    ENC28J60_CMD_RESET_LOCK_STATS, /*!< Reset SPI lock statistics, data type: NULL */
+    ENC28J60_CMD_S_LINK_HANDLER,  /*!< Set handler called on PHY link change interrupt, data type: eth_enc28j60_link_handler_t* */
+    ENC28J60_CMD_G_IRQ_STATS,     /*!< Get interrupt statistics, data type: eth_enc28j60_irq_stats_t* */
+    ENC28J60_CMD_G_NAPI_STATS,    /*!< Get interrupt/polling mode statistics, data type: eth_enc28j60_napi_stats_t* */
+    ENC28J60_CMD_S_RX_HOOK,       /*!< Set hook that sees (and may drop or shorten) every received frame, data type: eth_enc28j60_rx_hook_t* */
+    ENC28J60_CMD_S_RX_FILTER,     /*!< Select receive filters, combination of ERXFCON_xxx bits, data type: uint8_t* */
+    ENC28J60_CMD_G_RX_FILTER,     /*!< Get selected receive filters, data type: uint8_t* */
+    ENC28J60_CMD_S_PATTERN,       /*!< Program the pattern match filter (ERXFCON_PMEN), data type: eth_enc28j60_pattern_t* */
+    ENC28J60_CMD_ADD_MAC_FILTER,  /*!< Let frames to a (multicast) address pass the hash table filter (ERXFCON_HTEN), data type: uint8_t[6] */
+    ENC28J60_CMD_DEL_MAC_FILTER,  /*!< Remove an address added by ENC28J60_CMD_ADD_MAC_FILTER, data type: uint8_t[6] */
+    ENC28J60_CMD_G_CSUM_STATS,    /*!< Get checksum offload statistics, data type: eth_enc28j60_csum_stats_t* */
+    ENC28J60_CMD_RESET_CSUM_STATS, /*!< Reset checksum offload statistics, data type: NULL */
+    ENC28J60_CMD_CSUM_BENCH,      /*!< Compare CPU and DMA checksum time for a length, transmit buffer must be idle, data type: eth_enc28j60_csum_bench_t* */
+    ENC28J60_CMD_SPI_CALIBRATE,   /*!< Find the fastest reliable SPI clock and switch to it, transmit buffer must be idle, data type: uint32_t* (result in Hz) */
+    ENC28J60_CMD_S_SPI_CLOCK,     /*!< Switch SPI clock (e.g. a stored calibration result), verified by memory loopback, data type: uint32_t* */
+    ENC28J60_CMD_G_SPI_CLOCK,     /*!< Get SPI clock state, data type: eth_enc28j60_spi_clock_t* */
+    ENC28J60_CMD_G_RX_PERF,       /*!< Get receive path timing, data type: eth_enc28j60_rx_perf_t* */
+    ENC28J60_CMD_RESET_RX_PERF,   /*!< Reset receive path timing, data type: NULL */
+    ENC28J60_CMD_S_SPI_TRACE,     /*!< Pause (false) or resume (true) SPI operation tracing, data type: bool* */
+    ENC28J60_CMD_G_SPI_TRACE,     /*!< Move recorded SPI operations out of the trace ring, oldest first, data type: eth_enc28j60_trace_dump_t* */
+    ENC28J60_CMD_G_RX_LATENCY,    /*!< Get receive path latency histograms, data type: eth_enc28j60_rx_latency_t* */
+    ENC28J60_CMD_RESET_RX_LATENCY, /*!< Reset receive path latency histograms, data type: NULL */
+    ENC28J60_CMD_G_STATS,         /*!< Get driver counters, data type: eth_enc28j60_stats_t* */
+    ENC28J60_CMD_RESET_STATS,     /*!< Get driver counters and reset them, data type: eth_enc28j60_stats_t* (optional) */
+    ENC28J60_CMD_G_TX_STATUS,     /*!< Get transmit status statistics, data type: eth_enc28j60_tx_status_t* */
+    ENC28J60_CMD_RESET_TX_STATUS, /*!< Reset transmit status statistics, data type: NULL */
+    ENC28J60_CMD_DUPLEX_TEST,     /*!< Check the duplex setting with a PHY loopback frame, before esp_eth_start(), data type: eth_enc28j60_duplex_test_t* */
+} eth_enc28j60_io_cmd_t;
+
+/**
+ * @brief Register bank switch and SPI transaction statistics of the frame paths
+ * @note transactions are counted per device, a transmit running during receive is accounted to both paths
+ *
+ */
+typedef struct {
+    uint32_t rx_frames;           /*!< Frames received */
+    uint32_t rx_batches;          /*!< Receive drain batches, each reads EPKTCNT and writes ERXRDPT once */
+    uint32_t rx_bank_switches;    /*!< Bank switches issued while receiving these frames */
+    uint32_t rx_spi_transactions; /*!< SPI transactions issued while receiving these frames */
+    uint32_t tx_frames;           /*!< Frames transmitted */
+    uint32_t tx_bank_switches;    /*!< Bank switches issued while transmitting these frames */
+    uint32_t tx_spi_transactions; /*!< SPI transactions issued while transmitting these frames */
+} eth_enc28j60_bank_stats_t;
+
+/**
+ * @brief Receive buffer pool statistics
+ *
+ */
+typedef struct {
+    uint32_t small_num;      /*!< Buffers in the small class */
+    uint32_t small_free;     /*!< Currently free buffers in the small class */
+    uint32_t small_min_free; /*!< Lowest number of free buffers seen in the small class */
+    uint32_t large_num;      /*!< Buffers in the large class */
+    uint32_t large_free;     /*!< Currently free buffers in the large class */
+    uint32_t large_min_free; /*!< Lowest number of free buffers seen in the large class */
+    uint32_t drops;          /*!< Frames dropped because no receive buffer could be allocated, in any mode */
+} eth_enc28j60_rx_pool_stats_t;
+
+/**
+ * @brief Statistics of the heap and pbuf receive modes
+ *
+ */
+typedef struct {
+    uint32_t frames;       /*!< Frames received into exact size heap buffers (heap mode only) */
+    uint32_t bytes;        /*!< Sum of the heap buffer sizes allocated for these frames (heap mode only) */
+    uint32_t drops;        /*!< Frames dropped because no receive buffer could be allocated, in any mode */
+    uint32_t dma_free;     /*!< Current free size of DMA capable heap */
+    uint32_t dma_min_free; /*!< Lowest free size of DMA capable heap since boot, shows peak DMA heap use */
+} eth_enc28j60_rx_alloc_stats_t;
+
+/**
+ * @brief Receive path timing, used to compare the receive modes
+ *
+ */
+typedef struct {
+    eth_enc28j60_rx_mode_t mode; /*!< Receive mode in use */
+    uint32_t frames;             /*!< Frames processed, including dropped ones */
+    uint64_t bytes;              /*!< Payload bytes passed to the stack */
+    uint64_t cycles;             /*!< CPU cycles spent reading, releasing and delivering these frames */
+    uint32_t max_cycles;         /*!< Longest time spent on a single frame, in CPU cycles */
+} eth_enc28j60_rx_perf_t;
+
+/**
+ * @brief Stages of the receive path, between the time stamps taken for each frame
+ *
+ */
+typedef enum {
+    ENC28J60_RX_LAT_WAKEUP,  /*!< GPIO interrupt to driver task running, frames picked up in polling mode have none */
+    ENC28J60_RX_LAT_HEADER,  /*!< Task wakeup (or end of the previous frame) to receive status vector read, includes EIR and EPKTCNT reads */
+    ENC28J60_RX_LAT_PAYLOAD, /*!< Buffer allocation and frame read */
+    ENC28J60_RX_LAT_STACK,   /*!< Frame release and stack_input / netif->input, till it returns */
+    ENC28J60_RX_LAT_TOTAL,   /*!< GPIO interrupt to stack_input return, frames picked up in polling mode have none */
+    ENC28J60_RX_LAT_STAGES,
+} eth_enc28j60_rx_lat_stage_t;
+
+/**
+ * @brief Number of buckets of a latency histogram
+ * @note bucket 0 counts times below 1 us, bucket n times from 2^(n-1) to 2^n - 1 us, the last bucket everything longer
+ */
+#define ENC28J60_RX_LAT_BUCKETS (16)
+
+/**
+ * @brief Latency histogram of one receive path stage
+ *
+ */
+typedef struct {
+    uint32_t count;                            /*!< Frames measured */
+    uint32_t max_us;                           /*!< Longest time */
+    uint64_t sum_us;                           /*!< Sum of all times, for the mean */
+    uint32_t buckets[ENC28J60_RX_LAT_BUCKETS]; /*!< Frames per time range, see ENC28J60_RX_LAT_BUCKETS */
+} eth_enc28j60_lat_hist_t;
+
+/**
+ * @brief Receive path latency, one histogram per stage
+ *
+ */
+typedef struct {
+    eth_enc28j60_lat_hist_t stage[ENC28J60_RX_LAT_STAGES]; /*!< Indexed by eth_enc28j60_rx_lat_stage_t */
+} eth_enc28j60_rx_latency_t;
+
+/**
+ * @brief Driver counters, for monitoring which units are saturating
+ * @note counters are 32 bit and wrap around, monitoring should work with differences between two reads
+ *
+ */
+typedef struct {
+    uint32_t rx_frames;         /*!< Frames passed to the stack */
+    uint32_t rx_bytes;          /*!< Bytes passed to the stack, without CRC */
+    uint32_t rx_alloc_failures; /*!< Frames dropped for lack of a receive buffer (heap, pbuf or pool) */
+    uint32_t rx_errors;         /*!< Frames dropped for a buffer memory read error or a bad checksum, plus receive logic resets */
+    uint32_t rx_overflows;      /*!< Receive buffer full or packet counter overflow (RXERIF), the chip dropped frames */
+    uint32_t tx_frames;         /*!< Frames queued for transmission */
+    uint32_t tx_bytes;          /*!< Bytes queued for transmission */
+    uint32_t tx_timeouts;       /*!< Frames rejected because the transmit buffer stayed full */
+    uint32_t tx_aborts;         /*!< Transmissions aborted (TXERIF) */
+    uint32_t tx_late_collisions; /*!< Aborted transmissions with a late collision (ESTAT.LATECOL) */
+    uint32_t spi_errors;        /*!< SPI transactions the SPI master driver failed */
+    uint32_t lock_timeouts;     /*!< SPI device lock not taken within ENC28J60_SPI_LOCK_TIMEOUT_MS */
+    uint32_t tx_retries;        /*!< Collisions the chip retried after, from the transmit status vectors (tx_status only) */
+    uint32_t tx_retransmits;    /*!< Frames sent again by the driver after a late collision */
+} eth_enc28j60_stats_t;
+
+/**
+ * @brief Most retransmissions of one frame after late collisions
+ *
+ */
+#define ENC28J60_TX_RETRANSMIT_MAX (7)
+
+/**
+ * @brief Transmit status statistics, from the status vector the chip writes after each frame
+ * @note only retransmits is kept without eth_enc28j60_config_t.tx_status
+ *
+ */
+typedef struct {
+    uint32_t frames;               /*!< Transmit status vectors read */
+    uint32_t collisions[16];       /*!< Frames by collisions during their transmission, i.e. retries of the chip */
+    uint32_t retransmits[ENC28J60_TX_RETRANSMIT_MAX + 1]; /*!< Frames by retransmissions of the driver after late collisions */
+    uint32_t deferred;             /*!< Frames that waited for the medium */
+    uint32_t excess_defers;        /*!< Frames aborted after waiting too long for the medium */
+    uint32_t excess_collisions;    /*!< Frames aborted after 15 retries */
+    uint32_t late_collisions;      /*!< Frames hit by a collision after the collision window, i.e. aborted */
+    uint32_t underruns;            /*!< Frames aborted for a transmit underrun */
+    uint32_t not_done;             /*!< Status vectors without the done bit, not accounted otherwise */
+    uint64_t wire_bytes;           /*!< Bytes put on the wire, including collided attempts */
+} eth_enc28j60_tx_status_t;
+
+/**
+ * @brief Result of the duplex loopback test
+ * @note PHY loopback only works in full duplex, a frame only comes back if PHY and MAC both are set to it
+ *
+ */
+typedef struct {
+    bool phy_full_duplex; /*!< PHCON1.PDPXMD is set */
+    bool mac_full_duplex; /*!< MACON3.FULDPX is set */
+    bool looped_back;     /*!< Test frame sent with the PHY in loopback was received */
+} eth_enc28j60_duplex_test_t;
+
+/**
+ * @brief Buffer memory partition and receive buffer usage
+ *
+ */
+typedef struct {
+    uint32_t rx_size;          /*!< Receive buffer size in bytes */
+    uint32_t tx_size;          /*!< Transmit buffer size in bytes */
+    uint32_t rx_occupancy;     /*!< Bytes currently held in the receive buffer */
+    uint32_t rx_occupancy_hwm; /*!< Highest receive buffer occupancy seen when frames were picked up, counting complete frames */
+} eth_enc28j60_buf_usage_t;
+
+/**
+ * @brief SPI device lock statistics, times in CPU cycles
+ *
+ */
+typedef struct {
+    uint32_t acquisitions;       /*!< Times the lock was taken, a frame transaction counts once */
+    uint32_t frame_transactions; /*!< Times the lock and SPI bus were held for a whole RX or TX frame sequence */
+    uint32_t timeouts;           /*!< Times the lock couldn't be taken in time */
+    uint64_t wait_cycles;        /*!< Total time spent waiting for the lock */
+    uint32_t max_wait_cycles;    /*!< Longest wait for the lock */
+    uint64_t hold_cycles;        /*!< Total time the lock was held */
+    uint32_t max_hold_cycles;    /*!< Longest time the lock was held */
+} eth_enc28j60_lock_stats_t;
+
+/**
+ * @brief Handler of PHY link change interrupts, runs in the driver task
+ *
+ */
+typedef struct {
+    void (*handler)(void *arg); /*!< Called after LINKIF was cleared, NULL to unregister */
+    void *arg;                  /*!< Argument passed to handler */
+} eth_enc28j60_link_handler_t;
+
+/**
+ * @brief Hook on received frames, runs in the driver task before a frame is passed to the stack
+ *
+ */
+typedef struct {
+    bool (*hook)(void *arg, uint8_t *frame, uint32_t *len); /*!< Return false to drop the frame, may reduce *len (without CRC). NULL to unregister */
+    void *arg;                                              /*!< Argument passed to hook */
+} eth_enc28j60_rx_hook_t;
+
+/**
+ * @brief Interrupt statistics, counts how often each EIR flag was serviced
+ *
+ */
+typedef struct {
+    uint32_t pktif;     /*!< Receive packet pending */
+    uint32_t txif;      /*!< Transmit complete */
+    uint32_t txerif;    /*!< Transmit error, transmit logic was reset */
+    uint32_t rxerif;    /*!< Receive error (buffer full or packet counter overflow), frames were dropped by the chip */
+    uint32_t linkif;    /*!< PHY link change */
+    uint32_t rx_resets; /*!< Receive logic resets after an invalid receive status vector */
+} eth_enc28j60_irq_stats_t;
+
+/**
+ * @brief Interrupt/polling mode switch statistics
+ *
+ */
+typedef struct {
+    uint32_t poll_entries;  /*!< Switches from interrupt to polling mode */
+    uint32_t exits_idle;    /*!< Back to interrupt mode because no more frames arrived */
+    uint32_t exits_budget;  /*!< Back to interrupt mode because the frame budget was used up */
+    uint32_t exits_window;  /*!< Back to interrupt mode because the time window was over */
+    uint32_t rearm_pending; /*!< Interrupt was already pending when re-armed */
+    uint32_t frames_polled; /*!< Frames received in polling mode */
+} eth_enc28j60_napi_stats_t;
+
+/**
+ * @brief SPI clock state
+ *
+ */
+typedef struct {
+    uint32_t clock_hz;     /*!< Current SPI clock */
+    uint32_t min_clock_hz; /*!< Configured clock, the lowest runtime fallback goes */
+    uint32_t fallbacks;    /*!< Clock reductions after read back errors confirmed by a memory loopback */
+} eth_enc28j60_spi_clock_t;
+
+/**
+ * @brief Checksum offload statistics
+ *
+ */
+typedef struct {
+    uint32_t tx_frames;  /*!< Frames with at least one zero checksum field filled in by the DMA engine */
+    uint64_t tx_time_us; /*!< Time spent on them, including SPI transfers */
+    uint32_t rx_frames;  /*!< Frames whose checksums were verified by the DMA engine */
+    uint64_t rx_time_us; /*!< Time spent on them, including SPI transfers */
+    uint32_t rx_errors;  /*!< Frames dropped for a bad checksum */
+} eth_enc28j60_csum_stats_t;
+
+/**
+ * @brief Checksum benchmark: per checksum time on the CPU (lwIP) and with the DMA engine
+ * @note offload pays off for lengths where dma_time_us is below sw_time_us
+ *
+ */
+typedef struct {
+    uint16_t len;         /*!< Bytes to checksum */
+    uint32_t iterations;  /*!< Number of runs averaged */
+    uint32_t sw_time_us;  /*!< Result: lwIP inet_chksum() time */
+    uint32_t dma_time_us; /*!< Result: DMA engine time, including SPI transfers */
+} eth_enc28j60_csum_bench_t;
+
+/**
+ * @brief Pattern match filter: frames pass if the bytes selected by mask equal those of pattern
+ * @note ENC28J60 has a single pattern window of 64 bytes, the comparison is done on a checksum of the selected bytes
+ *
+ */
+typedef struct {
+    uint16_t offset;     /*!< Offset of the 64 byte window from the start of the frame (destination address) */
+    uint8_t mask[8];     /*!< Bit n of mask[n / 8] selects byte n of the window */
+    uint8_t pattern[64]; /*!< Expected content of the window, only the selected bytes matter */
+} eth_enc28j60_pattern_t;
+
+/**
+ * @brief Kind of SPI trace entry
+ *
+ */
+typedef enum {
+    ENC28J60_TRACE_SPI,      /*!< SPI operation */
+    ENC28J60_TRACE_RX_BEGIN, /*!< Receive frame transaction started, operations till ENC28J60_TRACE_END belong to one received frame */
+    ENC28J60_TRACE_TX_BEGIN, /*!< Transmit frame transaction started, operations till ENC28J60_TRACE_END belong to one sent frame */
+    ENC28J60_TRACE_END,      /*!< Frame transaction ended */
+} eth_enc28j60_trace_type_t;
+
+#define ENC28J60_TRACE_FLAG_QUEUED (1 << 0) /*!< Operation went through the queued (DMA) SPI path */
+#define ENC28J60_TRACE_FLAG_ERROR  (1 << 1) /*!< SPI driver reported an error */
+
+/**
+ * @brief SPI trace entry, also the record format of trace dumps (little endian)
+ *
+ */
+typedef struct {
+    uint32_t timestamp_us;     /*!< esp_timer time, lower 32 bits */
+    uint32_t caller;           /*!< Return address of the driver function that issued the operation (on Xtensa the top 2 bits hold the call window size) */
+    uint32_t lock_wait_cycles; /*!< CPU cycles waited for the SPI lock before the operation, 0 inside a frame transaction */
+    uint16_t length;           /*!< Data bytes after the command byte (including the dummy byte of MAC/MII reads) */
+    uint8_t type;              /*!< eth_enc28j60_trace_type_t */
+    uint8_t opcode;            /*!< SPI command (upper 3 bits) and argument (lower 5 bits) */
+    uint8_t value;             /*!< Register value written or read, bit mask set or cleared, 0 for buffer memory */
+    uint8_t flags;             /*!< ENC28J60_TRACE_FLAG_xxx */
+    uint16_t reserved;
+} eth_enc28j60_trace_entry_t;
+
+#define ENC28J60_TRACE_MAGIC   (0x54383245) // "E28T", starts a trace stream, followed by version and entry size (uint16_t each)
+#define ENC28J60_TRACE_VERSION (1)
+
+/**
+ * @brief SPI trace dump
+ *
+ */
+typedef struct {
+    eth_enc28j60_trace_entry_t *entries; /*!< Where to copy the entries to */
+    uint32_t max_entries;                /*!< Room in entries */
+    uint32_t num_entries;                /*!< Result: entries copied, they are removed from the trace ring */
+    uint32_t lost;                       /*!< Result: entries overwritten since the last dump, because it came too late */
+} eth_enc28j60_trace_dump_t;
+
 /**
 * @brief Create ENC28J60 Ethernet MAC instance
 *
@@ -268,6 +731,101 @@ typedef struct {
 */
 esp_eth_mac_t *esp_eth_mac_new_enc28j60(const eth_enc28j60_config_t *enc28j60_config, const eth_mac_config_t *mac_config);
 
+/**
+ * @brief Redundant pair configuration
+ *
+ */
+typedef struct {
+    esp_eth_mac_t *mac_a;       /*!< ENC28J60 MAC on LAN A */
+    esp_eth_mac_t *mac_b;       /*!< ENC28J60 MAC on LAN B */
+    esp_eth_phy_t *phy_a;       /*!< ENC28J60 PHY on LAN A */
+    esp_eth_phy_t *phy_b;       /*!< ENC28J60 PHY on LAN B */
+    uint32_t dup_table_size;    /*!< Entries of the duplicate table, rounded down to a power of 2 */
+    uint32_t entry_forget_ms;   /*!< Time a copy waits for its duplicate */
+} eth_enc28j60_prp_config_t;
+
+/**
+ * @brief Default redundant pair configuration
+ *
+ */
+#define ETH_ENC28J60_PRP_DEFAULT_CONFIG(a, b, pa, pb) \
+    {                                                 \
+        .mac_a = a,                                   \
+        .mac_b = b,                                   \
+        .phy_a = pa,                                  \
+        .phy_b = pb,                                  \
+        .dup_table_size = 256,                        \
+        .entry_forget_ms = 400,                       \
+    }
+
+/**
+ * @brief Redundant pair statistics
+ *
+ */
+typedef struct {
+    uint32_t tx_frames;      /*!< Frames sent (on both LANs) */
+    uint32_t tx_errors[2];   /*!< Copies that could not be sent, per LAN */
+    uint32_t tx_no_link[2];  /*!< Copies not sent because the LAN had no link, per LAN */
+    uint32_t rx_frames[2];   /*!< Frames received per LAN */
+    uint32_t rx_duplicates;  /*!< Second copies discarded */
+    uint32_t rx_untagged;    /*!< Frames without redundancy trailer (e.g. from single attached nodes), always accepted */
+    uint32_t rx_wrong_lan;   /*!< Tagged frames received on the other LAN than their LAN id says */
+} eth_enc28j60_prp_stats_t;
+
+/**
+* @brief Create a redundant MAC from two ENC28J60 MACs, in the manner of PRP (IEC 62439-3)
+*
+* @note every frame is sent on both LANs with a redundancy control trailer (sequence number, LAN id, size, 0x88FB),
+*       the first received copy is passed on and its duplicate discarded. Both MACs must be configured with
+*       the same netif, the redundant MAC takes ownership of them and their PHYs.
+*       Each MAC is started and stopped on the link of its own PHY, the pair is reported up while either LAN is up.
+*       Install the Ethernet driver with the PHY from esp_eth_mac_enc28j60_prp_get_phy().
+*
+* @param[in] config: redundant pair configuration
+*
+* @return
+*      - instance: create MAC instance successfully
+*      - NULL: create MAC instance failed because some error occurred
+*/
+esp_eth_mac_t *esp_eth_mac_new_enc28j60_prp(const eth_enc28j60_prp_config_t *config);
+
+/**
+* @brief Get redundant pair statistics
+*
+* @param[in] mac: redundant MAC instance
+* @param[out] stats: statistics
+*
+* @return
+*      - ESP_OK: get statistics successfully
+*      - ESP_ERR_INVALID_ARG: invalid argument
+*/
+esp_err_t esp_eth_mac_enc28j60_prp_get_stats(esp_eth_mac_t *mac, eth_enc28j60_prp_stats_t *stats);
+
+/**
+* @brief Get the PHY of a redundant pair, which drives the PHYs of both LANs, for the Ethernet driver
+*
+* @param[in] mac: redundant MAC instance
+*
+* @return
+*      - instance: PHY of the pair
+*      - NULL: invalid argument
+*/
+esp_eth_phy_t *esp_eth_mac_enc28j60_prp_get_phy(esp_eth_mac_t *mac);
+
+/**
+* @brief Misc IO function of ENC28J60 MAC driver
+*
+* @param[in] mac: ENC28J60 MAC instance
+* @param[in] cmd: IO control command
+* @param[in, out] data: address of data for `set` command or address where to store the data when used with `get` command
+*
+* @return
+*      - ESP_OK: process io command successfully
+*      - ESP_ERR_INVALID_ARG: process io command failed because of some invalid argument
+*      - ESP_FAIL: process io command failed because some other error occurred
+*/
+esp_err_t esp_eth_mac_enc28j60_ioctl(esp_eth_mac_t *mac, eth_enc28j60_io_cmd_t cmd, void *data);
+
 /**
 * @brief Create a PHY instance of ENC28J60
 *
@@ -279,6 +837,52 @@ esp_eth_mac_t *esp_eth_mac_new_enc28j60(const eth_enc28j60_config_t *enc28j60_co
 */
 esp_eth_phy_t *esp_eth_phy_new_enc28j60(const eth_phy_config_t *config);
 
+/**
+* @brief Read the link status of ENC28J60 PHY and report changes to the Ethernet driver
+*
+* @note meant to be called on PHY link change interrupt, see ENC28J60_CMD_S_LINK_HANDLER
+*
+* @param[in] phy: ENC28J60 PHY instance
+*
+* @return
+*      - ESP_OK: link status updated successfully
+*      - ESP_FAIL: reading the link status failed
+*/
+esp_err_t esp_eth_phy_enc28j60_update_link(esp_eth_phy_t *phy);
+
+/**
+* @brief Enable or disable link status polling by the Ethernet driver's periodic link check
+*
+* @note with polling disabled an up link is read once, later changes must be reported by
+*       esp_eth_phy_enc28j60_update_link(). A down link is still polled, in case a link change interrupt is missed.
+*       Polling is enabled by default.
+*
+* @param[in] phy: ENC28J60 PHY instance
+* @param[in] enable: true to read the link status on every periodic check
+*
+* @return
+*      - ESP_OK: set polling mode successfully
+*      - ESP_ERR_INVALID_ARG: invalid argument
+*/
+esp_err_t esp_eth_phy_enc28j60_set_link_polling(esp_eth_phy_t *phy, bool enable);
+
+/**
+* @brief Force the duplex mode of ENC28J60 PHY (PHCON1.PDPXMD) instead of the one selected by the LEDB strap
+*
+* @note ENC28J60 can't auto-negotiate, an auto-negotiating switch port sees it as half duplex. Only force full duplex
+*       if the switch port is configured to 10 Mbit/s full duplex too.
+*       The mode is set on every PHY reset, so call this before esp_eth_driver_install(). The MAC follows through
+*       the duplex reported on link up (MACON3.FULDPX and inter-packet gaps), ENC28J60_CMD_DUPLEX_TEST checks both.
+*
+* @param[in] phy: ENC28J60 PHY instance
+* @param[in] duplex: duplex mode to force
+*
+* @return
+*      - ESP_OK: set duplex mode successfully
+*      - ESP_ERR_INVALID_ARG: invalid argument
+*/
+esp_err_t esp_eth_phy_enc28j60_set_duplex(esp_eth_phy_t *phy, eth_duplex_t duplex);
+
 #ifdef __cplusplus
 }
 #endif
@@ -31,6 +31,8 @@
 #include "lwip/sys.h"
 #include "lwip/netdb.h"
 #include "lwip/dns.h"
+#include "lwip/netif.h"
+#include "nvs.h"
 
 static const char *TAG = "eth_example";
 
@@ -39,31 +41,155 @@ bool ethConnected(){
     return ethCon;
 }
 
-/** Event handler for Ethernet events */
+#if CONFIG_EXAMPLE_ENC28J60_PRP
+#define ETH_PORTS 1 // both controllers form one redundant port
+#else
+#define ETH_PORTS CONFIG_EXAMPLE_ENC28J60_PORTS
+#endif
+
+/** One ENC28J60 controller (or redundant pair) with its own netif */
+typedef struct {
+    esp_netif_t *netif;
+    esp_eth_handle_t eth_handle;
+    esp_eth_mac_t *mac;
+    esp_eth_phy_t *phy;
+    esp_eth_mac_t *ctrl[2]; // ENC28J60 controllers of the port, the second one only in a redundant pair
+    bool got_ip;
+} enc28j60_port_t;
+
+static enc28j60_port_t s_ports[ETH_PORTS];
+
+/** CS and INT GPIO of each controller */
+static const int s_port_gpio[][2] = {
+    {CONFIG_EXAMPLE_ENC28J60_CS_GPIO, CONFIG_EXAMPLE_ENC28J60_INT_GPIO},
+#if CONFIG_EXAMPLE_ENC28J60_PORTS > 1
+    {CONFIG_EXAMPLE_ENC28J60_CS_GPIO_1, CONFIG_EXAMPLE_ENC28J60_INT_GPIO_1},
+#endif
+#if CONFIG_EXAMPLE_ENC28J60_PORTS > 2
+    {CONFIG_EXAMPLE_ENC28J60_CS_GPIO_2, CONFIG_EXAMPLE_ENC28J60_INT_GPIO_2},
+#endif
+};
+
+static enc28j60_port_t *port_from_handle(esp_eth_handle_t eth_handle)
+{
+    for (int i = 0; i < ETH_PORTS; i++) {
+        if (s_ports[i].eth_handle == eth_handle) {
+            return &s_ports[i];
+        }
+    }
+    return NULL;
+}
+
+static void update_connected(void)
+{
+    ethCon = false;
+    for (int i = 0; i < ETH_PORTS; i++) {
+        ethCon |= s_ports[i].got_ip;
+    }
+}
+
+/** Event handler for Ethernet events
+ *  Does the work of esp_eth_set_default_handlers() too, which would pass events of every port to a single netif
+ */
+#if CONFIG_EXAMPLE_ENC28J60_HW_FILTER
+static enc28j60_port_t *port_from_netif(struct netif *netif)
+{
+    for (int i = 0; i < ETH_PORTS; i++) {
+        if (s_ports[i].netif && esp_netif_get_netif_impl(s_ports[i].netif) == netif) {
+            return &s_ports[i];
+        }
+    }
+    return NULL;
+}
+
+/** Let frames to a multicast MAC address pass the hash table filter of the port's controllers, or stop that */
+static err_t enc28j60_mac_filter(struct netif *netif, uint8_t *addr, enum netif_mac_filter_action action)
+{
+    enc28j60_port_t *port = port_from_netif(netif);
+    if (!port) {
+        return ERR_IF;
+    }
+    err_t err = ERR_OK;
+    for (int i = 0; i < 2 && port->ctrl[i]; i++) {
+        if (esp_eth_mac_enc28j60_ioctl(port->ctrl[i], action == NETIF_ADD_MAC_FILTER ? ENC28J60_CMD_ADD_MAC_FILTER :
+                                       ENC28J60_CMD_DEL_MAC_FILTER, addr) != ESP_OK) {
+            err = ERR_IF;
+        }
+    }
+    return err;
+}
+
+#if LWIP_IGMP
+/** lwIP joined or left an IPv4 group, its MAC address is 01:00:5E followed by the low 23 bits of the group */
+static err_t enc28j60_igmp_mac_filter(struct netif *netif, const ip4_addr_t *group, enum netif_mac_filter_action action)
+{
+    uint32_t addr = lwip_ntohl(ip4_addr_get_u32(group));
+    uint8_t mac[6] = {0x01, 0x00, 0x5E, (addr >> 16) & 0x7F, (addr >> 8) & 0xFF, addr & 0xFF};
+    return enc28j60_mac_filter(netif, mac, action);
+}
+#endif
+
+#if LWIP_IPV6 && LWIP_IPV6_MLD
+/** lwIP joined or left an IPv6 group, its MAC address is 33:33 followed by the low 32 bits of the group */
+static err_t enc28j60_mld_mac_filter(struct netif *netif, const ip6_addr_t *group, enum netif_mac_filter_action action)
+{
+    uint32_t addr = lwip_ntohl(group->addr[3]);
+    uint8_t mac[6] = {0x33, 0x33, addr >> 24, (addr >> 16) & 0xFF, (addr >> 8) & 0xFF, addr & 0xFF};
+    return enc28j60_mac_filter(netif, mac, action);
+}
+#endif
+#endif
+
 static void eth_event_handler(void *arg, esp_event_base_t event_base,
                               int32_t event_id, void *event_data)
 {
     uint8_t mac_addr[6] = {0};
     /* we can get the ethernet driver handle from event data */
     esp_eth_handle_t eth_handle = *(esp_eth_handle_t *)event_data;
+    enc28j60_port_t *port = port_from_handle(eth_handle);
+    if (!port) {
+        return;
+    }
+    int index = port - s_ports;
 
     switch (event_id) {
     case ETHERNET_EVENT_CONNECTED:
+        esp_netif_action_connected(port->netif, event_base, event_id, event_data);
         esp_eth_ioctl(eth_handle, ETH_CMD_G_MAC_ADDR, mac_addr);
-        ESP_LOGI(TAG, "Ethernet Link Up");
+        ESP_LOGI(TAG, "Ethernet Link Up (port %d)", index);
         ESP_LOGI(TAG, "Ethernet HW Addr %02x:%02x:%02x:%02x:%02x:%02x",
                  mac_addr[0], mac_addr[1], mac_addr[2], mac_addr[3], mac_addr[4], mac_addr[5]);
         break;
     case ETHERNET_EVENT_DISCONNECTED:
-        ESP_LOGI(TAG, "Ethernet Link Down");
-        ethCon = false;
+        esp_netif_action_disconnected(port->netif, event_base, event_id, event_data);
+        ESP_LOGI(TAG, "Ethernet Link Down (port %d)", index);
+        port->got_ip = false;
+        update_connected();
         break;
     case ETHERNET_EVENT_START:
-        ESP_LOGI(TAG, "Ethernet Started");
+        esp_netif_action_start(port->netif, event_base, event_id, event_data);
+        ESP_LOGI(TAG, "Ethernet Started (port %d)", index);
+#if CONFIG_EXAMPLE_ENC28J60_CSUM_OFFLOAD && LWIP_CHECKSUM_CTRL_PER_NETIF
+        /* the netif has been added by now, which enables all checksums again */
+        NETIF_SET_CHECKSUM_CTRL((struct netif *)esp_netif_get_netif_impl(port->netif),
+                                NETIF_CHECKSUM_GEN_ICMP | NETIF_CHECKSUM_GEN_ICMP6 |
+                                NETIF_CHECKSUM_CHECK_ICMP | NETIF_CHECKSUM_CHECK_ICMP6);
+#endif
+#if CONFIG_EXAMPLE_ENC28J60_HW_FILTER
+        /* the netif exists now, groups lwIP joins from here on are added to the hash table filter */
+#if LWIP_IGMP
+        netif_set_igmp_mac_filter((struct netif *)esp_netif_get_netif_impl(port->netif), enc28j60_igmp_mac_filter);
+#endif
+#if LWIP_IPV6 && LWIP_IPV6_MLD
+        netif_set_mld_mac_filter((struct netif *)esp_netif_get_netif_impl(port->netif), enc28j60_mld_mac_filter);
+#endif
+#endif
         break;
     case ETHERNET_EVENT_STOP:
-        ESP_LOGI(TAG, "Ethernet Stopped");
-        ethCon = false;
+        esp_netif_action_stop(port->netif, event_base, event_id, event_data);
+        ESP_LOGI(TAG, "Ethernet Stopped (port %d)", index);
+        port->got_ip = false;
+        update_connected();
         break;
     default:
         break;
@@ -77,13 +203,18 @@ static void got_ip_event_handler(void *arg, esp_event_base_t event_base,
     ip_event_got_ip_t *event = (ip_event_got_ip_t *) event_data;
     const esp_netif_ip_info_t *ip_info = &event->ip_info;
 
-    ESP_LOGI(TAG, "Ethernet Got IP Address");
+    ESP_LOGI(TAG, "Ethernet Got IP Address (%s)", esp_netif_get_desc(event->esp_netif));
     ESP_LOGI(TAG, "~~~~~~~~~~~");
     ESP_LOGI(TAG, "ETHIP:" IPSTR, IP2STR(&ip_info->ip));
     ESP_LOGI(TAG, "ETHMASK:" IPSTR, IP2STR(&ip_info->netmask));
     ESP_LOGI(TAG, "ETHGW:" IPSTR, IP2STR(&ip_info->gw));
     ESP_LOGI(TAG, "~~~~~~~~~~~");
-    ethCon = true;
+    for (int i = 0; i < ETH_PORTS; i++) {
+        if (s_ports[i].netif == event->esp_netif) {
+            s_ports[i].got_ip = true;
+        }
+    }
+    update_connected();
 }
 
 esp_netif_t *eth_netif = NULL;
@@ -93,69 +224,456 @@ esp_netif_t *get_netif(void)
     return eth_netif;
 }
 
-void ethernetConnect(void)
+esp_netif_t *get_netif_port(int port)
 {
-    ESP_ERROR_CHECK(gpio_install_isr_service(0));
-    // Initialize TCP/IP network interface (should be called only once in application)
-    ESP_ERROR_CHECK(esp_netif_init());
-    // Create default event loop that running in background
-    //ESP_ERROR_CHECK(esp_event_loop_create_default());
-    esp_netif_config_t netif_cfg = ESP_NETIF_DEFAULT_ETH();
-    eth_netif = esp_netif_new(&netif_cfg);
-    // Set default handlers to process TCP/IP stuffs
-    ESP_ERROR_CHECK(esp_eth_set_default_handlers(eth_netif));
-    // Register user defined event handers
-    ESP_ERROR_CHECK(esp_event_handler_register(ETH_EVENT, ESP_EVENT_ANY_ID, &eth_event_handler, NULL));
-    ESP_ERROR_CHECK(esp_event_handler_register(IP_EVENT, IP_EVENT_ETH_GOT_IP, &got_ip_event_handler, NULL));
+    return port >= 0 && port < ETH_PORTS ? s_ports[port].netif : NULL;
+}
 
-    spi_bus_config_t buscfg = {
-        .miso_io_num = CONFIG_EXAMPLE_ENC28J60_MISO_GPIO,
-        .mosi_io_num = CONFIG_EXAMPLE_ENC28J60_MOSI_GPIO,
-        .sclk_io_num = CONFIG_EXAMPLE_ENC28J60_SCLK_GPIO,
-        .quadwp_io_num = -1,
-        .quadhd_io_num = -1,
+int ethernet_port_count(void)
+{
+    return ETH_PORTS;
+}
+
+#if CONFIG_EXAMPLE_ENC28J60_LINK_IRQ
+/** PHY link change interrupt, called from the ENC28J60 driver task */
+static void enc28j60_link_irq_handler(void *arg)
+{
+    esp_eth_phy_enc28j60_update_link((esp_eth_phy_t *)arg);
+}
+#endif
+
+#if CONFIG_EXAMPLE_ENC28J60_SPI_CALIBRATE
+/** Switch to the SPI clock stored in NVS, calibrate and store it if there is none (or it doesn't work anymore) */
+static void enc28j60_spi_clock_setup(esp_eth_mac_t *mac, int index)
+{
+    nvs_handle_t nvs;
+    uint32_t clock_hz = 0;
+    char key[16];
+
+    if (nvs_open("enc28j60", NVS_READWRITE, &nvs) != ESP_OK) {
+        ESP_LOGW(TAG, "can't open NVS, keep SPI clock");
+        return;
+    }
+    /* port 0 keeps the key it had before there were several ports */
+    snprintf(key, sizeof(key), index ? "spi_hz%d" : "spi_hz", index);
+    if (nvs_get_u32(nvs, key, &clock_hz) == ESP_OK &&
+            esp_eth_mac_enc28j60_ioctl(mac, ENC28J60_CMD_S_SPI_CLOCK, &clock_hz) == ESP_OK) {
+        ESP_LOGI(TAG, "SPI clock %d Hz (stored)", clock_hz);
+    } else if (esp_eth_mac_enc28j60_ioctl(mac, ENC28J60_CMD_SPI_CALIBRATE, &clock_hz) == ESP_OK) {
+        nvs_set_u32(nvs, key, clock_hz);
+        nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+}
+#endif
+
+/** Controllers forced to full duplex, by controller index */
+static bool s_full_duplex[CONFIG_EXAMPLE_ENC28J60_PORTS];
+
+/** Force the duplex mode of the PHY from the configuration, a per port NVS key overrides it */
+static void enc28j60_duplex_setup(esp_eth_phy_t *phy, int index)
+{
+    nvs_handle_t nvs;
+    bool forced = false;
+    uint8_t full_duplex = 0;
+    char key[16];
+
+#if CONFIG_EXAMPLE_ENC28J60_FULL_DUPLEX
+    forced = true;
+    full_duplex = 1;
+#endif
+    if (nvs_open("enc28j60", NVS_READONLY, &nvs) == ESP_OK) {
+        snprintf(key, sizeof(key), index ? "duplex%d" : "duplex", index);
+        forced |= nvs_get_u8(nvs, key, &full_duplex) == ESP_OK;
+        nvs_close(nvs);
+    }
+    /* otherwise the LEDB strap decides */
+    if (forced) {
+        ESP_ERROR_CHECK(esp_eth_phy_enc28j60_set_duplex(phy, full_duplex ? ETH_DUPLEX_FULL : ETH_DUPLEX_HALF));
+    }
+    s_full_duplex[index] = forced && full_duplex;
+}
+
+/** Check the forced full duplex mode is in effect, PHY loopback only returns the test frame in full duplex
+ *  Takes the controller off the wire for up to 100 ms, so it runs before the driver is started
+ */
+static void enc28j60_duplex_check(esp_eth_mac_t *mac, int index)
+{
+    eth_enc28j60_duplex_test_t test;
+    if (esp_eth_mac_enc28j60_ioctl(mac, ENC28J60_CMD_DUPLEX_TEST, &test) != ESP_OK) {
+        ESP_LOGW(TAG, "duplex test failed (port %d)", index);
+        return;
+    }
+    if (test.phy_full_duplex && test.mac_full_duplex && test.looped_back) {
+        ESP_LOGI(TAG, "Full duplex (port %d)", index);
+    } else {
+        ESP_LOGE(TAG, "full duplex not in effect (port %d): PHY %s, MAC %s, loopback %s", index,
+                 test.phy_full_duplex ? "full" : "half", test.mac_full_duplex ? "full" : "half",
+                 test.looped_back ? "ok" : "failed");
+    }
+}
+
+/** Driver of the first controller, the one diagnostics are collected from */
+static esp_eth_mac_t *s_first_mac;
+
+#if CONFIG_EXAMPLE_ENC28J60_SPI_TRACE
+#define TRACE_CHUNK_ENTRIES 8
+
+/** Move the next records out of the SPI trace, complain about lost ones */
+static uint32_t enc28j60_trace_fetch(eth_enc28j60_trace_entry_t *entries, uint32_t max_entries)
+{
+    eth_enc28j60_trace_dump_t dump = {
+        .entries = entries,
+        .max_entries = max_entries
     };
-    ESP_ERROR_CHECK(spi_bus_initialize(CONFIG_EXAMPLE_ENC28J60_SPI_HOST, &buscfg, 1));
+    if (!s_first_mac || esp_eth_mac_enc28j60_ioctl(s_first_mac, ENC28J60_CMD_G_SPI_TRACE, &dump) != ESP_OK) {
+        return 0;
+    }
+    if (dump.lost) {
+        ESP_LOGW(TAG, "SPI trace: %d records lost", dump.lost);
+    }
+    return dump.num_entries;
+}
+
+#if CONFIG_EXAMPLE_ENC28J60_SPI_TRACE_PORT
+/** Stream the SPI trace to one TCP client at a time */
+static void enc28j60_trace_task(void *arg)
+{
+    eth_enc28j60_trace_entry_t entries[TRACE_CHUNK_ENTRIES];
+    const uint32_t header[2] = {ENC28J60_TRACE_MAGIC, ENC28J60_TRACE_VERSION | (sizeof(entries[0]) << 16)};
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(CONFIG_EXAMPLE_ENC28J60_SPI_TRACE_PORT),
+        .sin_addr.s_addr = htonl(INADDR_ANY)
+    };
+    int listen_sock = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+    if (listen_sock < 0 || bind(listen_sock, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(listen_sock, 1) != 0) {
+        ESP_LOGE(TAG, "SPI trace: can't listen on port %d", CONFIG_EXAMPLE_ENC28J60_SPI_TRACE_PORT);
+        vTaskDelete(NULL);
+        return;
+    }
+    while (1) {
+        int sock = accept(listen_sock, NULL, NULL);
+        if (sock < 0) {
+            continue;
+        }
+        ESP_LOGI(TAG, "SPI trace: client connected");
+        /* only stream what happens from now on */
+        while (enc28j60_trace_fetch(entries, TRACE_CHUNK_ENTRIES)) {
+        }
+        int sent = send(sock, header, sizeof(header), 0);
+        while (sent > 0) {
+            uint32_t num = enc28j60_trace_fetch(entries, TRACE_CHUNK_ENTRIES);
+            if (num) {
+                sent = send(sock, entries, num * sizeof(entries[0]), 0);
+            } else {
+                vTaskDelay(pdMS_TO_TICKS(20));
+            }
+        }
+        ESP_LOGI(TAG, "SPI trace: client disconnected");
+        close(sock);
+    }
+}
+#else
+/** Log the SPI trace as hex lines, one line per chunk so lines of other tasks don't split records */
+static void enc28j60_trace_task(void *arg)
+{
+    eth_enc28j60_trace_entry_t entries[TRACE_CHUNK_ENTRIES];
+    static char line[sizeof(entries) * 2 + 1];
+    while (1) {
+        uint32_t num = enc28j60_trace_fetch(entries, TRACE_CHUNK_ENTRIES);
+        if (!num) {
+            vTaskDelay(pdMS_TO_TICKS(100));
+            continue;
+        }
+        const uint8_t *bytes = (const uint8_t *)entries;
+        for (uint32_t i = 0; i < num * sizeof(entries[0]); i++) {
+            snprintf(line + i * 2, 3, "%02x", bytes[i]);
+        }
+        ESP_LOGI(TAG, "E28T:%s", line);
+    }
+}
+#endif
+#endif
+
+#if CONFIG_EXAMPLE_ENC28J60_RX_LATENCY
+/** Copy the receive latency histograms of the first controller into Modbus registers, saturated to 16 bit.
+ *  Per stage: frame count (low, high word), mean and max time in us, then the ENC28J60_RX_LAT_BUCKETS buckets
+ */
+int ethernet_rx_latency_regs(uint16_t *regs, int num)
+{
+    eth_enc28j60_rx_latency_t latency;
+    int n = 0;
+    if (!s_first_mac || esp_eth_mac_enc28j60_ioctl(s_first_mac, ENC28J60_CMD_G_RX_LATENCY, &latency) != ESP_OK) {
+        return 0;
+    }
+    for (int i = 0; i < ENC28J60_RX_LAT_STAGES && n + ETHERNET_RX_LATENCY_STAGE_REGS <= num; i++) {
+        const eth_enc28j60_lat_hist_t *hist = &latency.stage[i];
+        uint32_t mean = hist->count ? hist->sum_us / hist->count : 0;
+        regs[n++] = hist->count & 0xFFFF;
+        regs[n++] = hist->count >> 16;
+        regs[n++] = mean > UINT16_MAX ? UINT16_MAX : mean;
+        regs[n++] = hist->max_us > UINT16_MAX ? UINT16_MAX : hist->max_us;
+        for (int b = 0; b < ENC28J60_RX_LAT_BUCKETS; b++) {
+            regs[n++] = hist->buckets[b] > UINT16_MAX ? UINT16_MAX : hist->buckets[b];
+        }
+    }
+    return n;
+}
+#endif
+
+/** Create the MAC and PHY of one controller */
+static esp_eth_mac_t *enc28j60_mac_new(int index, esp_netif_t *netif, esp_eth_phy_t **phy_out)
+{
     /* ENC28J60 ethernet driver is based on spi driver */
     spi_device_interface_config_t devcfg = {
         .command_bits = 3,
         .address_bits = 5,
         .mode = 0,
         .clock_speed_hz = CONFIG_EXAMPLE_ENC28J60_SPI_CLOCK_MHZ * 1000 * 1000,
-        .spics_io_num = CONFIG_EXAMPLE_ENC28J60_CS_GPIO,
+        .spics_io_num = s_port_gpio[index][0],
         .queue_size = 20
     };
     spi_device_handle_t spi_handle = NULL;
     ESP_ERROR_CHECK(spi_bus_add_device(CONFIG_EXAMPLE_ENC28J60_SPI_HOST, &devcfg, &spi_handle));
 
     eth_enc28j60_config_t enc28j60_config = ETH_ENC28J60_DEFAULT_CONFIG(spi_handle);
-    enc28j60_config.int_gpio_num = CONFIG_EXAMPLE_ENC28J60_INT_GPIO;
+    enc28j60_config.int_gpio_num = s_port_gpio[index][1];
+    enc28j60_config.spi_host_id = CONFIG_EXAMPLE_ENC28J60_SPI_HOST;
+#if CONFIG_EXAMPLE_ENC28J60_SPI_CALIBRATE
+    enc28j60_config.spi_devcfg = &devcfg;
+#endif
+    enc28j60_config.rx_buf_size = CONFIG_EXAMPLE_ENC28J60_RX_BUFFER_SIZE & ~1; // the receive buffer must end on an odd address
+    enc28j60_config.spi_dma_threshold = CONFIG_EXAMPLE_ENC28J60_SPI_DMA_THRESHOLD;
+    enc28j60_config.rx_batch_max = CONFIG_EXAMPLE_ENC28J60_RX_BATCH_MAX;
+    enc28j60_config.napi_threshold = CONFIG_EXAMPLE_ENC28J60_NAPI_THRESHOLD;
+#if CONFIG_EXAMPLE_ENC28J60_NAPI_THRESHOLD > 0
+    enc28j60_config.napi_budget = CONFIG_EXAMPLE_ENC28J60_NAPI_BUDGET;
+    enc28j60_config.napi_window_us = CONFIG_EXAMPLE_ENC28J60_NAPI_WINDOW_US;
+#endif
+#if CONFIG_EXAMPLE_ENC28J60_RX_MODE_POOL
+    enc28j60_config.rx_mode = ENC28J60_RX_MODE_POOL;
+    enc28j60_config.rx_pool_small_num = CONFIG_EXAMPLE_ENC28J60_RX_POOL_SMALL_NUM;
+    enc28j60_config.rx_pool_large_num = CONFIG_EXAMPLE_ENC28J60_RX_POOL_LARGE_NUM;
+#elif CONFIG_EXAMPLE_ENC28J60_RX_MODE_PBUF
+    enc28j60_config.rx_mode = ENC28J60_RX_MODE_PBUF;
+#else
+    enc28j60_config.rx_mode = ENC28J60_RX_MODE_HEAP;
+#endif
+    enc28j60_config.netif = netif;
+#if CONFIG_EXAMPLE_ENC28J60_CSUM_OFFLOAD && LWIP_CHECKSUM_CTRL_PER_NETIF
+    enc28j60_config.csum_offload = ENC28J60_CSUM_OFFLOAD_TX | ENC28J60_CSUM_OFFLOAD_RX;
+#elif CONFIG_EXAMPLE_ENC28J60_CSUM_OFFLOAD
+    /* lwIP fills in every checksum itself, so only verifying received frames saves it any work */
+    enc28j60_config.csum_offload = ENC28J60_CSUM_OFFLOAD_RX;
+#endif
+#if CONFIG_EXAMPLE_ENC28J60_TX_STATUS
+    enc28j60_config.tx_status = true;
+#endif
+    enc28j60_config.tx_latecol_retries = CONFIG_EXAMPLE_ENC28J60_LATECOL_RETRIES;
+#if CONFIG_EXAMPLE_ENC28J60_SPI_TRACE
+    if (index == 0) {
+        enc28j60_config.spi_trace_depth = CONFIG_EXAMPLE_ENC28J60_SPI_TRACE_DEPTH;
+    }
+#endif
+#if CONFIG_EXAMPLE_ENC28J60_RX_LATENCY
+    enc28j60_config.rx_latency = (index == 0);
+#endif
 
     eth_mac_config_t mac_config = ETH_MAC_DEFAULT_CONFIG();
     mac_config.smi_mdc_gpio_num = -1;  // ENC28J60 doesn't have SMI interface
     mac_config.smi_mdio_gpio_num = -1;
     esp_eth_mac_t *mac = esp_eth_mac_new_enc28j60(&enc28j60_config, &mac_config);
+    if (!mac) {
+        ESP_LOGE(TAG, "create MAC of port %d failed", index);
+        spi_bus_remove_device(spi_handle);
+        return NULL;
+    }
+    if (index == 0) {
+        s_first_mac = mac;
+    }
 
     eth_phy_config_t phy_config = ETH_PHY_DEFAULT_CONFIG();
     phy_config.autonego_timeout_ms = 0; // ENC28J60 doesn't support auto-negotiation
     phy_config.reset_gpio_num = -1; // ENC28J60 doesn't have a pin to reset internal PHY
     esp_eth_phy_t *phy = esp_eth_phy_new_enc28j60(&phy_config);
+    *phy_out = phy;
+    enc28j60_duplex_setup(phy, index);
+
+#if CONFIG_EXAMPLE_ENC28J60_LINK_IRQ
+    /* link changes are reported by interrupt, periodic link check only polls if enabled */
+    eth_enc28j60_link_handler_t link_handler = {
+        .handler = enc28j60_link_irq_handler,
+        .arg = phy
+    };
+    ESP_ERROR_CHECK(esp_eth_mac_enc28j60_ioctl(mac, ENC28J60_CMD_S_LINK_HANDLER, &link_handler));
+#if !CONFIG_EXAMPLE_ENC28J60_LINK_POLL
+    ESP_ERROR_CHECK(esp_eth_phy_enc28j60_set_link_polling(phy, false));
+#endif
+#endif
+
+    return mac;
+}
+
+/** Bring up one port: SPI devices, driver, netif */
+static void enc28j60_port_start(int index)
+{
+    enc28j60_port_t *port = &s_ports[index];
+
+    if (index == 0) {
+        esp_netif_config_t netif_cfg = ESP_NETIF_DEFAULT_ETH();
+        port->netif = esp_netif_new(&netif_cfg);
+        eth_netif = port->netif;
+    } else {
+        /* further ports need their own key and description, and rank below port 0 for the default route */
+        char if_key[8];
+        char if_desc[8];
+        snprintf(if_key, sizeof(if_key), "ETH_%d", index);
+        snprintf(if_desc, sizeof(if_desc), "eth%d", index);
+        esp_netif_inherent_config_t netif_base = ESP_NETIF_INHERENT_DEFAULT_ETH();
+        netif_base.if_key = if_key;
+        netif_base.if_desc = if_desc;
+        netif_base.route_prio -= index;
+        esp_netif_config_t netif_cfg = {
+            .base = &netif_base,
+            .stack = ESP_NETIF_NETSTACK_DEFAULT_ETH
+        };
+        port->netif = esp_netif_new(&netif_cfg);
+    }
+
+    esp_eth_phy_t *phy = NULL;
+#if CONFIG_EXAMPLE_ENC28J60_PRP
+    /* one redundant MAC and PHY on top of both controllers, each LAN follows its own link */
+    esp_eth_phy_t *enc28j60_phys[2] = {NULL};
+    esp_eth_mac_t *enc28j60_macs[2] = {
+        enc28j60_mac_new(0, port->netif, &enc28j60_phys[0]),
+        enc28j60_mac_new(1, port->netif, &enc28j60_phys[1])
+    };
+    eth_enc28j60_prp_config_t prp_config = ETH_ENC28J60_PRP_DEFAULT_CONFIG(enc28j60_macs[0], enc28j60_macs[1],
+                                           enc28j60_phys[0], enc28j60_phys[1]);
+    esp_eth_mac_t *mac = NULL;
+    if (enc28j60_macs[0] && enc28j60_macs[1]) {
+        mac = esp_eth_mac_new_enc28j60_prp(&prp_config);
+    }
+    phy = mac ? esp_eth_mac_enc28j60_prp_get_phy(mac) : NULL;
+#else
+    esp_eth_mac_t *enc28j60_macs[1] = {enc28j60_mac_new(index, port->netif, &phy)};
+    esp_eth_mac_t *mac = enc28j60_macs[0];
+#endif
+    if (!mac) {
+        /* leave the port out rather than abort the boot, the other ports keep working */
+        ESP_LOGE(TAG, "port %d disabled", index);
+        for (int i = 0; i < sizeof(enc28j60_macs) / sizeof(enc28j60_macs[0]); i++) {
+            if (enc28j60_macs[i]) {
+                enc28j60_macs[i]->del(enc28j60_macs[i]);
+            }
+        }
+#if CONFIG_EXAMPLE_ENC28J60_PRP
+        for (int i = 0; i < 2; i++) {
+            if (enc28j60_phys[i]) {
+                enc28j60_phys[i]->del(enc28j60_phys[i]);
+            }
+        }
+#endif
+        if (phy) {
+            phy->del(phy);
+        }
+        esp_netif_destroy(port->netif);
+        port->netif = NULL;
+        if (index == 0) {
+            eth_netif = NULL;
+            s_first_mac = NULL;
+        }
+        return;
+    }
+    port->mac = mac;
+    port->phy = phy;
+    for (int i = 0; i < sizeof(enc28j60_macs) / sizeof(enc28j60_macs[0]); i++) {
+        port->ctrl[i] = enc28j60_macs[i];
+    }
 
     esp_eth_config_t eth_config = ETH_DEFAULT_CONFIG(mac, phy);
-    esp_eth_handle_t eth_handle = NULL;
-    ESP_ERROR_CHECK(esp_eth_driver_install(&eth_config, &eth_handle));
+    ESP_ERROR_CHECK(esp_eth_driver_install(&eth_config, &port->eth_handle));
 
     /* ENC28J60 doesn't burn any factory MAC address, we need to set it manually.
        02:00:00 is a Locally Administered OUI range so should not be used except when testing on a LAN under your control.
     */
     mac->set_addr(mac, (uint8_t[]) {
-        0x02, 0x00, 0x00, 0x12, 0x34, 0x56
+        0x02, 0x00, 0x00, 0x12, 0x34, 0x56 + index
     });
 
+#if CONFIG_EXAMPLE_ENC28J60_SPI_CALIBRATE
+    for (int i = 0; i < sizeof(enc28j60_macs) / sizeof(enc28j60_macs[0]); i++) {
+        enc28j60_spi_clock_setup(enc28j60_macs[i], index + i);
+    }
+#endif
+
+#if CONFIG_EXAMPLE_ENC28J60_HW_FILTER
+    /* Drop unwanted multicasts in the controller: unicast to us, broadcasts (ARP, DHCP) and the groups lwIP has
+       joined pass. Groups are added by the IGMP/MLD hooks once the netif exists, the all-hosts and all-nodes groups
+       are joined while the netif is added, before that */
+    uint8_t rx_filter = ERXFCON_UCEN | ERXFCON_CRCEN | ERXFCON_BCEN | ERXFCON_HTEN;
+    for (int i = 0; i < sizeof(enc28j60_macs) / sizeof(enc28j60_macs[0]); i++) {
+        ESP_ERROR_CHECK(esp_eth_mac_enc28j60_ioctl(enc28j60_macs[i], ENC28J60_CMD_ADD_MAC_FILTER, (uint8_t[]) {
+            0x01, 0x00, 0x5E, 0x00, 0x00, 0x01
+        }));
+        ESP_ERROR_CHECK(esp_eth_mac_enc28j60_ioctl(enc28j60_macs[i], ENC28J60_CMD_ADD_MAC_FILTER, (uint8_t[]) {
+            0x33, 0x33, 0x00, 0x00, 0x00, 0x01
+        }));
+        ESP_ERROR_CHECK(esp_eth_mac_enc28j60_ioctl(enc28j60_macs[i], ENC28J60_CMD_S_RX_FILTER, &rx_filter));
+    }
+#endif
+
+    for (int i = 0; i < sizeof(enc28j60_macs) / sizeof(enc28j60_macs[0]); i++) {
+        if (s_full_duplex[index + i]) {
+            enc28j60_duplex_check(enc28j60_macs[i], index + i);
+        }
+    }
+
     /* attach Ethernet driver to TCP/IP stack */
-    ESP_ERROR_CHECK(esp_netif_attach(eth_netif, esp_eth_new_netif_glue(eth_handle)));
+    ESP_ERROR_CHECK(esp_netif_attach(port->netif, esp_eth_new_netif_glue(port->eth_handle)));
     /* start Ethernet driver state machine */
-    ESP_ERROR_CHECK(esp_eth_start(eth_handle));
+    ESP_ERROR_CHECK(esp_eth_start(port->eth_handle));
+
+#if CONFIG_EXAMPLE_ENC28J60_CSUM_OFFLOAD
+    /* show from which length on the DMA engine beats checksumming on the CPU with this SPI clock */
+    for (int i = 0; i < 4; i++) {
+        eth_enc28j60_csum_bench_t bench = {
+            .len = (uint16_t[]) {64, 256, 576, 1460}[i],
+            .iterations = 16
+        };
+        if (esp_eth_mac_enc28j60_ioctl(enc28j60_macs[0], ENC28J60_CMD_CSUM_BENCH, &bench) == ESP_OK) {
+            ESP_LOGI(TAG, "checksum of %d bytes: cpu %d us, dma %d us", bench.len, bench.sw_time_us, bench.dma_time_us);
+        }
+    }
+#endif
+}
+
+void ethernetConnect(void)
+{
+    ESP_ERROR_CHECK(gpio_install_isr_service(0));
+    // Initialize TCP/IP network interface (should be called only once in application)
+    ESP_ERROR_CHECK(esp_netif_init());
+    // Create default event loop that running in background
+    //ESP_ERROR_CHECK(esp_event_loop_create_default());
+    // Register user defined event handers, they also drive the netifs of the ports
+    ESP_ERROR_CHECK(esp_event_handler_register(ETH_EVENT, ESP_EVENT_ANY_ID, &eth_event_handler, NULL));
+    ESP_ERROR_CHECK(esp_event_handler_register(IP_EVENT, IP_EVENT_ETH_GOT_IP, &got_ip_event_handler, NULL));
+
+    spi_bus_config_t buscfg = {
+        .miso_io_num = CONFIG_EXAMPLE_ENC28J60_MISO_GPIO,
+        .mosi_io_num = CONFIG_EXAMPLE_ENC28J60_MOSI_GPIO,
+        .sclk_io_num = CONFIG_EXAMPLE_ENC28J60_SCLK_GPIO,
+        .quadwp_io_num = -1,
+        .quadhd_io_num = -1,
+    };
+    ESP_ERROR_CHECK(spi_bus_initialize(CONFIG_EXAMPLE_ENC28J60_SPI_HOST, &buscfg, 1));
+    for (int i = 0; i < ETH_PORTS; i++) {
+        enc28j60_port_start(i);
+    }
+#if CONFIG_EXAMPLE_ENC28J60_SPI_TRACE
+    xTaskCreate(enc28j60_trace_task, "enc28j60_trace", 3072, NULL, 2, NULL);
+#endif
 }
 
 void ethernetDisconnect(){
@@ -2,4 +2,10 @@ extern void ethernetConnect();
 extern void ethernetDisconnect();
 extern esp_netif_t* wifi_start();
 extern esp_netif_t *get_netif(void);
+extern esp_netif_t *get_netif_port(int port);
+extern int ethernet_port_count(void);
 extern bool ethConnected();
+
+/** Modbus registers per receive path stage written by ethernet_rx_latency_regs() */
+#define ETHERNET_RX_LATENCY_STAGE_REGS 20
+extern int ethernet_rx_latency_regs(uint16_t *regs, int num);
@@ -11,6 +11,7 @@
 // WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
 // See the License for the specific language governing permissions and
 // limitations under the License.
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <sys/cdefs.h>
@@ -22,10 +23,15 @@
 #include "esp_intr_alloc.h"
 #include "esp_heap_caps.h"
 #include "esp_rom_sys.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/semphr.h"
 #include "hal/cpu_hal.h"
+#include "lwip/pbuf.h"
+#include "lwip/netif.h"
+#include "lwip/inet_chksum.h"
+#include "lwip/prot/ip.h"
 #include "enc28j60.h"
 #include "sdkconfig.h"
 
@@ -53,13 +59,229 @@ static const char *TAG = "enc28j60";
  * |  RX  | RX: 6 KB : [0x0000, 0x1800)
  * |______|
  *
+ * Default partition, the RX size can be changed by configuration or at runtime (see rx_end and tx_start of emac)
  */
 #define ENC28J60_BUF_RX_START (0)
-#define ENC28J60_BUF_RX_END (ENC28J60_BUF_TX_START - 1)
-#define ENC28J60_BUF_TX_START ((ENC28J60_BUFFER_SIZE / 4) * 3)
+#define ENC28J60_BUF_RX_SIZE_DEFAULT ((ENC28J60_BUFFER_SIZE / 4) * 3)
 #define ENC28J60_BUF_TX_END (ENC28J60_BUFFER_SIZE - 1)
+#define ENC28J60_BUF_RX_SIZE_MIN (0x0800)                                         // Room for at least one full size frame
+#define ENC28J60_BUF_TX_SIZE_MIN (1 + ENC28J60_TX_MAX_FRAME_LEN + ENC28J60_TSV_SIZE) // Control byte, longest frame and TSV
 
 #define ENC28J60_RSV_SIZE (6) // Receive Status Vector Size
+#define ENC28J60_RX_MAX_FRAME_LEN (1536) // MAMXFL reset value, longer frames are never stored
+#define ENC28J60_TX_MAX_FRAME_LEN (ENC28J60_RX_MAX_FRAME_LEN - 4) // without CRC, redundancy trailers may exceed ETH_MAX_PACKET_SIZE
+#define ENC28J60_ETH_HDR_LEN (14)
+#define ENC28J60_DMA_SPIN_MAX (1000) // ECON1 polls before a DMA operation is considered stuck
+#define ENC28J60_SPI_HOST_NUM (3) // SPI1_HOST..SPI3_HOST
+#define ENC28J60_BUS_DEVICES_MAX (3) // devices (CS lines) per SPI host
+#define ENC28J60_SPI_CLOCK_MAX_HZ (20 * 1000 * 1000)
+#define ENC28J60_SPI_CALIB_LEN (256)  // bytes written and read back per round
+#define ENC28J60_SPI_CALIB_ROUNDS (16)
+#define ENC28J60_SPI_READD_RETRIES (5)   // attempts to get the SPI device back at the old clock before giving up
+#define ENC28J60_SPI_CONFIRM_ROUNDS (4)  // memory loopback rounds confirming a read back error before the clock drops
+#define ENC28J60_RX_FILTER_DEFAULT (ERXFCON_UCEN | ERXFCON_CRCEN | ERXFCON_BCEN)
+#define ENC28J60_TSV_SIZE (7) // Transmit Status Vector Size, written by the chip right after the frame
+
+#define ENC28J60_EIR_HANDLED (EIR_PKTIF | EIR_TXIF | EIR_TXERIF | EIR_RXERIF | EIR_LINKIF) // Interrupt flags serviced by the driver task
+
+#define ENC28J60_TX_RING_SLOTS (8)          // Frames queued in the transmit buffer at most
+#define ENC28J60_LOOPBACK_ETHERTYPE (0x88B5) // IEEE 802 local experimental, for the duplex loopback frame
+#define ENC28J60_LOOPBACK_TIMEOUT_MS (100)   // How long the duplex test waits for its frame
+
+#define ENC28J60_BATCH_MAX_OPS (16)   // Maximum register operations collected in one batch
+#define ENC28J60_SPI_QUEUE_DEPTH (20) // Transactions queued at once, must not exceed queue_size of the SPI device
+
+#define ENC28J60_BANK_ANY (0xFE) // Operation on a shared register, runs in whatever bank is selected
+#define ENC28J60_REG_BANK_OF(reg) (ENC28J60_REG_IS_SHARED(reg) ? ENC28J60_BANK_ANY : ENC28J60_REG_BANK(reg))
+
+#define ENC28J60_OP_FENCE (1 << 0) // Operation must not be reordered against any other operation in the batch
+
+#define ENC28J60_RX_POOL_SMALL_SIZE (256)                             // Frames up to this length (including CRC) use the small class
+#define ENC28J60_RX_POOL_LARGE_SIZE ((ENC28J60_RX_MAX_FRAME_LEN + 3) & ~3) // DMA needs the buffer length 4 byte aligned
+#define ENC28J60_RX_POOL_NONE (0xFFFF)                               // Empty freelist / end of freelist
+
+/**
+ * @brief Register operation recorded in a batch, its execution order is planned when the batch is submitted
+ */
+typedef struct {
+    uint16_t reg_addr; // register address, including bank and type bits
+    uint8_t cmd;       // ENC28J60_SPI_CMD_WCR, ENC28J60_SPI_CMD_BFS or ENC28J60_SPI_CMD_BFC
+    uint8_t value;     // value to write or bit mask to set/clear
+    uint8_t bank;      // bank the register lives in, or ENC28J60_BANK_ANY
+    uint8_t flags;     // ENC28J60_OP_xxx
+} enc28j60_reg_op_t;
+
+/**
+ * @brief Entry of a static register sequence table, values are supplied when the sequence is added to a batch
+ */
+typedef struct {
+    uint16_t reg_addr;
+    uint8_t cmd;
+    uint8_t bank;
+    uint8_t flags;
+} enc28j60_reg_seq_t;
+
+#define ENC28J60_SEQ_OP(op_cmd, reg, op_flags)  \
+    {                                           \
+        .reg_addr = (reg),                      \
+        .cmd = (op_cmd),                        \
+        .bank = ENC28J60_REG_BANK_OF(reg),      \
+        .flags = (op_flags)                     \
+    }
+#define ENC28J60_SEQ_WCR(reg) ENC28J60_SEQ_OP(ENC28J60_SPI_CMD_WCR, reg, 0)
+#define ENC28J60_SEQ_BFS(reg) ENC28J60_SEQ_OP(ENC28J60_SPI_CMD_BFS, reg, 0)
+#define ENC28J60_SEQ_BFC(reg) ENC28J60_SEQ_OP(ENC28J60_SPI_CMD_BFC, reg, 0)
+
+/**
+ * @brief Move the buffer write pointer to where a new frame gets copied
+ * @note values: EWRPTL, EWRPTH
+ */
+static const enc28j60_reg_seq_t enc28j60_tx_write_ptr_seq[] = {
+    ENC28J60_SEQ_WCR(ENC28J60_EWRPTL),
+    ENC28J60_SEQ_WCR(ENC28J60_EWRPTH),
+};
+
+/**
+ * @brief Point the transmit logic at a frame already in buffer memory and start transmission
+ * @note values: ETXSTL, ETXSTH, ETXNDL, ETXNDH, ECON1 bits to set
+ */
+static const enc28j60_reg_seq_t enc28j60_tx_kick_seq[] = {
+    ENC28J60_SEQ_WCR(ENC28J60_ETXSTL),
+    ENC28J60_SEQ_WCR(ENC28J60_ETXSTH),
+    ENC28J60_SEQ_WCR(ENC28J60_ETXNDL),
+    ENC28J60_SEQ_WCR(ENC28J60_ETXNDH),
+    ENC28J60_SEQ_OP(ENC28J60_SPI_CMD_BFS, ENC28J60_ECON1, ENC28J60_OP_FENCE),
+};
+
+/**
+ * @brief Move the buffer read pointer
+ * @note values: ERDPTL, ERDPTH
+ */
+static const enc28j60_reg_seq_t enc28j60_rx_read_ptr_seq[] = {
+    ENC28J60_SEQ_WCR(ENC28J60_ERDPTL),
+    ENC28J60_SEQ_WCR(ENC28J60_ERDPTH),
+};
+
+/**
+ * @brief Free the receive buffer space of a processed frame
+ * @note values: ERXRDPTL, ERXRDPTH, ECON2 bits to set. PKTDEC is fenced: ECON2 is reachable from every bank, so
+ *       the planner would otherwise issue it ahead of the bank 0 ERXRDPT writes when another bank is selected
+ */
+static const enc28j60_reg_seq_t enc28j60_rx_release_seq[] = {
+    ENC28J60_SEQ_WCR(ENC28J60_ERXRDPTL),
+    ENC28J60_SEQ_WCR(ENC28J60_ERXRDPTH),
+    ENC28J60_SEQ_OP(ENC28J60_SPI_CMD_BFS, ENC28J60_ECON2, ENC28J60_OP_FENCE),
+};
+
+/**
+ * @brief Default setup of internal registers
+ * @note values: see enc28j60_setup_default(), the first ENC28J60_SETUP_SEQ_PARTITION_OPS entries program the buffer partition
+ */
+static const enc28j60_reg_seq_t enc28j60_setup_seq[] = {
+    ENC28J60_SEQ_WCR(ENC28J60_ERXSTL),
+    ENC28J60_SEQ_WCR(ENC28J60_ERXSTH),
+    ENC28J60_SEQ_WCR(ENC28J60_ERXNDL),
+    ENC28J60_SEQ_WCR(ENC28J60_ERXNDH),
+    ENC28J60_SEQ_WCR(ENC28J60_ERXRDPTL),
+    ENC28J60_SEQ_WCR(ENC28J60_ERXRDPTH),
+    ENC28J60_SEQ_WCR(ENC28J60_ETXSTL),
+    ENC28J60_SEQ_WCR(ENC28J60_ETXSTH),
+    ENC28J60_SEQ_WCR(ENC28J60_ERXFCON),
+    ENC28J60_SEQ_WCR(ENC28J60_MACON1),
+    ENC28J60_SEQ_WCR(ENC28J60_MACON3),
+    ENC28J60_SEQ_WCR(ENC28J60_MACON4),
+    ENC28J60_SEQ_WCR(ENC28J60_MABBIPG),
+    ENC28J60_SEQ_WCR(ENC28J60_MAIPGL),
+    ENC28J60_SEQ_WCR(ENC28J60_MAIPGH),
+};
+#define ENC28J60_SETUP_SEQ_PARTITION_OPS (8) // ERXST, ERXND, ERXRDPT, ETXST
+#define ENC28J60_SETUP_SEQ_RX_RING_OPS (6)   // ERXST, ERXND, ERXRDPT
+
+/**
+ * @brief SPI clocks tried by calibration, APB clock (80 MHz) divided by 10, 8, 6, 5 and 4
+ */
+static const uint32_t enc28j60_spi_clocks[] = {
+    8000000, 10000000, 13333333, 16000000, 20000000
+};
+#define ENC28J60_SPI_CLOCKS_NUM (int)(sizeof(enc28j60_spi_clocks) / sizeof(enc28j60_spi_clocks[0]))
+
+/**
+ * @brief Program the multicast hash table
+ * @note values: EHT0..EHT7
+ */
+static const enc28j60_reg_seq_t enc28j60_hash_table_seq[] = {
+    ENC28J60_SEQ_WCR(ENC28J60_EHT0),
+    ENC28J60_SEQ_WCR(ENC28J60_EHT1),
+    ENC28J60_SEQ_WCR(ENC28J60_EHT2),
+    ENC28J60_SEQ_WCR(ENC28J60_EHT3),
+    ENC28J60_SEQ_WCR(ENC28J60_EHT4),
+    ENC28J60_SEQ_WCR(ENC28J60_EHT5),
+    ENC28J60_SEQ_WCR(ENC28J60_EHT6),
+    ENC28J60_SEQ_WCR(ENC28J60_EHT7),
+};
+
+/**
+ * @brief Program the pattern match filter
+ * @note values: EPMM0..EPMM7, EPMCSL, EPMCSH, EPMOL, EPMOH
+ */
+static const enc28j60_reg_seq_t enc28j60_pattern_seq[] = {
+    ENC28J60_SEQ_WCR(ENC28J60_EPMM0),
+    ENC28J60_SEQ_WCR(ENC28J60_EPMM1),
+    ENC28J60_SEQ_WCR(ENC28J60_EPMM2),
+    ENC28J60_SEQ_WCR(ENC28J60_EPMM3),
+    ENC28J60_SEQ_WCR(ENC28J60_EPMM4),
+    ENC28J60_SEQ_WCR(ENC28J60_EPMM5),
+    ENC28J60_SEQ_WCR(ENC28J60_EPMM6),
+    ENC28J60_SEQ_WCR(ENC28J60_EPMM7),
+    ENC28J60_SEQ_WCR(ENC28J60_EPMCSL),
+    ENC28J60_SEQ_WCR(ENC28J60_EPMCSH),
+    ENC28J60_SEQ_WCR(ENC28J60_EPMOL),
+    ENC28J60_SEQ_WCR(ENC28J60_EPMOH),
+};
+
+/**
+ * @brief Program the MAC address
+ * @note values: MAADR6..MAADR1
+ */
+static const enc28j60_reg_seq_t enc28j60_mac_addr_seq[] = {
+    ENC28J60_SEQ_WCR(ENC28J60_MAADR6),
+    ENC28J60_SEQ_WCR(ENC28J60_MAADR5),
+    ENC28J60_SEQ_WCR(ENC28J60_MAADR4),
+    ENC28J60_SEQ_WCR(ENC28J60_MAADR3),
+    ENC28J60_SEQ_WCR(ENC28J60_MAADR2),
+    ENC28J60_SEQ_WCR(ENC28J60_MAADR1),
+};
+
+/**
+ * @brief Sequence of register operations submitted to ENC28J60 under a single lock
+ */
+typedef struct {
+    enc28j60_reg_op_t ops[ENC28J60_BATCH_MAX_OPS];
+    uint32_t num_ops;
+    bool overflow;
+} enc28j60_batch_t;
+
+/**
+ * @brief Non-volatile control registers mirrored by the shadow register cache
+ * @note ordered by bank, so that a full resync needs as few bank switches as possible
+ */
+static const uint16_t enc28j60_shadow_regs[] = {
+    ENC28J60_ECON2, ENC28J60_EIE,
+    ENC28J60_ETXSTL, ENC28J60_ETXSTH, ENC28J60_ERXSTL, ENC28J60_ERXSTH, ENC28J60_ERXNDL, ENC28J60_ERXNDH,
+    ENC28J60_ERXFCON,
+    ENC28J60_MACON1, ENC28J60_MACON2, ENC28J60_MACON3, ENC28J60_MACON4, ENC28J60_MICMD,
+    ENC28J60_MAADR5, ENC28J60_MAADR6, ENC28J60_MAADR3, ENC28J60_MAADR4, ENC28J60_MAADR1, ENC28J60_MAADR2,
+};
+#define ENC28J60_SHADOW_NUM ((int)(sizeof(enc28j60_shadow_regs) / sizeof(enc28j60_shadow_regs[0])))
+#define ENC28J60_SHADOW_ECON2_VOLATILE (ECON2_PKTDEC) // self-clearing bits, never cached
+
+/**
+ * @brief Write-through cache of the control registers, saves the SPI read of read-modify-write sequences
+ */
+typedef struct {
+    uint8_t value[ENC28J60_SHADOW_NUM];
+    uint32_t valid; // bit n set: value[n] reflects the register content
+} enc28j60_shadow_t;
 
 typedef struct {
     uint8_t next_packet_low;
@@ -70,28 +292,440 @@ typedef struct {
     uint8_t status_high;
 } enc28j60_rx_header_t;
 
+typedef struct {
+    uint8_t byte_count_low;
+    uint8_t byte_count_high;
+    uint8_t status_low;  // TSV_DONE, TSV_xxx_ERR and TSV_COLLISION_COUNT
+    uint8_t status_high; // TSV_UNDERRUN .. TSV_DEFER
+    uint8_t wire_bytes_low;
+    uint8_t wire_bytes_high;
+    uint8_t status_ctrl; // control, pause, backpressure and VLAN frame flags
+} enc28j60_tx_status_t;
+
+typedef enum {
+    ENC28J60_RX_POOL_SMALL,
+    ENC28J60_RX_POOL_LARGE,
+    ENC28J60_RX_POOL_CLASSES,
+} enc28j60_rx_pool_class_t;
+
+/**
+ * @brief Frame queued in the transmit buffer
+ */
+typedef struct {
+    uint16_t start; // address of the per packet control byte, frame follows immediately
+    uint16_t len;   // frame length
+} enc28j60_tx_desc_t;
+
+/**
+ * @brief Frames packed back to back into the transmit buffer, each followed by space for its TSV
+ * @note the oldest frame is the one being transmitted while busy is set, the others wait for TXIF
+ */
+typedef struct {
+    enc28j60_tx_desc_t desc[ENC28J60_TX_RING_SLOTS];
+    uint32_t head;    // index of oldest queued frame
+    uint32_t count;   // number of queued frames
+    uint32_t wr_addr; // where the next frame gets written
+    bool busy;        // transmit logic is working on desc[head]
+    uint8_t retransmits; // times desc[head] was sent again after a late collision
+} enc28j60_tx_ring_t;
+
+struct enc28j60_rx_pool_s;
+
+/**
+ * @brief Pool buffer descriptor, handed to lwIP as a custom pbuf and returned to its pool when lwIP frees it
+ */
+typedef struct {
+    struct pbuf_custom pbuf; // must be the first member
+    struct enc28j60_rx_pool_s *pool;
+    uint8_t *payload;
+    uint16_t index;
+    uint16_t next; // index of next free buffer, only meaningful while the buffer is on the freelist
+} enc28j60_rx_buf_t;
+
+/**
+ * @brief Fixed size DMA capable receive buffers with a lock-free freelist
+ * @note buffers are taken by the driver task only, but returned from whatever task frees the pbuf (usually tcpip task)
+ */
+typedef struct enc28j60_rx_pool_s {
+    enc28j60_rx_buf_t *bufs;
+    uint8_t *mem;
+    uint32_t head;     // (tag << 16) | index of first free buffer, tag is bumped on every update against ABA
+    uint32_t num_free;
+    uint32_t min_free;
+    uint16_t num;
+    uint16_t buf_size;
+} enc28j60_rx_pool_t;
+
+/**
+ * @brief SPI operation trace ring, written and read under the SPI lock
+ */
+typedef struct {
+    eth_enc28j60_trace_entry_t *entries;
+    uint32_t depth;
+    uint32_t head;      // next entry to write
+    uint32_t count;     // entries not dumped yet
+    uint32_t lost;      // entries overwritten before they were dumped
+    uint32_t lock_wait; // lock wait to report with the next entry, CPU cycles
+    bool enabled;
+} enc28j60_trace_t;
+
+/**
+ * @brief Receive path time stamps, low 32 bits of esp_timer_get_time()
+ * @note esp_timer rather than CCOUNT, the GPIO ISR may run on another core than the driver task
+ */
+typedef struct {
+    uint32_t isr_us;      // first GPIO interrupt since the task last woke up, 0 if none; written by the ISR
+    uint32_t wake_isr_us; // interrupt the frames being received belong to, 0 in polling mode
+    uint32_t mark_us;     // end of the previous stage
+    bool enabled;
+    eth_enc28j60_rx_latency_t stats;
+} enc28j60_rx_lat_t;
+
 typedef struct {
     esp_eth_mac_t parent;
     esp_eth_mediator_t *eth;
     spi_device_handle_t spi_hdl;
+    int spi_host_id;          // -1 if unknown: no ordered bus handover and no clock changes
+    spi_device_interface_config_t spi_devcfg;
+    uint32_t spi_clock_min_hz; // clock the device was added with, 0 if the device can't be re-added at another clock
+    uint32_t spi_fallbacks;
+    bool spi_failed;          // the SPI device could not be re-added, the controller is unusable
     SemaphoreHandle_t spi_lock;
+    SemaphoreHandle_t bus_turn; // given when the bus is handed over to this controller
+    TaskHandle_t spi_owner; // task running a frame transaction, holds spi_lock and the SPI bus
+    uint32_t lock_taken_at;
+    portMUX_TYPE stats_mux; // guards the statistics structs (lock, csum, napi, irq, bank, rx_perf, rx_alloc, rx_lat, tx_status)
+    eth_enc28j60_lock_stats_t lock_stats;
+    eth_enc28j60_link_handler_t link_handler;
+    eth_enc28j60_irq_stats_t irq_stats;
+    uint8_t rx_filter;        // ERXFCON value outside promiscuous mode
+    uint8_t csum_offload;     // ENC28J60_CSUM_OFFLOAD_xxx
+    eth_enc28j60_rx_hook_t rx_hook;
+    eth_enc28j60_csum_stats_t csum_stats;
+    uint8_t hash_table[8];    // EHT0..EHT7
+    uint8_t hash_refs[64];    // addresses using each hash table bit
+    uint32_t napi_threshold;
+    uint32_t napi_budget;
+    uint32_t napi_window_us;
+    eth_enc28j60_napi_stats_t napi_stats;
     TaskHandle_t rx_task_hdl;
     uint32_t sw_reset_timeout_ms;
     uint32_t next_packet_ptr;
+    uint32_t rx_end;   // last byte of receive buffer, receive buffer starts at ENC28J60_BUF_RX_START
+    uint32_t tx_start; // first byte of transmit buffer, transmit buffer ends at ENC28J60_BUF_TX_END
+    uint32_t rx_occupancy_hwm;
     int int_gpio_num;
+    uint32_t spi_dma_threshold;
     uint8_t addr[6];
     uint8_t last_bank;
     bool packets_remain;
+    bool rx_batch_active; // frames are released by PKTDEC only, ERXRDPT is advanced at the end of the batch
+    uint32_t rx_batch_max;
+    uint32_t bank_switches;
+    uint32_t spi_transactions;
+    eth_enc28j60_bank_stats_t bank_stats;
+    enc28j60_shadow_t shadow;
+    esp_netif_t *netif;
+    eth_enc28j60_rx_mode_t rx_mode;
+    eth_enc28j60_rx_perf_t rx_perf;
+    enc28j60_rx_pool_t rx_pool[ENC28J60_RX_POOL_CLASSES];
+    uint32_t rx_drops;
+    eth_enc28j60_rx_alloc_stats_t rx_alloc_stats;
+    SemaphoreHandle_t tx_lock;
+    SemaphoreHandle_t tx_sem; // counting, given once per freed ring slot, so each freed slot wakes one transmitter
+    uint32_t tx_wait_ms;
+    enc28j60_tx_ring_t tx_ring;
+    spi_transaction_t batch_trans[ENC28J60_SPI_QUEUE_DEPTH];
+    enc28j60_trace_t trace;
+    enc28j60_rx_lat_t rx_lat;
+    eth_enc28j60_stats_t stats;
+    bool tx_status_capture;
+    bool tx_late_collision; // set on TXERIF with ESTAT.LATECOL, for the frame the transmit logic finished with
+    uint8_t tx_latecol_retries;
+    eth_enc28j60_tx_status_t tx_status;
+    eth_enc28j60_rx_hook_t loopback_chained_hook; // rx hook installed while the duplex test runs
+    bool loopback_seen;
 } emac_enc28j60_t;
 
+/**
+ * @brief Driver counters are updated from the driver task, transmitting tasks and the SPI lock holder,
+ *        relaxed atomic adds keep them exact without a lock
+ */
+#define ENC28J60_STAT_ADD(emac, field, n) __atomic_fetch_add(&(emac)->stats.field, (n), __ATOMIC_RELAXED)
+#define ENC28J60_STAT_INC(emac, field) ENC28J60_STAT_ADD(emac, field, 1)
+
+/**
+ * @brief Frame transactions of the controllers on one SPI bus, served in the order they were requested
+ * @note a controller waits at most once, as its frame transactions are serialized by its own SPI lock
+ */
+typedef struct {
+    bool busy;
+    emac_enc28j60_t *waiters[ENC28J60_BUS_DEVICES_MAX]; // FIFO
+    uint32_t head;
+    uint32_t count;
+} enc28j60_bus_t;
+
+static enc28j60_bus_t s_enc28j60_bus[ENC28J60_SPI_HOST_NUM];
+static portMUX_TYPE s_enc28j60_bus_mux = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t s_enc28j60_instances;
+
+/**
+ * @brief Append an entry to the SPI trace, the oldest one is overwritten if the ring is full
+ * @note caller must hold the SPI lock
+ */
+static void enc28j60_trace_record(emac_enc28j60_t *emac, uint8_t type, uint8_t opcode, uint32_t len, uint8_t value,
+                                  uint8_t flags, void *caller)
+{
+    enc28j60_trace_t *trace = &emac->trace;
+    if (!trace->enabled) {
+        return;
+    }
+    eth_enc28j60_trace_entry_t *entry = &trace->entries[trace->head];
+    entry->timestamp_us = (uint32_t)esp_timer_get_time();
+    entry->caller = (uint32_t)(uintptr_t)caller;
+    entry->lock_wait_cycles = trace->lock_wait;
+    entry->length = len > UINT16_MAX ? UINT16_MAX : len;
+    entry->type = type;
+    entry->opcode = opcode;
+    entry->value = value;
+    entry->flags = flags;
+    entry->reserved = 0;
+    trace->lock_wait = 0;
+    trace->head = (trace->head + 1) % trace->depth;
+    if (trace->count < trace->depth) {
+        trace->count++;
+    } else {
+        trace->lost++;
+    }
+}
+
+#define ENC28J60_TRACE_SPI_OP(emac, cmd, addr, len, value, flags) \
+    enc28j60_trace_record(emac, ENC28J60_TRACE_SPI, ((cmd) << 5) | ((addr) & 0x1F), len, value, flags, \
+                          __builtin_return_address(0))
+
+#define ENC28J60_TRACE_MARK(emac, type) \
+    enc28j60_trace_record(emac, type, 0, 0, 0, 0, __builtin_return_address(0))
+
+static void enc28j60_rx_lat_add(eth_enc28j60_lat_hist_t *hist, uint32_t us)
+{
+    uint32_t bucket = us ? 32 - __builtin_clz(us) : 0;
+    if (bucket >= ENC28J60_RX_LAT_BUCKETS) {
+        bucket = ENC28J60_RX_LAT_BUCKETS - 1;
+    }
+    hist->buckets[bucket]++;
+    hist->count++;
+    hist->sum_us += us;
+    if (us > hist->max_us) {
+        hist->max_us = us;
+    }
+}
+
+/**
+ * @brief A receive path stage is over, account the time since the end of the previous one
+ */
+static void enc28j60_rx_lat_mark(emac_enc28j60_t *emac, eth_enc28j60_rx_lat_stage_t stage)
+{
+    enc28j60_rx_lat_t *lat = &emac->rx_lat;
+    if (!lat->enabled) {
+        return;
+    }
+    uint32_t now = (uint32_t)esp_timer_get_time();
+    portENTER_CRITICAL(&emac->stats_mux);
+    enc28j60_rx_lat_add(&lat->stats.stage[stage], now - lat->mark_us);
+    if (stage == ENC28J60_RX_LAT_STACK && lat->wake_isr_us) {
+        enc28j60_rx_lat_add(&lat->stats.stage[ENC28J60_RX_LAT_TOTAL], now - lat->wake_isr_us);
+    }
+    portEXIT_CRITICAL(&emac->stats_mux);
+    lat->mark_us = now;
+}
+
+/**
+ * @brief Driver task woke up (irq) or starts a polling round, the header read of the next frame is measured from here
+ */
+static void enc28j60_rx_lat_wakeup(emac_enc28j60_t *emac, bool irq)
+{
+    enc28j60_rx_lat_t *lat = &emac->rx_lat;
+    if (!lat->enabled) {
+        return;
+    }
+    lat->mark_us = (uint32_t)esp_timer_get_time();
+    lat->wake_isr_us = irq ? __atomic_exchange_n(&lat->isr_us, 0, __ATOMIC_RELAXED) : 0;
+    if (lat->wake_isr_us) {
+        portENTER_CRITICAL(&emac->stats_mux);
+        enc28j60_rx_lat_add(&lat->stats.stage[ENC28J60_RX_LAT_WAKEUP], lat->mark_us - lat->wake_isr_us);
+        portEXIT_CRITICAL(&emac->stats_mux);
+    }
+}
+
+
+static bool enc28j60_lock_take(emac_enc28j60_t *emac)
+{
+    if (emac->spi_failed) {
+        return false;
+    }
+    uint32_t start = cpu_hal_get_cycle_count();
+    if (xSemaphoreTake(emac->spi_lock, pdMS_TO_TICKS(ENC28J60_SPI_LOCK_TIMEOUT_MS)) != pdTRUE) {
+        portENTER_CRITICAL(&emac->stats_mux);
+        emac->lock_stats.timeouts++;
+        portEXIT_CRITICAL(&emac->stats_mux);
+        ENC28J60_STAT_INC(emac, lock_timeouts);
+        return false;
+    }
+    emac->lock_taken_at = cpu_hal_get_cycle_count();
+    uint32_t wait = emac->lock_taken_at - start;
+    emac->trace.lock_wait = wait;
+    portENTER_CRITICAL(&emac->stats_mux);
+    emac->lock_stats.acquisitions++;
+    emac->lock_stats.wait_cycles += wait;
+    if (wait > emac->lock_stats.max_wait_cycles) {
+        emac->lock_stats.max_wait_cycles = wait;
+    }
+    portEXIT_CRITICAL(&emac->stats_mux);
+    return true;
+}
+
+static bool enc28j60_lock_give(emac_enc28j60_t *emac)
+{
+    uint32_t hold = cpu_hal_get_cycle_count() - emac->lock_taken_at;
+    portENTER_CRITICAL(&emac->stats_mux);
+    emac->lock_stats.hold_cycles += hold;
+    if (hold > emac->lock_stats.max_hold_cycles) {
+        emac->lock_stats.max_hold_cycles = hold;
+    }
+    portEXIT_CRITICAL(&emac->stats_mux);
+    return xSemaphoreGive(emac->spi_lock) == pdTRUE;
+}
+
+/**
+ * @brief Move entries out of the SPI trace, oldest first
+ */
+static esp_err_t enc28j60_trace_dump(emac_enc28j60_t *emac, eth_enc28j60_trace_dump_t *dump)
+{
+    esp_err_t ret = ESP_OK;
+    enc28j60_trace_t *trace = &emac->trace;
+
+    MAC_CHECK(trace->entries, "SPI trace is disabled", out, ESP_ERR_INVALID_STATE);
+    MAC_CHECK(enc28j60_lock_take(emac), "take SPI lock failed", out, ESP_ERR_TIMEOUT);
+    uint32_t num = trace->count < dump->max_entries ? trace->count : dump->max_entries;
+    uint32_t tail = (trace->head + trace->depth - trace->count) % trace->depth;
+    for (uint32_t i = 0; i < num; i++) {
+        dump->entries[i] = trace->entries[(tail + i) % trace->depth];
+    }
+    trace->count -= num;
+    dump->num_entries = num;
+    dump->lost = trace->lost;
+    trace->lost = 0;
+    trace->lock_wait = 0;
+    enc28j60_lock_give(emac);
+out:
+    return ret;
+}
+
+/**
+ * @brief Lock the SPI device for a single operation
+ * @note inside a frame transaction of the calling task the lock is already held, nothing to do then
+ */
 static inline bool enc28j60_lock(emac_enc28j60_t *emac)
 {
-    return xSemaphoreTake(emac->spi_lock, pdMS_TO_TICKS(ENC28J60_SPI_LOCK_TIMEOUT_MS)) == pdTRUE;
+    if (emac->spi_owner == xTaskGetCurrentTaskHandle()) {
+        return true;
+    }
+    return enc28j60_lock_take(emac);
 }
 
 static inline bool enc28j60_unlock(emac_enc28j60_t *emac)
 {
-    return xSemaphoreGive(emac->spi_lock) == pdTRUE;
+    if (emac->spi_owner == xTaskGetCurrentTaskHandle()) {
+        return true;
+    }
+    return enc28j60_lock_give(emac);
+}
+
+/**
+ * @brief Wait for the turn of this controller on its SPI bus
+ * @note the bus is handed over in request order, not by task priority, so a busy controller can't starve
+ *       another one on the same bus
+ */
+static void enc28j60_bus_take(emac_enc28j60_t *emac)
+{
+    if (emac->spi_host_id < 0) {
+        return;
+    }
+    enc28j60_bus_t *bus = &s_enc28j60_bus[emac->spi_host_id];
+    bool wait = false;
+    portENTER_CRITICAL(&s_enc28j60_bus_mux);
+    if (bus->busy) {
+        bus->waiters[(bus->head + bus->count) % ENC28J60_BUS_DEVICES_MAX] = emac;
+        bus->count++;
+        wait = true;
+    } else {
+        bus->busy = true;
+    }
+    portEXIT_CRITICAL(&s_enc28j60_bus_mux);
+    if (wait) {
+        xSemaphoreTake(emac->bus_turn, portMAX_DELAY);
+    }
+}
+
+/**
+ * @brief Hand the SPI bus over to the controller that waits longest, if any
+ */
+static void enc28j60_bus_give(emac_enc28j60_t *emac)
+{
+    if (emac->spi_host_id < 0) {
+        return;
+    }
+    enc28j60_bus_t *bus = &s_enc28j60_bus[emac->spi_host_id];
+    emac_enc28j60_t *next = NULL;
+    portENTER_CRITICAL(&s_enc28j60_bus_mux);
+    if (bus->count) {
+        next = bus->waiters[bus->head];
+        bus->head = (bus->head + 1) % ENC28J60_BUS_DEVICES_MAX;
+        bus->count--;
+    } else {
+        bus->busy = false;
+    }
+    portEXIT_CRITICAL(&s_enc28j60_bus_mux);
+    if (next) {
+        xSemaphoreGive(next->bus_turn);
+    }
+}
+
+/**
+ * @brief Start a frame transaction: lock the device and acquire the SPI bus once for a whole RX or TX sequence
+ * @note single operations of the calling task run without locking till enc28j60_frame_end()
+ */
+static esp_err_t enc28j60_frame_begin(emac_enc28j60_t *emac)
+{
+    if (!enc28j60_lock_take(emac)) {
+        return ESP_ERR_TIMEOUT;
+    }
+    enc28j60_bus_take(emac);
+    if (spi_device_acquire_bus(emac->spi_hdl, portMAX_DELAY) != ESP_OK) {
+        enc28j60_bus_give(emac);
+        enc28j60_lock_give(emac);
+        return ESP_FAIL;
+    }
+    emac->spi_owner = xTaskGetCurrentTaskHandle();
+    portENTER_CRITICAL(&emac->stats_mux);
+    emac->lock_stats.frame_transactions++;
+    portEXIT_CRITICAL(&emac->stats_mux);
+    return ESP_OK;
+}
+
+/**
+ * @brief End the frame transaction of the calling task, if there is one
+ */
+static void enc28j60_frame_end(emac_enc28j60_t *emac)
+{
+    if (emac->spi_owner != xTaskGetCurrentTaskHandle()) {
+        return;
+    }
+    ENC28J60_TRACE_MARK(emac, ENC28J60_TRACE_END);
+    emac->spi_owner = NULL;
+    spi_device_release_bus(emac->spi_hdl);
+    enc28j60_bus_give(emac);
+    enc28j60_lock_give(emac);
 }
 
 /**
@@ -113,15 +747,68 @@ static inline uint32_t enc28j60_next_ptr_align_odd(uint32_t next_packet_ptr, uin
 /**
  * @brief Calculate wrap around when reading beyond the end of the RX buffer
  */
-static inline uint32_t enc28j60_rx_packet_start(uint32_t start_addr, uint32_t off)
+static inline uint32_t enc28j60_rx_packet_start(emac_enc28j60_t *emac, uint32_t start_addr, uint32_t off)
 {
-    if (start_addr + off > ENC28J60_BUF_RX_END) {
-        return (start_addr + off) - (ENC28J60_BUF_RX_END - ENC28J60_BUF_RX_START + 1);
+    if (start_addr + off > emac->rx_end) {
+        return (start_addr + off) - (emac->rx_end - ENC28J60_BUF_RX_START + 1);
     } else {
         return start_addr + off;
     }
 }
 
+/**
+ * @brief Look up the shadow cache slot of a register
+ * @return slot index, or -1 if the register is not cached
+ */
+static int enc28j60_shadow_slot(uint16_t reg_addr)
+{
+    for (int i = 0; i < ENC28J60_SHADOW_NUM; i++) {
+        if (enc28j60_shadow_regs[i] == reg_addr) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Mirror a successful register write/set/clear into the shadow cache
+ */
+static void enc28j60_shadow_update(emac_enc28j60_t *emac, uint8_t cmd, uint16_t reg_addr, uint8_t value)
+{
+    int slot = enc28j60_shadow_slot(reg_addr);
+    if (slot < 0) {
+        return;
+    }
+    if (reg_addr == ENC28J60_ECON2) {
+        value &= ~ENC28J60_SHADOW_ECON2_VOLATILE;
+    }
+    switch (cmd) {
+    case ENC28J60_SPI_CMD_WCR:
+        emac->shadow.value[slot] = value;
+        emac->shadow.valid |= 1 << slot;
+        break;
+    case ENC28J60_SPI_CMD_BFS:
+        emac->shadow.value[slot] |= value;
+        break;
+    case ENC28J60_SPI_CMD_BFC:
+        emac->shadow.value[slot] &= ~value;
+        break;
+    default:
+        break;
+    }
+}
+
+/**
+ * @brief Forget the cached value of a register, e.g. after a failed write
+ */
+static inline void enc28j60_shadow_invalidate(emac_enc28j60_t *emac, uint16_t reg_addr)
+{
+    int slot = enc28j60_shadow_slot(reg_addr);
+    if (slot >= 0) {
+        emac->shadow.valid &= ~(1 << slot);
+    }
+}
+
 /**
  * @brief SPI operation wrapper for writing ENC28J60 internal register
  */
@@ -138,10 +825,13 @@ static esp_err_t enc28j60_do_register_write(emac_enc28j60_t *emac, uint8_t reg_a
         }
     };
     if (enc28j60_lock(emac)) {
+        emac->spi_transactions++;
         if (spi_device_polling_transmit(emac->spi_hdl, &trans) != ESP_OK) {
             ESP_LOGE(TAG, "%s(%d): spi transmit failed", __FUNCTION__, __LINE__);
+            ENC28J60_STAT_INC(emac, spi_errors);
             ret = ESP_FAIL;
         }
+        ENC28J60_TRACE_SPI_OP(emac, ENC28J60_SPI_CMD_WCR, reg_addr, 1, value, ret == ESP_OK ? 0 : ENC28J60_TRACE_FLAG_ERROR);
         enc28j60_unlock(emac);
     } else {
         ret = ESP_ERR_TIMEOUT;
@@ -162,12 +852,16 @@ static esp_err_t enc28j60_do_register_read(emac_enc28j60_t *emac, bool is_eth_re
         .flags = SPI_TRANS_USE_RXDATA
     };
     if (enc28j60_lock(emac)) {
+        emac->spi_transactions++;
         if (spi_device_polling_transmit(emac->spi_hdl, &trans) != ESP_OK) {
             ESP_LOGE(TAG, "%s(%d): spi transmit failed", __FUNCTION__, __LINE__);
+            ENC28J60_STAT_INC(emac, spi_errors);
             ret = ESP_FAIL;
         } else {
             *value = is_eth_reg ? trans.rx_data[0] : trans.rx_data[1];
         }
+        ENC28J60_TRACE_SPI_OP(emac, ENC28J60_SPI_CMD_RCR, reg_addr, is_eth_reg ? 1 : 2, ret == ESP_OK ? *value : 0,
+                              ret == ESP_OK ? 0 : ENC28J60_TRACE_FLAG_ERROR);
         enc28j60_unlock(emac);
     } else {
         ret = ESP_ERR_TIMEOUT;
@@ -192,10 +886,15 @@ static esp_err_t enc28j60_do_bitwise_set(emac_enc28j60_t *emac, uint8_t reg_addr
         }
     };
     if (enc28j60_lock(emac)) {
+        emac->spi_transactions++;
         if (spi_device_polling_transmit(emac->spi_hdl, &trans) != ESP_OK) {
             ESP_LOGE(TAG, "%s(%d): spi transmit failed", __FUNCTION__, __LINE__);
+            ENC28J60_STAT_INC(emac, spi_errors);
             ret = ESP_FAIL;
+        } else {
+            enc28j60_shadow_update(emac, ENC28J60_SPI_CMD_BFS, reg_addr, mask);
         }
+        ENC28J60_TRACE_SPI_OP(emac, ENC28J60_SPI_CMD_BFS, reg_addr, 1, mask, ret == ESP_OK ? 0 : ENC28J60_TRACE_FLAG_ERROR);
         enc28j60_unlock(emac);
     } else {
         ret = ESP_ERR_TIMEOUT;
@@ -220,10 +919,15 @@ static esp_err_t enc28j60_do_bitwise_clr(emac_enc28j60_t *emac, uint8_t reg_addr
         }
     };
     if (enc28j60_lock(emac)) {
+        emac->spi_transactions++;
         if (spi_device_polling_transmit(emac->spi_hdl, &trans) != ESP_OK) {
             ESP_LOGE(TAG, "%s(%d): spi transmit failed", __FUNCTION__, __LINE__);
+            ENC28J60_STAT_INC(emac, spi_errors);
             ret = ESP_FAIL;
+        } else {
+            enc28j60_shadow_update(emac, ENC28J60_SPI_CMD_BFC, reg_addr, mask);
         }
+        ENC28J60_TRACE_SPI_OP(emac, ENC28J60_SPI_CMD_BFC, reg_addr, 1, mask, ret == ESP_OK ? 0 : ENC28J60_TRACE_FLAG_ERROR);
         enc28j60_unlock(emac);
     } else {
         ret = ESP_ERR_TIMEOUT;
@@ -231,6 +935,30 @@ static esp_err_t enc28j60_do_bitwise_clr(emac_enc28j60_t *emac, uint8_t reg_addr
     return ret;
 }
 
+/**
+ * @brief Transmit a buffer memory transaction
+ * @note long transfers are queued, so the calling task blocks (instead of spinning) till the DMA transfer completes
+ */
+static esp_err_t enc28j60_spi_bulk_transmit(emac_enc28j60_t *emac, spi_transaction_t *trans, void *caller)
+{
+    esp_err_t ret = ESP_OK;
+    uint8_t flags = 0;
+    emac->spi_transactions++;
+    if (!emac->spi_dma_threshold || trans->length < emac->spi_dma_threshold * 8) {
+        ret = spi_device_polling_transmit(emac->spi_hdl, trans);
+    } else {
+        spi_transaction_t *done = NULL;
+        flags |= ENC28J60_TRACE_FLAG_QUEUED;
+        ret = spi_device_queue_trans(emac->spi_hdl, trans, portMAX_DELAY);
+        if (ret == ESP_OK) {
+            ret = spi_device_get_trans_result(emac->spi_hdl, &done, portMAX_DELAY);
+        }
+    }
+    enc28j60_trace_record(emac, ENC28J60_TRACE_SPI, (trans->cmd << 5) | (trans->addr & 0x1F), trans->length / 8, 0,
+                          flags | (ret == ESP_OK ? 0 : ENC28J60_TRACE_FLAG_ERROR), caller);
+    return ret;
+}
+
 /**
  * @brief SPI operation wrapper for writing ENC28J60 internal memory
  */
@@ -244,8 +972,9 @@ static esp_err_t enc28j60_do_memory_write(emac_enc28j60_t *emac, uint8_t *buffer
         .tx_buffer = buffer
     };
     if (enc28j60_lock(emac)) {
-        if (spi_device_polling_transmit(emac->spi_hdl, &trans) != ESP_OK) {
+        if (enc28j60_spi_bulk_transmit(emac, &trans, __builtin_return_address(0)) != ESP_OK) {
             ESP_LOGE(TAG, "%s(%d): spi transmit failed", __FUNCTION__, __LINE__);
+            ENC28J60_STAT_INC(emac, spi_errors);
             ret = ESP_FAIL;
         }
         enc28j60_unlock(emac);
@@ -269,8 +998,9 @@ static esp_err_t enc28j60_do_memory_read(emac_enc28j60_t *emac, uint8_t *buffer,
     };
 
     if (enc28j60_lock(emac)) {
-        if (spi_device_polling_transmit(emac->spi_hdl, &trans) != ESP_OK) {
+        if (enc28j60_spi_bulk_transmit(emac, &trans, __builtin_return_address(0)) != ESP_OK) {
             ESP_LOGE(TAG, "%s(%d): spi transmit failed", __FUNCTION__, __LINE__);
+            ENC28J60_STAT_INC(emac, spi_errors);
             ret = ESP_FAIL;
         }
         enc28j60_unlock(emac);
@@ -291,10 +1021,13 @@ static esp_err_t enc28j60_do_reset(emac_enc28j60_t *emac)
         .addr = 0x1F,
     };
     if (enc28j60_lock(emac)) {
+        emac->spi_transactions++;
         if (spi_device_polling_transmit(emac->spi_hdl, &trans) != ESP_OK) {
             ESP_LOGE(TAG, "%s(%d): spi transmit failed", __FUNCTION__, __LINE__);
+            ENC28J60_STAT_INC(emac, spi_errors);
             ret = ESP_FAIL;
         }
+        ENC28J60_TRACE_SPI_OP(emac, ENC28J60_SPI_CMD_SRC, 0x1F, 0, 0, ret == ESP_OK ? 0 : ENC28J60_TRACE_FLAG_ERROR);
         enc28j60_unlock(emac);
     } else {
         ret = ESP_ERR_TIMEOUT;
@@ -302,22 +1035,49 @@ static esp_err_t enc28j60_do_reset(emac_enc28j60_t *emac)
 
     // After reset, wait at least 1ms for the device to be ready
     esp_rom_delay_us(ENC28J60_SYSTEM_RESET_ADDITION_TIME_US);
+    // registers are back to their reset values
+    emac->shadow.valid = 0;
+    emac->last_bank = 0xFF;
 
     return ret;
 }
 
+/**
+ * @brief Calculate ECON1.BSEL bits to clear and to set when switching between register banks
+ * @note only touch the bits that differ if the current bank is known, so that e.g. bank 0 -> 1 is a single BFS
+ */
+static inline void enc28j60_bank_switch_masks(uint8_t from, uint8_t to, uint8_t *clr_mask, uint8_t *set_mask)
+{
+    if (from > 3) {
+        *clr_mask = 0x03;
+        *set_mask = to & 0x03;
+    } else {
+        *clr_mask = from & ~to & 0x03;
+        *set_mask = to & ~from & 0x03;
+    }
+}
+
 /**
  * @brief Switch ENC28J60 register bank
  */
 static esp_err_t enc28j60_switch_register_bank(emac_enc28j60_t *emac, uint8_t bank)
 {
     esp_err_t ret = ESP_OK;
+    uint8_t clr_mask = 0;
+    uint8_t set_mask = 0;
     if (bank != emac->last_bank) {
-        MAC_CHECK(enc28j60_do_bitwise_clr(emac, ENC28J60_ECON1, 0x03) == ESP_OK,
-                  "clear ECON1[1:0] failed", out, ESP_FAIL);
-        MAC_CHECK(enc28j60_do_bitwise_set(emac, ENC28J60_ECON1, bank & 0x03) == ESP_OK,
-                  "set ECON1[1:0] failed", out, ESP_FAIL);
+        enc28j60_bank_switch_masks(emac->last_bank, bank, &clr_mask, &set_mask);
+        emac->last_bank = 0xFF;
+        if (clr_mask) {
+            MAC_CHECK(enc28j60_do_bitwise_clr(emac, ENC28J60_ECON1, clr_mask) == ESP_OK,
+                      "clear ECON1[1:0] failed", out, ESP_FAIL);
+        }
+        if (set_mask) {
+            MAC_CHECK(enc28j60_do_bitwise_set(emac, ENC28J60_ECON1, set_mask) == ESP_OK,
+                      "set ECON1[1:0] failed", out, ESP_FAIL);
+        }
         emac->last_bank = bank;
+        emac->bank_switches++;
     }
 out:
     return ret;
@@ -329,11 +1089,16 @@ out:
 static esp_err_t enc28j60_register_write(emac_enc28j60_t *emac, uint16_t reg_addr, uint8_t value)
 {
     esp_err_t ret = ESP_OK;
-    MAC_CHECK(enc28j60_switch_register_bank(emac, (reg_addr & 0xF00) >> 8) == ESP_OK,
-              "switch bank failed", out, ESP_FAIL);
-    MAC_CHECK(enc28j60_do_register_write(emac, reg_addr & 0xFF, value) == ESP_OK,
+    if (!ENC28J60_REG_IS_SHARED(reg_addr)) {
+        MAC_CHECK(enc28j60_switch_register_bank(emac, ENC28J60_REG_BANK(reg_addr)) == ESP_OK,
+                  "switch bank failed", out, ESP_FAIL);
+    }
+    MAC_CHECK(enc28j60_do_register_write(emac, ENC28J60_REG_INDEX(reg_addr), value) == ESP_OK,
               "write register failed", out, ESP_FAIL);
+    enc28j60_shadow_update(emac, ENC28J60_SPI_CMD_WCR, reg_addr, value);
+    return ESP_OK;
 out:
+    enc28j60_shadow_invalidate(emac, reg_addr);
     return ret;
 }
 
@@ -343,44 +1108,1041 @@ out:
 static esp_err_t enc28j60_register_read(emac_enc28j60_t *emac, uint16_t reg_addr, uint8_t *value)
 {
     esp_err_t ret = ESP_OK;
-    MAC_CHECK(enc28j60_switch_register_bank(emac, (reg_addr & 0xF00) >> 8) == ESP_OK,
-              "switch bank failed", out, ESP_FAIL);
-    MAC_CHECK(enc28j60_do_register_read(emac, !(reg_addr & 0xF000), reg_addr & 0xFF, value) == ESP_OK,
+    if (!ENC28J60_REG_IS_SHARED(reg_addr)) {
+        MAC_CHECK(enc28j60_switch_register_bank(emac, ENC28J60_REG_BANK(reg_addr)) == ESP_OK,
+                  "switch bank failed", out, ESP_FAIL);
+    }
+    MAC_CHECK(enc28j60_do_register_read(emac, !ENC28J60_REG_IS_MAC_MII(reg_addr), ENC28J60_REG_INDEX(reg_addr), value) == ESP_OK,
               "read register failed", out, ESP_FAIL);
 out:
     return ret;
 }
 
 /**
- * @brief Read ENC28J60 internal memroy
+ * @brief Read ENC28J60 register, served from the shadow cache when possible
  */
-static esp_err_t enc28j60_read_packet(emac_enc28j60_t *emac, uint32_t addr, uint8_t *packet, uint32_t len)
+static esp_err_t enc28j60_register_read_cached(emac_enc28j60_t *emac, uint16_t reg_addr, uint8_t *value)
+{
+    int slot = enc28j60_shadow_slot(reg_addr);
+    if (slot >= 0 && (emac->shadow.valid & (1 << slot))) {
+        *value = emac->shadow.value[slot];
+        return ESP_OK;
+    }
+    esp_err_t ret = enc28j60_register_read(emac, reg_addr, value);
+    if (ret == ESP_OK && slot >= 0) {
+        enc28j60_shadow_update(emac, ENC28J60_SPI_CMD_WCR, reg_addr, *value);
+    }
+    return ret;
+}
+
+/**
+ * @brief Reload the shadow cache from the chip, e.g. after a soft reset
+ *
+ * @param[out] mismatches: number of valid cache entries that didn't match the chip (optional)
+ */
+static esp_err_t enc28j60_shadow_resync(emac_enc28j60_t *emac, uint32_t *mismatches)
 {
     esp_err_t ret = ESP_OK;
-    MAC_CHECK(enc28j60_register_write(emac, ENC28J60_ERDPTL, addr & 0xFF) == ESP_OK,
-              "write ERDPTL failed", out, ESP_FAIL);
-    MAC_CHECK(enc28j60_register_write(emac, ENC28J60_ERDPTH, (addr & 0xFF00) >> 8) == ESP_OK,
-              "write ERDPTH failed", out, ESP_FAIL);
-    MAC_CHECK(enc28j60_do_memory_read(emac, packet, len) == ESP_OK,
-              "read memory failed", out, ESP_FAIL);
+    uint32_t diff = 0;
+    uint8_t value = 0;
+    for (int i = 0; i < ENC28J60_SHADOW_NUM; i++) {
+        MAC_CHECK(enc28j60_register_read(emac, enc28j60_shadow_regs[i], &value) == ESP_OK,
+                  "read register 0x%04x failed", out, ESP_FAIL, enc28j60_shadow_regs[i]);
+        if (enc28j60_shadow_regs[i] == ENC28J60_ECON2) {
+            value &= ~ENC28J60_SHADOW_ECON2_VOLATILE;
+        }
+        if ((emac->shadow.valid & (1 << i)) && emac->shadow.value[i] != value) {
+            ESP_LOGW(TAG, "register 0x%04x: cached 0x%02x, chip 0x%02x",
+                     enc28j60_shadow_regs[i], emac->shadow.value[i], value);
+            diff++;
+        }
+        emac->shadow.value[i] = value;
+        emac->shadow.valid |= 1 << i;
+    }
 out:
+    if (mismatches) {
+        *mismatches = diff;
+    }
     return ret;
 }
 
 /**
- * @brief Write ENC28J60 internal PHY register
+ * @brief Start a new (empty) register operation batch
  */
-static esp_err_t emac_enc28j60_write_phy_reg(esp_eth_mac_t *mac, uint32_t phy_addr,
-        uint32_t phy_reg, uint32_t reg_value)
+static inline void enc28j60_batch_init(enc28j60_batch_t *batch)
 {
-    esp_err_t ret = ESP_OK;
-    emac_enc28j60_t *emac = __containerof(mac, emac_enc28j60_t, parent);
-    uint8_t mii_status;
+    batch->num_ops = 0;
+    batch->overflow = false;
+}
 
-    /* check if phy access is in progress */
-    MAC_CHECK(enc28j60_register_read(emac, ENC28J60_MISTAT, &mii_status) == ESP_OK,
-              "read MISTAT failed", out, ESP_FAIL);
-    MAC_CHECK(!(mii_status & MISTAT_BUSY), "phy is busy", out, ESP_ERR_INVALID_STATE);
+/**
+ * @brief Append a register operation to the batch
+ * @note overflow is reported when the batch gets submitted
+ */
+static inline void enc28j60_batch_add(enc28j60_batch_t *batch, uint8_t cmd, uint16_t reg_addr, uint8_t value)
+{
+    if (batch->num_ops >= ENC28J60_BATCH_MAX_OPS) {
+        batch->overflow = true;
+        return;
+    }
+    batch->ops[batch->num_ops].reg_addr = reg_addr;
+    batch->ops[batch->num_ops].cmd = cmd;
+    batch->ops[batch->num_ops].value = value;
+    batch->ops[batch->num_ops].bank = ENC28J60_REG_BANK_OF(reg_addr);
+    batch->ops[batch->num_ops].flags = 0;
+    batch->num_ops++;
+}
+
+/**
+ * @brief Append a static register sequence to the batch
+ *
+ * @param seq: sequence table
+ * @param num: number of entries in the table
+ * @param values: one value (or bit mask) per table entry
+ */
+static void enc28j60_batch_add_seq(enc28j60_batch_t *batch, const enc28j60_reg_seq_t *seq, uint32_t num, const uint8_t *values)
+{
+    if (batch->num_ops + num > ENC28J60_BATCH_MAX_OPS) {
+        batch->overflow = true;
+        return;
+    }
+    for (uint32_t i = 0; i < num; i++) {
+        enc28j60_reg_op_t *op = &batch->ops[batch->num_ops++];
+        op->reg_addr = seq[i].reg_addr;
+        op->cmd = seq[i].cmd;
+        op->value = values[i];
+        op->bank = seq[i].bank;
+        op->flags = seq[i].flags;
+    }
+}
+
+static inline void enc28j60_batch_register_write(enc28j60_batch_t *batch, uint16_t reg_addr, uint8_t value)
+{
+    enc28j60_batch_add(batch, ENC28J60_SPI_CMD_WCR, reg_addr, value);
+}
+
+/**
+ * @note can only be used for ETH registers
+ */
+static inline void enc28j60_batch_bitwise_set(enc28j60_batch_t *batch, uint16_t reg_addr, uint8_t mask)
+{
+    enc28j60_batch_add(batch, ENC28J60_SPI_CMD_BFS, reg_addr, mask);
+}
+
+/**
+ * @note can only be used for ETH registers
+ */
+static inline void enc28j60_batch_bitwise_clr(enc28j60_batch_t *batch, uint16_t reg_addr, uint8_t mask)
+{
+    enc28j60_batch_add(batch, ENC28J60_SPI_CMD_BFC, reg_addr, mask);
+}
+
+/**
+ * @brief Put one single byte SPI operation into the device queue
+ */
+static esp_err_t enc28j60_batch_queue(emac_enc28j60_t *emac, uint32_t *queued, uint8_t cmd, uint8_t addr, uint8_t value)
+{
+    spi_transaction_t *trans = &emac->batch_trans[*queued];
+    memset(trans, 0, sizeof(spi_transaction_t));
+    trans->cmd = cmd;
+    trans->addr = addr;
+    trans->length = 8;
+    trans->flags = SPI_TRANS_USE_TXDATA;
+    trans->tx_data[0] = value;
+    emac->spi_transactions++;
+    if (spi_device_queue_trans(emac->spi_hdl, trans, portMAX_DELAY) != ESP_OK) {
+        ESP_LOGE(TAG, "%s(%d): spi queue transaction failed", __FUNCTION__, __LINE__);
+        ENC28J60_STAT_INC(emac, spi_errors);
+        ENC28J60_TRACE_SPI_OP(emac, cmd, addr, 1, value, ENC28J60_TRACE_FLAG_QUEUED | ENC28J60_TRACE_FLAG_ERROR);
+        return ESP_FAIL;
+    }
+    ENC28J60_TRACE_SPI_OP(emac, cmd, addr, 1, value, ENC28J60_TRACE_FLAG_QUEUED);
+    (*queued)++;
+    return ESP_OK;
+}
+
+/**
+ * @brief Wait for all queued SPI operations to finish
+ */
+static esp_err_t enc28j60_batch_drain(emac_enc28j60_t *emac, uint32_t *queued)
+{
+    esp_err_t ret = ESP_OK;
+    spi_transaction_t *trans = NULL;
+    for (uint32_t i = 0; i < *queued; i++) {
+        if (spi_device_get_trans_result(emac->spi_hdl, &trans, portMAX_DELAY) != ESP_OK) {
+            ESP_LOGE(TAG, "%s(%d): spi transmit failed", __FUNCTION__, __LINE__);
+            ENC28J60_STAT_INC(emac, spi_errors);
+            ret = ESP_FAIL;
+        }
+    }
+    *queued = 0;
+    return ret;
+}
+
+/**
+ * @brief Plan execution order of the batch so that as few bank switches as possible are needed
+ *
+ * Operations are grouped by bank, starting with the currently selected one. Shared register operations run in
+ * whatever bank is selected. Relative order of operations on the same bank is kept (e.g. ERXRDPTL must be written
+ * before ERXRDPTH), and nothing is moved across an operation flagged with ENC28J60_OP_FENCE.
+ */
+static void enc28j60_batch_plan(const enc28j60_batch_t *batch, uint8_t bank, uint8_t *order)
+{
+    uint32_t planned = 0;
+    uint32_t seg_start = 0;
+    while (seg_start < batch->num_ops) {
+        uint32_t seg_end = seg_start + 1;
+        if (!(batch->ops[seg_start].flags & ENC28J60_OP_FENCE)) {
+            while (seg_end < batch->num_ops && !(batch->ops[seg_end].flags & ENC28J60_OP_FENCE)) {
+                seg_end++;
+            }
+        }
+        uint32_t pending = ((1 << seg_end) - 1) & ~((1 << seg_start) - 1);
+        while (pending) {
+            for (uint32_t i = seg_start; i < seg_end; i++) {
+                if ((pending & (1 << i)) &&
+                        (batch->ops[i].bank == ENC28J60_BANK_ANY || batch->ops[i].bank == bank)) {
+                    order[planned++] = i;
+                    pending &= ~(1 << i);
+                }
+            }
+            if (pending) {
+                // continue with the bank of the first operation left over
+                bank = batch->ops[__builtin_ctz(pending)].bank;
+            }
+        }
+        seg_start = seg_end;
+    }
+}
+
+/**
+ * @brief Submit all register operations of the batch in a single locked sequence of queued SPI transactions
+ * @note execution order and bank switches are planned here (not when ops are added), because only now the
+ *       current bank is known for sure
+ */
+static esp_err_t enc28j60_batch_submit(emac_enc28j60_t *emac, enc28j60_batch_t *batch)
+{
+    esp_err_t ret = ESP_OK;
+    uint32_t queued = 0;
+    uint8_t order[ENC28J60_BATCH_MAX_OPS];
+    uint8_t clr_mask = 0;
+    uint8_t set_mask = 0;
+    MAC_CHECK(!batch->overflow, "too many operations in batch", out, ESP_ERR_INVALID_SIZE);
+    if (!batch->num_ops) {
+        goto out;
+    }
+    MAC_CHECK(enc28j60_lock(emac), "lock spi failed", out, ESP_ERR_TIMEOUT);
+    enc28j60_batch_plan(batch, emac->last_bank, order);
+    for (uint32_t i = 0; i < batch->num_ops && ret == ESP_OK; i++) {
+        enc28j60_reg_op_t *op = &batch->ops[order[i]];
+        bool switch_bank = op->bank != ENC28J60_BANK_ANY && op->bank != emac->last_bank;
+        // make room for the operation and a possible bank switch (BFC + BFS on ECON1)
+        if (queued + (switch_bank ? 3 : 1) > ENC28J60_SPI_QUEUE_DEPTH) {
+            ret = enc28j60_batch_drain(emac, &queued);
+        }
+        if (ret == ESP_OK && switch_bank) {
+            enc28j60_bank_switch_masks(emac->last_bank, op->bank, &clr_mask, &set_mask);
+            if (clr_mask) {
+                ret = enc28j60_batch_queue(emac, &queued, ENC28J60_SPI_CMD_BFC, ENC28J60_ECON1, clr_mask);
+            }
+            if (ret == ESP_OK && set_mask) {
+                ret = enc28j60_batch_queue(emac, &queued, ENC28J60_SPI_CMD_BFS, ENC28J60_ECON1, set_mask);
+            }
+            emac->last_bank = op->bank;
+            emac->bank_switches++;
+        }
+        if (ret == ESP_OK) {
+            ret = enc28j60_batch_queue(emac, &queued, op->cmd, ENC28J60_REG_INDEX(op->reg_addr), op->value);
+        }
+    }
+    // always collect what has been queued, so that nothing is left in the device queue
+    if (enc28j60_batch_drain(emac, &queued) != ESP_OK) {
+        ret = ESP_FAIL;
+    }
+    for (uint32_t i = 0; i < batch->num_ops; i++) {
+        if (ret == ESP_OK) {
+            enc28j60_shadow_update(emac, batch->ops[i].cmd, batch->ops[i].reg_addr, batch->ops[i].value);
+        } else {
+            enc28j60_shadow_invalidate(emac, batch->ops[i].reg_addr);
+        }
+    }
+    if (ret != ESP_OK) {
+        emac->last_bank = 0xFF; // bank is unknown, force switching on next access
+    }
+    enc28j60_unlock(emac);
+out:
+    enc28j60_batch_init(batch);
+    return ret;
+}
+
+/**
+ * @brief Read ENC28J60 internal memroy
+ */
+static esp_err_t enc28j60_read_packet(emac_enc28j60_t *emac, uint32_t addr, uint8_t *packet, uint32_t len)
+{
+    esp_err_t ret = ESP_OK;
+    enc28j60_batch_t batch;
+    uint8_t values[] = {addr & 0xFF, (addr & 0xFF00) >> 8};
+    enc28j60_batch_init(&batch);
+    enc28j60_batch_add_seq(&batch, enc28j60_rx_read_ptr_seq, 2, values);
+    MAC_CHECK(enc28j60_batch_submit(emac, &batch) == ESP_OK,
+              "write ERDPT failed", out, ESP_FAIL);
+    MAC_CHECK(enc28j60_do_memory_read(emac, packet, len) == ESP_OK,
+              "read memory failed", out, ESP_FAIL);
+out:
+    return ret;
+}
+
+/**
+ * @brief Location of the checksums of an IPv4 frame
+ */
+typedef struct {
+    uint32_t ip_len;   // IP header length
+    uint32_t l4_len;   // TCP/UDP header and payload length, 0 if the frame carries neither (or is a fragment)
+    uint32_t l4_csum;  // offset of the TCP/UDP checksum field in the frame
+    uint32_t pseudo;   // folded sum of the pseudo header
+    bool udp;
+} enc28j60_csum_info_t;
+
+/**
+ * @brief Fold a 32 bit sum into 16 bit one's complement sum
+ */
+static inline uint16_t enc28j60_csum_fold(uint32_t sum)
+{
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    return sum;
+}
+
+/**
+ * @brief Find the IP header and TCP/UDP segment of an outgoing or received frame
+ * @return false if the frame is not IPv4
+ */
+static bool enc28j60_csum_parse(const uint8_t *frame, uint32_t len, enc28j60_csum_info_t *info)
+{
+    const uint8_t *ip = frame + ENC28J60_ETH_HDR_LEN;
+    if (len < ENC28J60_ETH_HDR_LEN + 20 || frame[12] != 0x08 || frame[13] != 0x00 || (ip[0] >> 4) != 4) {
+        return false;
+    }
+    uint32_t ip_len = (ip[0] & 0x0F) * 4;
+    uint32_t total_len = (ip[2] << 8) | ip[3];
+    if (ip_len < 20 || total_len < ip_len || ENC28J60_ETH_HDR_LEN + total_len > len) {
+        return false;
+    }
+    info->ip_len = ip_len;
+    info->l4_len = 0;
+    /* fragments don't carry a complete segment, leave them to the stack */
+    if (((ip[6] & 0x3F) | ip[7]) || (ip[9] != IP_PROTO_TCP && ip[9] != IP_PROTO_UDP)) {
+        return true;
+    }
+    info->udp = ip[9] == IP_PROTO_UDP;
+    info->l4_len = total_len - ip_len;
+    if (info->l4_len < (info->udp ? 8 : 20)) {
+        info->l4_len = 0;
+        return true;
+    }
+    info->l4_csum = ENC28J60_ETH_HDR_LEN + ip_len + (info->udp ? 6 : 16);
+    uint32_t sum = ip[9] + info->l4_len;
+    for (int i = 12; i < 20; i += 2) {
+        sum += (ip[i] << 8) | ip[i + 1];
+    }
+    info->pseudo = enc28j60_csum_fold(sum);
+    return true;
+}
+
+/**
+ * @brief Let the DMA engine calculate the IP checksum over ENC28J60 memory from start to end (inclusive)
+ * @note ranges inside the receive buffer may wrap around its end
+ */
+static esp_err_t enc28j60_dma_checksum(emac_enc28j60_t *emac, uint32_t start, uint32_t end, uint16_t *csum)
+{
+    esp_err_t ret = ESP_OK;
+    enc28j60_batch_t batch;
+    uint8_t econ1 = 0;
+    uint8_t csl = 0;
+    uint8_t csh = 0;
+    uint32_t spins = 0;
+
+    enc28j60_batch_init(&batch);
+    enc28j60_batch_register_write(&batch, ENC28J60_EDMASTL, start & 0xFF);
+    enc28j60_batch_register_write(&batch, ENC28J60_EDMASTH, (start & 0xFF00) >> 8);
+    enc28j60_batch_register_write(&batch, ENC28J60_EDMANDL, end & 0xFF);
+    enc28j60_batch_register_write(&batch, ENC28J60_EDMANDH, (end & 0xFF00) >> 8);
+    enc28j60_batch_bitwise_set(&batch, ENC28J60_ECON1, ECON1_CSUMEN | ECON1_DMAST);
+    MAC_CHECK(enc28j60_batch_submit(emac, &batch) == ESP_OK, "start DMA checksum failed", out, ESP_FAIL);
+    /* the engine needs about one SPI register read per 8 bytes, so busy waiting is cheaper than the interrupt */
+    do {
+        MAC_CHECK(enc28j60_register_read(emac, ENC28J60_ECON1, &econ1) == ESP_OK, "read ECON1 failed", out, ESP_FAIL);
+        MAC_CHECK(++spins < ENC28J60_DMA_SPIN_MAX, "DMA checksum timeout", out, ESP_ERR_TIMEOUT);
+    } while (econ1 & ECON1_DMAST);
+    MAC_CHECK(enc28j60_register_read(emac, ENC28J60_EDMACSL, &csl) == ESP_OK, "read EDMACSL failed", out, ESP_FAIL);
+    MAC_CHECK(enc28j60_register_read(emac, ENC28J60_EDMACSH, &csh) == ESP_OK, "read EDMACSH failed", out, ESP_FAIL);
+    *csum = (csh << 8) | csl;
+out:
+    return ret;
+}
+
+/**
+ * @brief Fill in the IP and TCP/UDP checksums of a frame already written to the transmit buffer
+ * @param addr address of the first byte of the frame (after the per packet control byte)
+ * @note only fields lwIP left zero are filled in: the engine sums over the field itself, and without
+ *       LWIP_CHECKSUM_CTRL_PER_NETIF lwIP has already written valid checksums that must be kept
+ */
+static esp_err_t enc28j60_tx_checksum(emac_enc28j60_t *emac, uint32_t addr, const uint8_t *frame, uint32_t len)
+{
+    esp_err_t ret = ESP_OK;
+    enc28j60_csum_info_t info;
+    enc28j60_batch_t batch;
+    uint16_t csum = 0;
+    uint8_t field[2];
+    int64_t start = esp_timer_get_time();
+    int64_t elapsed = 0;
+
+    if (!enc28j60_csum_parse(frame, len, &info)) {
+        return ESP_OK;
+    }
+    bool fill_ip = !frame[ENC28J60_ETH_HDR_LEN + 10] && !frame[ENC28J60_ETH_HDR_LEN + 11];
+    bool fill_l4 = info.l4_len && !frame[info.l4_csum] && !frame[info.l4_csum + 1];
+    if (!fill_ip && !fill_l4) {
+        return ESP_OK;
+    }
+    uint32_t ip = addr + ENC28J60_ETH_HDR_LEN;
+    if (fill_ip) {
+        MAC_CHECK(enc28j60_dma_checksum(emac, ip, ip + info.ip_len - 1, &csum) == ESP_OK,
+                  "IP header checksum failed", out, ESP_FAIL);
+        field[0] = csum >> 8;
+        field[1] = csum & 0xFF;
+        enc28j60_batch_init(&batch);
+        enc28j60_batch_register_write(&batch, ENC28J60_EWRPTL, (ip + 10) & 0xFF);
+        enc28j60_batch_register_write(&batch, ENC28J60_EWRPTH, ((ip + 10) & 0xFF00) >> 8);
+        MAC_CHECK(enc28j60_batch_submit(emac, &batch) == ESP_OK, "write EWRPT failed", out, ESP_FAIL);
+        MAC_CHECK(enc28j60_do_memory_write(emac, field, 2) == ESP_OK, "write IP checksum failed", out, ESP_FAIL);
+    }
+
+    if (fill_l4) {
+        uint32_t l4 = ip + info.ip_len;
+        MAC_CHECK(enc28j60_dma_checksum(emac, l4, l4 + info.l4_len - 1, &csum) == ESP_OK,
+                  "segment checksum failed", out, ESP_FAIL);
+        /* the field was zero, so the engine's result only lacks the pseudo header */
+        csum = ~enc28j60_csum_fold((uint16_t)~csum + info.pseudo);
+        if (info.udp && !csum) {
+            csum = 0xFFFF;
+        }
+        field[0] = csum >> 8;
+        field[1] = csum & 0xFF;
+        enc28j60_batch_init(&batch);
+        enc28j60_batch_register_write(&batch, ENC28J60_EWRPTL, (addr + info.l4_csum) & 0xFF);
+        enc28j60_batch_register_write(&batch, ENC28J60_EWRPTH, ((addr + info.l4_csum) & 0xFF00) >> 8);
+        MAC_CHECK(enc28j60_batch_submit(emac, &batch) == ESP_OK, "write EWRPT failed", out, ESP_FAIL);
+        MAC_CHECK(enc28j60_do_memory_write(emac, field, 2) == ESP_OK, "write segment checksum failed", out, ESP_FAIL);
+    }
+    elapsed = esp_timer_get_time() - start;
+    portENTER_CRITICAL(&emac->stats_mux);
+    emac->csum_stats.tx_frames++;
+    emac->csum_stats.tx_time_us += elapsed;
+    portEXIT_CRITICAL(&emac->stats_mux);
+out:
+    return ret;
+}
+
+/**
+ * @brief Verify the IP and TCP/UDP checksums of the frame at the head of the receive buffer
+ * @param frame the frame as already read, used to locate the headers
+ * @return false if a checksum is wrong
+ */
+static bool enc28j60_rx_checksum_ok(emac_enc28j60_t *emac, const uint8_t *frame, uint32_t len)
+{
+    enc28j60_csum_info_t info;
+    uint16_t csum = 0;
+    bool ok = false;
+    int64_t start = esp_timer_get_time();
+    int64_t elapsed = 0;
+
+    if (!enc28j60_csum_parse(frame, len, &info)) {
+        return true;
+    }
+    uint32_t ip_off = ENC28J60_RSV_SIZE + ENC28J60_ETH_HDR_LEN;
+    uint32_t ip = enc28j60_rx_packet_start(emac, emac->next_packet_ptr, ip_off);
+    uint32_t ip_end = enc28j60_rx_packet_start(emac, emac->next_packet_ptr, ip_off + info.ip_len - 1);
+    if (enc28j60_dma_checksum(emac, ip, ip_end, &csum) != ESP_OK || csum) {
+        goto out;
+    }
+    if (info.l4_len && !(info.udp && !frame[info.l4_csum] && !frame[info.l4_csum + 1])) {
+        uint32_t l4 = enc28j60_rx_packet_start(emac, emac->next_packet_ptr, ip_off + info.ip_len);
+        uint32_t l4_end = enc28j60_rx_packet_start(emac, emac->next_packet_ptr, ip_off + info.ip_len + info.l4_len - 1);
+        if (enc28j60_dma_checksum(emac, l4, l4_end, &csum) != ESP_OK ||
+                enc28j60_csum_fold((uint16_t)~csum + info.pseudo) != 0xFFFF) {
+            goto out;
+        }
+    }
+    ok = true;
+out:
+    elapsed = esp_timer_get_time() - start;
+    portENTER_CRITICAL(&emac->stats_mux);
+    emac->csum_stats.rx_frames++;
+    emac->csum_stats.rx_time_us += elapsed;
+    if (!ok) {
+        emac->csum_stats.rx_errors++;
+    }
+    portEXIT_CRITICAL(&emac->stats_mux);
+    return ok;
+}
+
+/**
+ * @brief Time checksumming the same length with lwIP on the CPU and with the DMA engine
+ * @note the DMA engine runs over whatever is in the transmit buffer, the content doesn't affect its speed
+ */
+static esp_err_t enc28j60_csum_bench(emac_enc28j60_t *emac, eth_enc28j60_csum_bench_t *bench)
+{
+    esp_err_t ret = ESP_OK;
+    uint8_t *data = NULL;
+    uint16_t csum = 0;
+    uint32_t iterations = bench->iterations ? bench->iterations : 1;
+
+    MAC_CHECK(bench->len && bench->len <= ETH_MAX_PACKET_SIZE, "invalid length: %d", out, ESP_ERR_INVALID_ARG, bench->len);
+    data = malloc(bench->len);
+    MAC_CHECK(data, "no mem for benchmark data", out, ESP_ERR_NO_MEM);
+    for (uint32_t i = 0; i < bench->len; i++) {
+        data[i] = i;
+    }
+    int64_t start = esp_timer_get_time();
+    for (uint32_t i = 0; i < iterations; i++) {
+        csum += inet_chksum(data, bench->len);
+    }
+    bench->sw_time_us = (esp_timer_get_time() - start) / iterations;
+    start = esp_timer_get_time();
+    for (uint32_t i = 0; i < iterations; i++) {
+        MAC_CHECK(enc28j60_dma_checksum(emac, emac->tx_start, emac->tx_start + bench->len - 1, &csum) == ESP_OK,
+                  "DMA checksum failed", out, ESP_FAIL);
+    }
+    bench->dma_time_us = (esp_timer_get_time() - start) / iterations;
+out:
+    free(data);
+    return ret;
+}
+
+/**
+ * @brief Push a buffer back onto the freelist of its pool
+ */
+static void enc28j60_rx_pool_put(enc28j60_rx_pool_t *pool, enc28j60_rx_buf_t *buf)
+{
+    uint32_t head = __atomic_load_n(&pool->head, __ATOMIC_ACQUIRE);
+    uint32_t new_head;
+    do {
+        buf->next = head & 0xFFFF;
+        new_head = (((head >> 16) + 1) << 16) | buf->index;
+    } while (!__atomic_compare_exchange_n(&pool->head, &head, new_head, true, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE));
+    __atomic_add_fetch(&pool->num_free, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Pop a buffer from the freelist of a pool
+ * @return free buffer, or NULL if the pool is exhausted (or disabled)
+ */
+static enc28j60_rx_buf_t *enc28j60_rx_pool_get(enc28j60_rx_pool_t *pool)
+{
+    uint32_t head = __atomic_load_n(&pool->head, __ATOMIC_ACQUIRE);
+    uint32_t new_head;
+    enc28j60_rx_buf_t *buf;
+    do {
+        if ((head & 0xFFFF) == ENC28J60_RX_POOL_NONE) {
+            return NULL;
+        }
+        buf = &pool->bufs[head & 0xFFFF];
+        new_head = (((head >> 16) + 1) << 16) | buf->next;
+    } while (!__atomic_compare_exchange_n(&pool->head, &head, new_head, true, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE));
+    uint32_t num_free = __atomic_sub_fetch(&pool->num_free, 1, __ATOMIC_RELAXED);
+    if (num_free < pool->min_free) {
+        pool->min_free = num_free;
+    }
+    return buf;
+}
+
+/**
+ * @brief Custom pbuf free callback, called by lwIP once the last reference of a pool frame is dropped
+ */
+static void enc28j60_rx_pool_pbuf_free(struct pbuf *p)
+{
+    enc28j60_rx_buf_t *buf = (enc28j60_rx_buf_t *)p;
+    enc28j60_rx_pool_put(buf->pool, buf);
+}
+
+/**
+ * @brief Allocate buffers of one size class, a pool with zero buffers stays empty
+ */
+static esp_err_t enc28j60_rx_pool_init(enc28j60_rx_pool_t *pool, uint16_t num, uint16_t buf_size)
+{
+    esp_err_t ret = ESP_OK;
+    pool->head = ENC28J60_RX_POOL_NONE;
+    pool->num_free = 0;
+    pool->min_free = 0;
+    pool->num = num;
+    pool->buf_size = buf_size;
+    if (!num) {
+        return ESP_OK;
+    }
+    MAC_CHECK(num < ENC28J60_RX_POOL_NONE, "too many rx pool buffers: %d", out, ESP_ERR_INVALID_ARG, num);
+    pool->bufs = calloc(num, sizeof(enc28j60_rx_buf_t));
+    MAC_CHECK(pool->bufs, "calloc rx pool descriptors failed", out, ESP_ERR_NO_MEM);
+    pool->mem = heap_caps_malloc((size_t)num * buf_size, MALLOC_CAP_DMA);
+    MAC_CHECK(pool->mem, "no mem for rx pool buffers", out, ESP_ERR_NO_MEM);
+    for (uint16_t i = 0; i < num; i++) {
+        enc28j60_rx_buf_t *buf = &pool->bufs[i];
+        buf->pool = pool;
+        buf->index = i;
+        buf->payload = pool->mem + (size_t)i * buf_size;
+        buf->pbuf.custom_free_function = enc28j60_rx_pool_pbuf_free;
+        enc28j60_rx_pool_put(pool, buf);
+    }
+    pool->min_free = num;
+    return ESP_OK;
+out:
+    free(pool->bufs);
+    pool->bufs = NULL;
+    pool->num = 0;
+    return ret;
+}
+
+/**
+ * @brief Release memory of a pool
+ * @note all frames taken from the pool must have been freed by the stack
+ */
+static void enc28j60_rx_pool_deinit(enc28j60_rx_pool_t *pool)
+{
+    heap_caps_free(pool->mem);
+    free(pool->bufs);
+    pool->mem = NULL;
+    pool->bufs = NULL;
+    pool->num = 0;
+    pool->head = ENC28J60_RX_POOL_NONE;
+}
+
+/**
+ * @brief Pick a pool buffer for a frame of given length (including CRC)
+ * @note a small frame borrows a large buffer when the small class is exhausted
+ */
+static enc28j60_rx_buf_t *enc28j60_rx_pool_alloc(emac_enc28j60_t *emac, uint32_t len)
+{
+    enc28j60_rx_buf_t *buf = NULL;
+    if (len <= emac->rx_pool[ENC28J60_RX_POOL_SMALL].buf_size) {
+        buf = enc28j60_rx_pool_get(&emac->rx_pool[ENC28J60_RX_POOL_SMALL]);
+    }
+    if (!buf && len <= emac->rx_pool[ENC28J60_RX_POOL_LARGE].buf_size) {
+        buf = enc28j60_rx_pool_get(&emac->rx_pool[ENC28J60_RX_POOL_LARGE]);
+    }
+    return buf;
+}
+
+/**
+ * @brief Read the receive status vector of the frame at the head of the receive buffer
+ */
+static esp_err_t enc28j60_rx_peek(emac_enc28j60_t *emac, uint32_t *len, uint32_t *next_packet_addr)
+{
+    esp_err_t ret = ESP_OK;
+    __attribute__((aligned(4))) enc28j60_rx_header_t header; // SPI driver needs the rx buffer 4 byte align
+
+    MAC_CHECK(enc28j60_read_packet(emac, emac->next_packet_ptr, (uint8_t *)&header, sizeof(header)) == ESP_OK,
+              "read header failed", out, ESP_FAIL);
+    *len = header.length_low + (header.length_high << 8);
+    *next_packet_addr = header.next_packet_low + (header.next_packet_high << 8);
+    /* frames always start at even addresses inside the receive buffer, anything else means the ring is corrupted */
+    MAC_CHECK(!(*next_packet_addr & 1) && *next_packet_addr <= emac->rx_end && *len <= ENC28J60_RX_MAX_FRAME_LEN,
+              "invalid receive status vector (next: 0x%x, length: %d)", out, ESP_ERR_INVALID_RESPONSE,
+              *next_packet_addr, *len);
+out:
+    return ret;
+}
+
+/**
+ * @brief Read the frame content following the receive status vector
+ */
+static inline esp_err_t enc28j60_rx_payload(emac_enc28j60_t *emac, uint8_t *buf, uint32_t len)
+{
+    return enc28j60_read_packet(emac, enc28j60_rx_packet_start(emac, emac->next_packet_ptr, ENC28J60_RSV_SIZE), buf, len);
+}
+
+/**
+ * @brief Free receive buffer space of the current frame, decrement packet counter and check for more frames
+ * @note within a drain batch only the packet counter is decremented, see enc28j60_rx_drain()
+ */
+static esp_err_t enc28j60_rx_release(emac_enc28j60_t *emac, uint32_t next_packet_addr)
+{
+    esp_err_t ret = ESP_OK;
+    uint8_t pk_counter = 0;
+    enc28j60_batch_t batch;
+
+    if (emac->rx_batch_active) {
+        MAC_CHECK(enc28j60_do_bitwise_set(emac, ENC28J60_ECON2, ECON2_PKTDEC) == ESP_OK,
+                  "set ECON2.PKTDEC failed", out, ESP_FAIL);
+        emac->next_packet_ptr = next_packet_addr;
+        return ESP_OK;
+    }
+    uint32_t erxrdpt = enc28j60_next_ptr_align_odd(next_packet_addr, ENC28J60_BUF_RX_START, emac->rx_end);
+    uint8_t values[] = {erxrdpt & 0xFF, (erxrdpt & 0xFF00) >> 8, ECON2_PKTDEC};
+    enc28j60_batch_init(&batch);
+    enc28j60_batch_add_seq(&batch, enc28j60_rx_release_seq, 3, values);
+    MAC_CHECK(enc28j60_batch_submit(emac, &batch) == ESP_OK,
+              "write ERXRDPT/ECON2.PKTDEC failed", out, ESP_FAIL);
+    emac->next_packet_ptr = next_packet_addr;
+
+    MAC_CHECK(enc28j60_register_read(emac, ENC28J60_EPKTCNT, &pk_counter) == ESP_OK,
+              "read EPKTCNT failed", out, ESP_FAIL);
+    emac->packets_remain = pk_counter > 0;
+out:
+    return ret;
+}
+
+/**
+ * @brief Buffer a frame is received into, owned by the driver until it is passed to the stack
+ */
+typedef struct {
+    uint8_t *payload; // frame content, NULL while no buffer is allocated
+    void *owner;      // pool buffer or pbuf holding the payload, unused for heap buffers
+    uint32_t size;    // allocated length, rounded up to 4 bytes as DMA writes whole words
+} enc28j60_rx_frame_t;
+
+/**
+ * @brief Buffer handling of a receive mode
+ */
+typedef struct {
+    bool (*alloc)(emac_enc28j60_t *emac, enc28j60_rx_frame_t *frame, uint32_t len); // len includes the CRC
+    void (*free)(enc28j60_rx_frame_t *frame);
+    bool (*input)(emac_enc28j60_t *emac, struct netif *netif, enc28j60_rx_frame_t *frame, uint32_t len); // false: still ours
+} enc28j60_rx_ops_t;
+
+static bool enc28j60_rx_heap_alloc(emac_enc28j60_t *emac, enc28j60_rx_frame_t *frame, uint32_t len)
+{
+    frame->size = (len + 3) & ~3;
+    frame->payload = heap_caps_malloc(frame->size, MALLOC_CAP_DMA);
+    if (!frame->payload) {
+        ESP_LOGE(TAG, "no mem for receive buffer");
+    }
+    return frame->payload;
+}
+
+static void enc28j60_rx_heap_free(enc28j60_rx_frame_t *frame)
+{
+    free(frame->payload);
+}
+
+/**
+ * @brief Pass the buffer to the mediator (e.g. TCP/IP layer), which takes the ownership
+ */
+static bool enc28j60_rx_heap_input(emac_enc28j60_t *emac, struct netif *netif, enc28j60_rx_frame_t *frame, uint32_t len)
+{
+    portENTER_CRITICAL(&emac->stats_mux);
+    emac->rx_alloc_stats.frames++;
+    emac->rx_alloc_stats.bytes += frame->size;
+    portEXIT_CRITICAL(&emac->stats_mux);
+    emac->eth->stack_input(emac->eth, frame->payload, len);
+    return true;
+}
+
+static bool enc28j60_rx_pooled_alloc(emac_enc28j60_t *emac, enc28j60_rx_frame_t *frame, uint32_t len)
+{
+    enc28j60_rx_buf_t *buf = enc28j60_rx_pool_alloc(emac, len);
+    if (buf) {
+        frame->owner = buf;
+        frame->payload = buf->payload;
+        frame->size = buf->pool->buf_size;
+    }
+    return buf;
+}
+
+static void enc28j60_rx_pooled_free(enc28j60_rx_frame_t *frame)
+{
+    enc28j60_rx_buf_t *buf = (enc28j60_rx_buf_t *)frame->owner;
+    enc28j60_rx_pool_put(buf->pool, buf);
+}
+
+/**
+ * @brief Hand the pool buffer to lwIP as custom pbuf, it returns to the pool when lwIP frees the pbuf
+ */
+static bool enc28j60_rx_pooled_input(emac_enc28j60_t *emac, struct netif *netif, enc28j60_rx_frame_t *frame, uint32_t len)
+{
+    enc28j60_rx_buf_t *buf = (enc28j60_rx_buf_t *)frame->owner;
+    struct pbuf *p = pbuf_alloced_custom(PBUF_RAW, len, PBUF_REF, &buf->pbuf, buf->payload, frame->size);
+    if (!p) {
+        ESP_LOGE(TAG, "wrap pool buffer in pbuf failed");
+        return false;
+    }
+    if (netif->input(p, netif) != ERR_OK) {
+        pbuf_free(p);
+    }
+    return true;
+}
+
+static bool enc28j60_rx_pbuf_alloc(emac_enc28j60_t *emac, enc28j60_rx_frame_t *frame, uint32_t len)
+{
+    frame->size = (len + 3) & ~3;
+    struct pbuf *p = pbuf_alloc(PBUF_RAW, frame->size, PBUF_RAM);
+    if (!p) {
+        ESP_LOGE(TAG, "no mem for receive pbuf");
+        return false;
+    }
+    frame->owner = p;
+    frame->payload = p->payload;
+    return true;
+}
+
+static void enc28j60_rx_pbuf_free(enc28j60_rx_frame_t *frame)
+{
+    pbuf_free((struct pbuf *)frame->owner);
+}
+
+/**
+ * @brief Trim the pbuf to the frame length and pass it to lwIP without further copy
+ */
+static bool enc28j60_rx_pbuf_input(emac_enc28j60_t *emac, struct netif *netif, enc28j60_rx_frame_t *frame, uint32_t len)
+{
+    struct pbuf *p = (struct pbuf *)frame->owner;
+    pbuf_realloc(p, len); // strip CRC and the alignment padding
+    if (netif->input(p, netif) != ERR_OK) {
+        pbuf_free(p);
+    }
+    return true;
+}
+
+static const enc28j60_rx_ops_t enc28j60_rx_heap_ops = {
+    .alloc = enc28j60_rx_heap_alloc,
+    .free = enc28j60_rx_heap_free,
+    .input = enc28j60_rx_heap_input,
+};
+
+static const enc28j60_rx_ops_t enc28j60_rx_pooled_ops = {
+    .alloc = enc28j60_rx_pooled_alloc,
+    .free = enc28j60_rx_pooled_free,
+    .input = enc28j60_rx_pooled_input,
+};
+
+static const enc28j60_rx_ops_t enc28j60_rx_pbuf_ops = {
+    .alloc = enc28j60_rx_pbuf_alloc,
+    .free = enc28j60_rx_pbuf_free,
+    .input = enc28j60_rx_pbuf_input,
+};
+
+/**
+ * @brief Receive one frame into a buffer of the receive mode and pass it to the stack
+ * @note a frame that can't be delivered is still released from the chip, it counts as rx_errors if it is broken
+ *       (bad length, read error, bad checksum) and as rx_alloc_failures if no buffer was available
+ */
+static esp_err_t enc28j60_receive(emac_enc28j60_t *emac, const enc28j60_rx_ops_t *ops, struct netif *netif)
+{
+    esp_err_t ret = ESP_OK;
+    uint32_t rx_len = 0;
+    uint32_t next_packet_addr = 0;
+    uint32_t bank_switches = emac->bank_switches;
+    uint32_t spi_transactions = emac->spi_transactions;
+    enc28j60_rx_frame_t frame = {0};
+    bool ok = false;
+
+    MAC_CHECK(enc28j60_frame_begin(emac) == ESP_OK, "begin frame transaction failed", out, ESP_ERR_TIMEOUT);
+    ENC28J60_TRACE_MARK(emac, ENC28J60_TRACE_RX_BEGIN);
+    ret = enc28j60_rx_peek(emac, &rx_len, &next_packet_addr);
+    MAC_CHECK(ret == ESP_OK, "peek frame failed", out, ret);
+    enc28j60_rx_lat_mark(emac, ENC28J60_RX_LAT_HEADER);
+    if (rx_len <= 4) {
+        ENC28J60_STAT_INC(emac, rx_errors);
+    } else if (!ops->alloc(emac, &frame, rx_len)) {
+        emac->rx_drops++;
+        ENC28J60_STAT_INC(emac, rx_alloc_failures);
+    } else if (enc28j60_rx_payload(emac, frame.payload, rx_len) != ESP_OK) {
+        ESP_LOGE(TAG, "read packet content failed");
+        ENC28J60_STAT_INC(emac, rx_errors);
+    } else if ((emac->csum_offload & ENC28J60_CSUM_OFFLOAD_RX) && !enc28j60_rx_checksum_ok(emac, frame.payload, rx_len - 4)) {
+        ENC28J60_STAT_INC(emac, rx_errors);
+    } else {
+        enc28j60_rx_lat_mark(emac, ENC28J60_RX_LAT_PAYLOAD);
+        ok = true;
+    }
+    MAC_CHECK(enc28j60_rx_release(emac, next_packet_addr) == ESP_OK, "release frame failed", out, ESP_FAIL);
+    portENTER_CRITICAL(&emac->stats_mux);
+    emac->bank_stats.rx_frames++;
+    emac->bank_stats.rx_bank_switches += emac->bank_switches - bank_switches;
+    emac->bank_stats.rx_spi_transactions += emac->spi_transactions - spi_transactions;
+    portEXIT_CRITICAL(&emac->stats_mux);
+    enc28j60_frame_end(emac);
+
+    rx_len -= 4; // substract the CRC length
+    if (ok && (!emac->rx_hook.hook || emac->rx_hook.hook(emac->rx_hook.arg, frame.payload, &rx_len))) {
+        if (ops->input(emac, netif, &frame, rx_len)) {
+            frame.payload = NULL;
+            portENTER_CRITICAL(&emac->stats_mux);
+            emac->rx_perf.bytes += rx_len;
+            portEXIT_CRITICAL(&emac->stats_mux);
+            ENC28J60_STAT_INC(emac, rx_frames);
+            ENC28J60_STAT_ADD(emac, rx_bytes, rx_len);
+            enc28j60_rx_lat_mark(emac, ENC28J60_RX_LAT_STACK);
+        } else {
+            emac->rx_drops++;
+            ENC28J60_STAT_INC(emac, rx_alloc_failures);
+        }
+    }
+out:
+    enc28j60_frame_end(emac);
+    if (frame.payload) {
+        ops->free(&frame);
+    }
+    return ret;
+}
+
+/**
+ * @brief Find room for a frame in the transmit buffer
+ * @return address of the per packet control byte, or -1 if the frame does not fit right now
+ */
+static int enc28j60_tx_ring_alloc(emac_enc28j60_t *emac, uint32_t len)
+{
+    enc28j60_tx_ring_t *ring = &emac->tx_ring;
+    uint32_t need = 1 + len + ENC28J60_TSV_SIZE;
+    if (ring->count == ENC28J60_TX_RING_SLOTS) {
+        return -1;
+    }
+    if (ring->count == 0) {
+        ring->wr_addr = emac->tx_start;
+        return need <= ENC28J60_BUF_TX_END - emac->tx_start + 1 ? (int)ring->wr_addr : -1;
+    }
+    uint32_t oldest = ring->desc[ring->head].start;
+    if (ring->wr_addr > oldest) {
+        // used area doesn't wrap, try the tail first, then the start of the buffer
+        if (ring->wr_addr + need <= ENC28J60_BUF_TX_END + 1) {
+            return ring->wr_addr;
+        }
+        return emac->tx_start + need <= oldest ? (int)emac->tx_start : -1;
+    }
+    return ring->wr_addr + need <= oldest ? (int)ring->wr_addr : -1;
+}
+
+/**
+ * @brief Start transmission of the oldest queued frame
+ */
+static esp_err_t enc28j60_tx_kick(emac_enc28j60_t *emac)
+{
+    enc28j60_tx_ring_t *ring = &emac->tx_ring;
+    enc28j60_tx_desc_t *desc = &ring->desc[ring->head];
+    uint32_t end = desc->start + desc->len; // control byte + frame - 1
+    enc28j60_batch_t batch;
+    uint8_t values[] = {
+        desc->start & 0xFF, (desc->start & 0xFF00) >> 8,
+        end & 0xFF, (end & 0xFF00) >> 8,
+        ECON1_TXRTS
+    };
+    enc28j60_batch_init(&batch);
+    enc28j60_batch_add_seq(&batch, enc28j60_tx_kick_seq, 5, values);
+    esp_err_t ret = enc28j60_batch_submit(emac, &batch);
+    ring->busy = ret == ESP_OK;
+    return ret;
+}
+
+/**
+ * @brief Read the transmit status vector the chip wrote right after the frame, and account it
+ * @note caller must be in a frame transaction
+ * @return true if the frame was aborted by a late collision
+ */
+static bool enc28j60_tx_status_capture(emac_enc28j60_t *emac, const enc28j60_tx_desc_t *desc)
+{
+    __attribute__((aligned(4))) enc28j60_tx_status_t tsv; // SPI driver needs the rx buffer 4 byte align
+    eth_enc28j60_tx_status_t *stats = &emac->tx_status;
+
+    if (enc28j60_read_packet(emac, desc->start + desc->len + 1, (uint8_t *)&tsv, sizeof(tsv)) != ESP_OK) {
+        ESP_LOGE(TAG, "read transmit status vector failed");
+        return false;
+    }
+    portENTER_CRITICAL(&emac->stats_mux);
+    if (!(tsv.status_low & TSV_DONE)) {
+        stats->not_done++;
+        portEXIT_CRITICAL(&emac->stats_mux);
+        return false;
+    }
+    uint32_t collisions = tsv.status_low & TSV_COLLISION_COUNT;
+    stats->frames++;
+    stats->collisions[collisions]++;
+    stats->wire_bytes += tsv.wire_bytes_low + (tsv.wire_bytes_high << 8);
+    stats->deferred += (tsv.status_high & TSV_DEFER) ? 1 : 0;
+    stats->excess_defers += (tsv.status_high & TSV_EXCESS_DEFER) ? 1 : 0;
+    stats->excess_collisions += (tsv.status_high & TSV_EXCESS_COLLISION) ? 1 : 0;
+    stats->late_collisions += (tsv.status_high & TSV_LATE_COLLISION) ? 1 : 0;
+    stats->underruns += (tsv.status_high & TSV_UNDERRUN) ? 1 : 0;
+    portEXIT_CRITICAL(&emac->stats_mux);
+    ENC28J60_STAT_ADD(emac, tx_retries, collisions);
+    return tsv.status_high & TSV_LATE_COLLISION;
+}
+
+/**
+ * @brief Retire the frame the transmit logic finished with and start the next queued one
+ * @note called by the driver task on TXIF or TXERIF. A frame aborted by a late collision (which may stall
+ *       the transmit logic, see enc28j60_tx_error) is still in the transmit buffer and gets sent again,
+ *       rather than leaving its recovery to TCP retransmission timeouts
+ */
+static void enc28j60_tx_complete(emac_enc28j60_t *emac)
+{
+    enc28j60_tx_ring_t *ring = &emac->tx_ring;
+    bool late_collision = emac->tx_late_collision;
+    bool freed = false;
+    emac->tx_late_collision = false;
+    xSemaphoreTake(emac->tx_lock, portMAX_DELAY);
+    bool in_frame = ring->count && enc28j60_frame_begin(emac) == ESP_OK;
+    if (ring->busy && ring->count) {
+        ring->busy = false;
+        /* status vector is only read now, when the frame is done, so transmit itself never waits for it */
+        if (in_frame && emac->tx_status_capture) {
+            late_collision |= enc28j60_tx_status_capture(emac, &ring->desc[ring->head]);
+        }
+        if (late_collision && ring->retransmits < emac->tx_latecol_retries) {
+            ring->retransmits++;
+            ENC28J60_STAT_INC(emac, tx_retransmits);
+        } else {
+            portENTER_CRITICAL(&emac->stats_mux);
+            emac->tx_status.retransmits[ring->retransmits]++;
+            portEXIT_CRITICAL(&emac->stats_mux);
+            ring->retransmits = 0;
+            ring->head = (ring->head + 1) % ENC28J60_TX_RING_SLOTS;
+            ring->count--;
+            freed = true;
+        }
+    }
+    if (ring->count && (!in_frame || enc28j60_tx_kick(emac) != ESP_OK)) {
+        ESP_LOGE(TAG, "start queued transmit failed");
+    }
+    enc28j60_frame_end(emac);
+    xSemaphoreGive(emac->tx_lock);
+    if (freed) {
+        xSemaphoreGive(emac->tx_sem);
+    }
+}
+
+/**
+ * @brief Drop all queued frames, used when the transmit logic is stopped
+ */
+static void enc28j60_tx_ring_reset(emac_enc28j60_t *emac)
+{
+    xSemaphoreTake(emac->tx_lock, portMAX_DELAY);
+    memset(&emac->tx_ring, 0, sizeof(emac->tx_ring));
+    emac->tx_ring.wr_addr = emac->tx_start;
+    xSemaphoreGive(emac->tx_lock);
+    /* every slot is free, wake as many transmitters */
+    for (int i = 0; i < ENC28J60_TX_RING_SLOTS; i++) {
+        xSemaphoreGive(emac->tx_sem);
+    }
+}
+
+/**
+ * @brief Write ENC28J60 internal PHY register
+ */
+static esp_err_t emac_enc28j60_write_phy_reg(esp_eth_mac_t *mac, uint32_t phy_addr,
+        uint32_t phy_reg, uint32_t reg_value)
+{
+    esp_err_t ret = ESP_OK;
+    emac_enc28j60_t *emac = __containerof(mac, emac_enc28j60_t, parent);
+    uint8_t mii_status;
+    /* the MII registers are shared by all PHY accesses, e.g. the link interrupt and the link check, so each runs as one transaction */
+    bool own_frame = emac->spi_owner != xTaskGetCurrentTaskHandle();
+
+    MAC_CHECK(!own_frame || enc28j60_frame_begin(emac) == ESP_OK, "begin PHY transaction failed", out, ESP_ERR_TIMEOUT);
+    /* check if phy access is in progress */
+    MAC_CHECK(enc28j60_register_read(emac, ENC28J60_MISTAT, &mii_status) == ESP_OK,
+              "read MISTAT failed", out, ESP_FAIL);
+    MAC_CHECK(!(mii_status & MISTAT_BUSY), "phy is busy", out, ESP_ERR_INVALID_STATE);
 
     /* tell the PHY address to write */
     MAC_CHECK(enc28j60_register_write(emac, ENC28J60_MIREGADR, phy_reg & 0xFF) == ESP_OK,
@@ -400,6 +2162,9 @@ static esp_err_t emac_enc28j60_write_phy_reg(esp_eth_mac_t *mac, uint32_t phy_ad
     } while ((mii_status & MISTAT_BUSY) && to < ENC28J60_PHY_OPERATION_TIMEOUT_US);
     MAC_CHECK(!(mii_status & MISTAT_BUSY), "phy is busy", out, ESP_ERR_TIMEOUT);
 out:
+    if (own_frame) {
+        enc28j60_frame_end(emac);
+    }
     return ret;
 }
 
@@ -410,11 +2175,14 @@ static esp_err_t emac_enc28j60_read_phy_reg(esp_eth_mac_t *mac, uint32_t phy_add
         uint32_t phy_reg, uint32_t *reg_value)
 {
     esp_err_t ret = ESP_OK;
-    MAC_CHECK(reg_value, "can't set reg_value to null", out, ESP_ERR_INVALID_ARG);
     emac_enc28j60_t *emac = __containerof(mac, emac_enc28j60_t, parent);
     uint8_t mii_status;
     uint8_t mii_cmd;
+    bool own_frame = false;
 
+    MAC_CHECK(reg_value, "can't set reg_value to null", out, ESP_ERR_INVALID_ARG);
+    own_frame = emac->spi_owner != xTaskGetCurrentTaskHandle();
+    MAC_CHECK(!own_frame || enc28j60_frame_begin(emac) == ESP_OK, "begin PHY transaction failed", out, ESP_ERR_TIMEOUT);
     /* check if phy access is in progress */
     MAC_CHECK(enc28j60_register_read(emac, ENC28J60_MISTAT, &mii_status) == ESP_OK,
               "read MISTAT failed", out, ESP_FAIL);
@@ -423,7 +2191,7 @@ static esp_err_t emac_enc28j60_read_phy_reg(esp_eth_mac_t *mac, uint32_t phy_add
     /* tell the PHY address to read */
     MAC_CHECK(enc28j60_register_write(emac, ENC28J60_MIREGADR, phy_reg & 0xFF) == ESP_OK,
               "write MIREGADR failed", out, ESP_FAIL);
-    MAC_CHECK(enc28j60_register_read(emac, ENC28J60_MICMD, &mii_cmd) == ESP_OK,
+    MAC_CHECK(enc28j60_register_read_cached(emac, ENC28J60_MICMD, &mii_cmd) == ESP_OK,
               "read MICMD failed", out, ESP_FAIL);
     mii_cmd |= MICMD_MIIRD;
     MAC_CHECK(enc28j60_register_write(emac, ENC28J60_MICMD, mii_cmd) == ESP_OK,
@@ -451,231 +2219,849 @@ static esp_err_t emac_enc28j60_read_phy_reg(esp_eth_mac_t *mac, uint32_t phy_add
               "read MIRDH failed", out, ESP_FAIL);
     *reg_value = (value_h << 8) | value_l;
 out:
+    if (own_frame) {
+        enc28j60_frame_end(emac);
+    }
+    return ret;
+}
+
+/**
+ * @brief Set mediator for Ethernet MAC
+ */
+static esp_err_t emac_enc28j60_set_mediator(esp_eth_mac_t *mac, esp_eth_mediator_t *eth)
+{
+    esp_err_t ret = ESP_OK;
+    MAC_CHECK(eth, "can't set mac's mediator to null", out, ESP_ERR_INVALID_ARG);
+    emac_enc28j60_t *emac = __containerof(mac, emac_enc28j60_t, parent);
+    emac->eth = eth;
+out:
+    return ret;
+}
+
+/**
+ * @brief Verify chip ID
+ */
+static esp_err_t enc28j60_verify_id(emac_enc28j60_t *emac)
+{
+    esp_err_t ret = ESP_OK;
+    uint8_t id;
+    MAC_CHECK(enc28j60_register_read(emac, ENC28J60_EREVID, &id) == ESP_OK,
+              "read EREVID failed", out, ESP_FAIL);
+    ESP_LOGI(TAG, "revision: %d", id);
+    MAC_CHECK(id > 0 && id < 7, "wrong chip ID", out, ESP_ERR_INVALID_VERSION);
+out:
+    return ret;
+}
+
+/**
+ * @brief Write mac address to internal registers
+ */
+static esp_err_t enc28j60_set_mac_addr(emac_enc28j60_t *emac)
+{
+    esp_err_t ret = ESP_OK;
+    enc28j60_batch_t batch;
+    uint8_t values[] = {emac->addr[5], emac->addr[4], emac->addr[3], emac->addr[2], emac->addr[1], emac->addr[0]};
+    enc28j60_batch_init(&batch);
+    enc28j60_batch_add_seq(&batch, enc28j60_mac_addr_seq, 6, values);
+    MAC_CHECK(enc28j60_batch_submit(emac, &batch) == ESP_OK,
+              "write MAADR failed", out, ESP_FAIL);
+out:
+    return ret;
+}
+
+/**
+ * @brief   Clear multicast hash table
+ */
+static esp_err_t enc28j60_clear_multicast_table(emac_enc28j60_t *emac)
+{
+    esp_err_t ret = ESP_OK;
+    enc28j60_batch_t batch;
+
+    memset(emac->hash_table, 0, sizeof(emac->hash_table));
+    memset(emac->hash_refs, 0, sizeof(emac->hash_refs));
+    enc28j60_batch_init(&batch);
+    enc28j60_batch_add_seq(&batch, enc28j60_hash_table_seq, 8, emac->hash_table);
+    MAC_CHECK(enc28j60_batch_submit(emac, &batch) == ESP_OK,
+              "write EHT failed", out, ESP_FAIL);
+out:
+    return ret;
+}
+
+/**
+ * @brief Hash table bit of a destination address: bits 28:23 of the Ethernet CRC
+ */
+static uint32_t enc28j60_hash_index(const uint8_t *addr)
+{
+    uint32_t crc = 0xFFFFFFFF;
+    for (int i = 0; i < 6; i++) {
+        uint8_t byte = addr[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = ((crc ^ byte) & 0x01) ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+            byte >>= 1;
+        }
+    }
+    return (crc >> 23) & 0x3F;
+}
+
+/**
+ * @brief Let frames to the address pass the hash table filter (add) or stop doing so (remove)
+ * @note different addresses may share a hash table bit, the bit is cleared when the last of them is removed
+ */
+static esp_err_t enc28j60_hash_update(emac_enc28j60_t *emac, const uint8_t *addr, bool add)
+{
+    esp_err_t ret = ESP_OK;
+    enc28j60_batch_t batch;
+    uint32_t index = enc28j60_hash_index(addr);
+
+    if (add) {
+        MAC_CHECK(emac->hash_refs[index] < UINT8_MAX, "too many addresses on hash bit %d", out, ESP_ERR_NO_MEM, index);
+        emac->hash_refs[index]++;
+    } else {
+        MAC_CHECK(emac->hash_refs[index], "address not in hash table", out, ESP_ERR_NOT_FOUND);
+        emac->hash_refs[index]--;
+    }
+    if (emac->hash_refs[index]) {
+        emac->hash_table[index >> 3] |= 1 << (index & 0x07);
+    } else {
+        emac->hash_table[index >> 3] &= ~(1 << (index & 0x07));
+    }
+    enc28j60_batch_init(&batch);
+    enc28j60_batch_add_seq(&batch, enc28j60_hash_table_seq, 8, emac->hash_table);
+    MAC_CHECK(enc28j60_batch_submit(emac, &batch) == ESP_OK,
+              "write EHT failed", out, ESP_FAIL);
+out:
+    return ret;
+}
+
+/**
+ * @brief Program the pattern match filter, the checksum of the masked bytes is calculated here
+ * @note the checksum is the IP checksum of the bytes selected by the mask, taken in order as one byte stream
+ */
+static esp_err_t enc28j60_set_pattern(emac_enc28j60_t *emac, const eth_enc28j60_pattern_t *pattern)
+{
+    esp_err_t ret = ESP_OK;
+    enc28j60_batch_t batch;
+    uint32_t sum = 0;
+    uint32_t num = 0;
+
+    MAC_CHECK(pattern->offset + 64 <= ENC28J60_RX_MAX_FRAME_LEN, "invalid pattern offset: %d", out,
+              ESP_ERR_INVALID_ARG, pattern->offset);
+    for (int i = 0; i < 64; i++) {
+        if (pattern->mask[i >> 3] & (1 << (i & 0x07))) {
+            sum += (num & 1) ? pattern->pattern[i] : pattern->pattern[i] << 8;
+            num++;
+        }
+    }
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    uint16_t csum = ~sum & 0xFFFF;
+    uint8_t values[] = {
+        pattern->mask[0], pattern->mask[1], pattern->mask[2], pattern->mask[3],
+        pattern->mask[4], pattern->mask[5], pattern->mask[6], pattern->mask[7],
+        csum & 0xFF, (csum & 0xFF00) >> 8,
+        pattern->offset & 0xFF, (pattern->offset & 0xFF00) >> 8
+    };
+    enc28j60_batch_init(&batch);
+    enc28j60_batch_add_seq(&batch, enc28j60_pattern_seq, sizeof(values), values);
+    MAC_CHECK(enc28j60_batch_submit(emac, &batch) == ESP_OK,
+              "write pattern match registers failed", out, ESP_FAIL);
+out:
+    return ret;
+}
+
+/**
+ * @brief Select the receive filters (ERXFCON)
+ */
+static esp_err_t enc28j60_set_rx_filter(emac_enc28j60_t *emac, uint8_t erxfcon)
+{
+    esp_err_t ret = ESP_OK;
+    MAC_CHECK(enc28j60_register_write(emac, ENC28J60_ERXFCON, erxfcon) == ESP_OK,
+              "write ERXFCON failed", out, ESP_FAIL);
+    emac->rx_filter = erxfcon;
+out:
+    return ret;
+}
+
+/**
+ * @brief Default setup for ENC28J60 internal registers
+ */
+static esp_err_t enc28j60_setup_default(emac_enc28j60_t *emac)
+{
+    esp_err_t ret = ESP_OK;
+    enc28j60_batch_t batch;
+    uint32_t erxrdpt = enc28j60_next_ptr_align_odd(ENC28J60_BUF_RX_START, ENC28J60_BUF_RX_START, emac->rx_end);
+    uint8_t values[] = {
+        // set up receive buffer start + end
+        ENC28J60_BUF_RX_START & 0xFF, (ENC28J60_BUF_RX_START & 0xFF00) >> 8,
+        emac->rx_end & 0xFF, (emac->rx_end & 0xFF00) >> 8,
+        erxrdpt & 0xFF, (erxrdpt & 0xFF00) >> 8,
+        // set up transmit buffer start
+        emac->tx_start & 0xFF, (emac->tx_start & 0xFF00) >> 8,
+        // set up default filter mode: (unicast OR broadcast) AND crc valid
+        ENC28J60_RX_FILTER_DEFAULT,
+        // enable MAC receive, enable pause control frame on Tx and Rx path
+        MACON1_MARXEN | MACON1_RXPAUS | MACON1_TXPAUS,
+        // enable automatic padding, append CRC, check frame length, half duplex by default (can update at runtime)
+        MACON3_PADCFG0 | MACON3_TXCRCEN | MACON3_FRMLNEN,
+        // enable defer transmission (effective only in half duplex)
+        MACON4_DEFER,
+        // set inter-frame gap (back-to-back)
+        0x12,
+        // set inter-frame gap (non-back-to-back)
+        0x12, 0x0C
+    };
+    _Static_assert(sizeof(values) == sizeof(enc28j60_setup_seq) / sizeof(enc28j60_setup_seq[0]),
+                   "values don't match enc28j60_setup_seq");
+
+    enc28j60_batch_init(&batch);
+    enc28j60_batch_add_seq(&batch, enc28j60_setup_seq, sizeof(values), values);
+    MAC_CHECK(enc28j60_batch_submit(emac, &batch) == ESP_OK,
+              "write default registers failed", out, ESP_FAIL);
+    emac->rx_filter = ENC28J60_RX_FILTER_DEFAULT;
+out:
+    return ret;
+}
+
+/**
+ * @brief Start enc28j60: enable interrupt and start receive
+ */
+static esp_err_t emac_enc28j60_start(esp_eth_mac_t *mac)
+{
+    esp_err_t ret = ESP_OK;
+    emac_enc28j60_t *emac = __containerof(mac, emac_enc28j60_t, parent);
+    /* enable interrupt */
+    MAC_CHECK(enc28j60_do_bitwise_clr(emac, ENC28J60_EIR, 0xFF) == ESP_OK,
+              "clear EIR failed", out, ESP_FAIL);
+    enc28j60_tx_ring_reset(emac);
+    MAC_CHECK(enc28j60_do_bitwise_set(emac, ENC28J60_EIE, EIE_PKTIE | EIE_TXIE | EIE_TXERIE | EIE_RXERIE) == ESP_OK,
+              "set EIE failed", out, ESP_FAIL);
+    /* enable rx logic */
+    MAC_CHECK(enc28j60_do_bitwise_set(emac, ENC28J60_ECON1, ECON1_RXEN) == ESP_OK,
+              "set ECON1.RXEN failed", out, ESP_FAIL);
+
+    MAC_CHECK(enc28j60_register_write(emac, ENC28J60_ERDPTL, 0x00) == ESP_OK,
+              "write ERDPTL failed", out, ESP_FAIL);
+    MAC_CHECK(enc28j60_register_write(emac, ENC28J60_ERDPTH, 0x00) == ESP_OK,
+              "write ERDPTH failed", out, ESP_FAIL);
+out:
+    return ret;
+}
+
+/**
+ * @brief   Stop enc28j60: disable interrupt and stop receiving packets
+ */
+static esp_err_t emac_enc28j60_stop(esp_eth_mac_t *mac)
+{
+    esp_err_t ret = ESP_OK;
+    emac_enc28j60_t *emac = __containerof(mac, emac_enc28j60_t, parent);
+    /* disable interrupts, except link change: the MAC is stopped on link down and started again on link up */
+    MAC_CHECK(enc28j60_do_bitwise_clr(emac, ENC28J60_EIE, EIE_PKTIE | EIE_TXIE | EIE_TXERIE | EIE_RXERIE) == ESP_OK,
+              "clear EIE failed", out, ESP_FAIL);
+    /* disable rx */
+    MAC_CHECK(enc28j60_do_bitwise_clr(emac, ENC28J60_ECON1, ECON1_RXEN) == ESP_OK,
+              "clear ECON1.RXEN failed", out, ESP_FAIL);
+    /* abort pending transmission and drop queued frames */
+    MAC_CHECK(enc28j60_do_bitwise_clr(emac, ENC28J60_ECON1, ECON1_TXRTS) == ESP_OK,
+              "clear ECON1.TXRTS failed", out, ESP_FAIL);
+    enc28j60_tx_ring_reset(emac);
+out:
+    return ret;
+}
+
+static esp_err_t emac_enc28j60_set_addr(esp_eth_mac_t *mac, uint8_t *addr)
+{
+    esp_err_t ret = ESP_OK;
+    MAC_CHECK(addr, "can't set mac addr to null", out, ESP_ERR_INVALID_ARG);
+    emac_enc28j60_t *emac = __containerof(mac, emac_enc28j60_t, parent);
+    memcpy(emac->addr, addr, 6);
+    MAC_CHECK(enc28j60_set_mac_addr(emac) == ESP_OK, "set mac address failed", out, ESP_FAIL);
+out:
+    return ret;
+}
+
+static esp_err_t emac_enc28j60_get_addr(esp_eth_mac_t *mac, uint8_t *addr)
+{
+    esp_err_t ret = ESP_OK;
+    MAC_CHECK(addr, "can't set mac addr to null", out, ESP_ERR_INVALID_ARG);
+    emac_enc28j60_t *emac = __containerof(mac, emac_enc28j60_t, parent);
+    memcpy(addr, emac->addr, 6);
+out:
+    return ret;
+}
+
+static void enc28j60_isr_handler(void *arg)
+{
+    emac_enc28j60_t *emac = (emac_enc28j60_t *)arg;
+    BaseType_t high_task_wakeup = pdFALSE;
+    /* keep the first interrupt, later ones are served by the same wakeup; never 0, that means none */
+    if (emac->rx_lat.enabled && !emac->rx_lat.isr_us) {
+        emac->rx_lat.isr_us = (uint32_t)esp_timer_get_time() | 1;
+    }
+    /* notify enc28j60 task */
+    vTaskNotifyGiveFromISR(emac->rx_task_hdl, &high_task_wakeup);
+    if (high_task_wakeup != pdFALSE) {
+        portYIELD_FROM_ISR();
+    }
+}
+
+/**
+ * @brief Check receive buffer size, the rest of the buffer memory is left for transmit
+ * @note size must be even, so that the receive buffer ends at an odd address as ERXRDPT does
+ */
+static inline bool enc28j60_partition_valid(uint32_t rx_size)
+{
+    return !(rx_size & 1) && rx_size >= ENC28J60_BUF_RX_SIZE_MIN &&
+           ENC28J60_BUFFER_SIZE - ENC28J60_BUF_RX_START - rx_size >= ENC28J60_BUF_TX_SIZE_MIN;
+}
+
+/**
+ * @brief Move the boundary between receive and transmit buffer
+ * @note only allowed while receive is stopped and no frame is queued for transmit, pending frames are discarded
+ */
+static esp_err_t enc28j60_set_partition(emac_enc28j60_t *emac, uint32_t rx_size)
+{
+    esp_err_t ret = ESP_OK;
+    uint8_t econ1 = 0;
+    uint8_t pk_counter = 0;
+    bool tx_locked = false;
+    enc28j60_batch_t batch;
+
+    MAC_CHECK(enc28j60_partition_valid(rx_size), "invalid rx buffer size: %d", out, ESP_ERR_INVALID_ARG, rx_size);
+    MAC_CHECK(enc28j60_do_register_read(emac, true, ENC28J60_ECON1, &econ1) == ESP_OK,
+              "read ECON1 failed", out, ESP_FAIL);
+    MAC_CHECK(!(econ1 & ECON1_RXEN), "receive must be stopped", out, ESP_ERR_INVALID_STATE);
+    xSemaphoreTake(emac->tx_lock, portMAX_DELAY);
+    tx_locked = true;
+    MAC_CHECK(!emac->tx_ring.count && !(econ1 & ECON1_TXRTS), "transmit in progress", out, ESP_ERR_INVALID_STATE);
+
+    /* discard frames left in the receive buffer */
+    MAC_CHECK(enc28j60_register_read(emac, ENC28J60_EPKTCNT, &pk_counter) == ESP_OK,
+              "read EPKTCNT failed", out, ESP_FAIL);
+    while (pk_counter--) {
+        MAC_CHECK(enc28j60_do_bitwise_set(emac, ENC28J60_ECON2, ECON2_PKTDEC) == ESP_OK,
+                  "set ECON2.PKTDEC failed", out, ESP_FAIL);
+    }
+
+    /* writing ERXST also resets the receive write pointer */
+    uint32_t rx_end = ENC28J60_BUF_RX_START + rx_size - 1;
+    uint32_t tx_start = ENC28J60_BUF_RX_START + rx_size;
+    uint32_t erxrdpt = enc28j60_next_ptr_align_odd(ENC28J60_BUF_RX_START, ENC28J60_BUF_RX_START, rx_end);
+    uint8_t values[] = {
+        ENC28J60_BUF_RX_START & 0xFF, (ENC28J60_BUF_RX_START & 0xFF00) >> 8,
+        rx_end & 0xFF, (rx_end & 0xFF00) >> 8,
+        erxrdpt & 0xFF, (erxrdpt & 0xFF00) >> 8,
+        tx_start & 0xFF, (tx_start & 0xFF00) >> 8,
+    };
+    _Static_assert(sizeof(values) == ENC28J60_SETUP_SEQ_PARTITION_OPS, "values don't match partition part of enc28j60_setup_seq");
+    enc28j60_batch_init(&batch);
+    enc28j60_batch_add_seq(&batch, enc28j60_setup_seq, ENC28J60_SETUP_SEQ_PARTITION_OPS, values);
+    MAC_CHECK(enc28j60_batch_submit(emac, &batch) == ESP_OK,
+              "write buffer partition failed", out, ESP_FAIL);
+    emac->rx_end = rx_end;
+    emac->tx_start = tx_start;
+    emac->next_packet_ptr = ENC28J60_BUF_RX_START;
+    emac->packets_remain = false;
+    emac->rx_occupancy_hwm = 0;
+    emac->tx_ring.wr_addr = tx_start;
+    ESP_LOGI(TAG, "buffer partition: rx %d bytes, tx %d bytes", rx_size, ENC28J60_BUF_TX_END - tx_start + 1);
+out:
+    if (tx_locked) {
+        xSemaphoreGive(emac->tx_lock);
+    }
+    return ret;
+}
+
+/**
+ * @brief Number of bytes the receive buffer holds right now
+ */
+static esp_err_t enc28j60_rx_occupancy(emac_enc28j60_t *emac, uint32_t *occupancy)
+{
+    esp_err_t ret = ESP_OK;
+    uint8_t wrpt_low = 0;
+    uint8_t wrpt_high = 0;
+    MAC_CHECK(enc28j60_register_read(emac, ENC28J60_ERXWRPTL, &wrpt_low) == ESP_OK,
+              "read ERXWRPTL failed", out, ESP_FAIL);
+    MAC_CHECK(enc28j60_register_read(emac, ENC28J60_ERXWRPTH, &wrpt_high) == ESP_OK,
+              "read ERXWRPTH failed", out, ESP_FAIL);
+    uint32_t size = emac->rx_end - ENC28J60_BUF_RX_START + 1;
+    uint32_t wrpt = wrpt_low + (wrpt_high << 8);
+    *occupancy = (wrpt + size - emac->next_packet_ptr) % size;
+out:
+    return ret;
+}
+
+/**
+ * @brief Receive all frames pending in the receive buffer
+ * @note EPKTCNT is read once per batch of at most rx_batch_max frames, the frames of a batch only decrement the
+ *       packet counter and the receive buffer space is freed by a single ERXRDPT update at the end of the batch.
+ *       The occupancy high water mark costs no SPI access, ERXWRPT is only read for ENC28J60_CMD_G_BUF_USAGE
+ */
+static esp_err_t enc28j60_rx_drain(emac_enc28j60_t *emac)
+{
+    esp_err_t ret = ESP_OK;
+    uint8_t pk_counter = 0;
+    enc28j60_batch_t batch;
+    /* netif is only usable once the driver is attached to the TCP/IP stack and the interface is up, the lwIP
+       netif exists and has its input function only then, use heap buffers till then */
+    struct netif *netif = NULL;
+    const enc28j60_rx_ops_t *ops = &enc28j60_rx_heap_ops;
+    if (emac->rx_mode != ENC28J60_RX_MODE_HEAP && emac->netif) {
+        netif = esp_netif_get_netif_impl(emac->netif);
+        if (netif && netif_is_up(netif) && netif->input) {
+            ops = emac->rx_mode == ENC28J60_RX_MODE_POOL ? &enc28j60_rx_pooled_ops : &enc28j60_rx_pbuf_ops;
+        } else {
+            netif = NULL;
+        }
+    }
+    /* receive buffer is at its fullest when the frames start being processed: its occupancy then is the span of
+       the frames pending at the first EPKTCNT read, known from the frame pointers once they are received */
+    uint32_t occ_start = emac->next_packet_ptr;
+    uint32_t occ_frames = 0;
+    uint32_t occ_received = 0;
+    while (1) {
+        uint32_t bank_switches = emac->bank_switches;
+        uint32_t spi_transactions = emac->spi_transactions;
+        MAC_CHECK(enc28j60_register_read(emac, ENC28J60_EPKTCNT, &pk_counter) == ESP_OK,
+                  "read EPKTCNT failed", out, ESP_FAIL);
+        if (!pk_counter) {
+            break;
+        }
+        if (!occ_frames) {
+            occ_frames = pk_counter;
+        }
+        /* per frame costs are accounted by the receive functions, only add the per batch ones */
+        portENTER_CRITICAL(&emac->stats_mux);
+        emac->bank_stats.rx_bank_switches += emac->bank_switches - bank_switches;
+        emac->bank_stats.rx_spi_transactions += emac->spi_transactions - spi_transactions;
+        portEXIT_CRITICAL(&emac->stats_mux);
+        uint32_t num = pk_counter < emac->rx_batch_max ? pk_counter : emac->rx_batch_max;
+        emac->rx_batch_active = true;
+        for (uint32_t i = 0; i < num && ret == ESP_OK; i++) {
+            uint32_t start = cpu_hal_get_cycle_count();
+            ret = enc28j60_receive(emac, ops, netif);
+            uint32_t cycles = cpu_hal_get_cycle_count() - start;
+            if (++occ_received == occ_frames && ret == ESP_OK) {
+                uint32_t size = emac->rx_end - ENC28J60_BUF_RX_START + 1;
+                uint32_t occupancy = (emac->next_packet_ptr + size - occ_start) % size;
+                if (occupancy > emac->rx_occupancy_hwm) {
+                    emac->rx_occupancy_hwm = occupancy;
+                }
+            }
+            portENTER_CRITICAL(&emac->stats_mux);
+            emac->rx_perf.frames++;
+            emac->rx_perf.cycles += cycles;
+            if (cycles > emac->rx_perf.max_cycles) {
+                emac->rx_perf.max_cycles = cycles;
+            }
+            portEXIT_CRITICAL(&emac->stats_mux);
+            /* a dropped frame has no stack stage, the next header read is measured from here */
+            if (emac->rx_lat.enabled) {
+                emac->rx_lat.mark_us = (uint32_t)esp_timer_get_time();
+            }
+        }
+        emac->rx_batch_active = false;
+        /* free the space of all frames released so far */
+        bank_switches = emac->bank_switches;
+        spi_transactions = emac->spi_transactions;
+        uint32_t erxrdpt = enc28j60_next_ptr_align_odd(emac->next_packet_ptr, ENC28J60_BUF_RX_START, emac->rx_end);
+        uint8_t values[] = {erxrdpt & 0xFF, (erxrdpt & 0xFF00) >> 8};
+        enc28j60_batch_init(&batch);
+        enc28j60_batch_add_seq(&batch, enc28j60_rx_release_seq, 2, values);
+        MAC_CHECK(enc28j60_batch_submit(emac, &batch) == ESP_OK, "write ERXRDPT failed", out, ESP_FAIL);
+        portENTER_CRITICAL(&emac->stats_mux);
+        emac->bank_stats.rx_bank_switches += emac->bank_switches - bank_switches;
+        emac->bank_stats.rx_spi_transactions += emac->spi_transactions - spi_transactions;
+        emac->bank_stats.rx_batches++;
+        portEXIT_CRITICAL(&emac->stats_mux);
+        if (ret != ESP_OK) {
+            break;
+        }
+    }
+out:
+    emac->rx_batch_active = false;
     return ret;
 }
 
 /**
- * @brief Set mediator for Ethernet MAC
+ * @brief Reset the receive logic and start over with an empty receive buffer
+ * @note used when the receive status vector shows the receive buffer can't be trusted anymore, pending frames are lost
  */
-static esp_err_t emac_enc28j60_set_mediator(esp_eth_mac_t *mac, esp_eth_mediator_t *eth)
+static esp_err_t enc28j60_rx_reset(emac_enc28j60_t *emac)
 {
     esp_err_t ret = ESP_OK;
-    MAC_CHECK(eth, "can't set mac's mediator to null", out, ESP_ERR_INVALID_ARG);
-    emac_enc28j60_t *emac = __containerof(mac, emac_enc28j60_t, parent);
-    emac->eth = eth;
+    enc28j60_batch_t batch;
+    uint32_t erxrdpt = enc28j60_next_ptr_align_odd(ENC28J60_BUF_RX_START, ENC28J60_BUF_RX_START, emac->rx_end);
+    uint8_t values[] = {
+        ENC28J60_BUF_RX_START & 0xFF, (ENC28J60_BUF_RX_START & 0xFF00) >> 8,
+        emac->rx_end & 0xFF, (emac->rx_end & 0xFF00) >> 8,
+        erxrdpt & 0xFF, (erxrdpt & 0xFF00) >> 8,
+    };
+    _Static_assert(sizeof(values) == ENC28J60_SETUP_SEQ_RX_RING_OPS, "values don't match rx ring part of enc28j60_setup_seq");
+
+    ESP_LOGW(TAG, "receive buffer corrupted, reset receive logic");
+    MAC_CHECK(enc28j60_do_bitwise_clr(emac, ENC28J60_ECON1, ECON1_RXEN) == ESP_OK,
+              "clear ECON1.RXEN failed", out, ESP_FAIL);
+    MAC_CHECK(enc28j60_do_bitwise_set(emac, ENC28J60_ECON1, ECON1_RXRST) == ESP_OK,
+              "set ECON1.RXRST failed", out, ESP_FAIL);
+    MAC_CHECK(enc28j60_do_bitwise_clr(emac, ENC28J60_ECON1, ECON1_RXRST) == ESP_OK,
+              "clear ECON1.RXRST failed", out, ESP_FAIL);
+    /* writing ERXST also resets the receive write pointer, RXRST clears the packet counter */
+    enc28j60_batch_init(&batch);
+    enc28j60_batch_add_seq(&batch, enc28j60_setup_seq, ENC28J60_SETUP_SEQ_RX_RING_OPS, values);
+    MAC_CHECK(enc28j60_batch_submit(emac, &batch) == ESP_OK,
+              "write receive buffer pointers failed", out, ESP_FAIL);
+    emac->next_packet_ptr = ENC28J60_BUF_RX_START;
+    emac->packets_remain = false;
+    MAC_CHECK(enc28j60_do_bitwise_clr(emac, ENC28J60_EIR, EIR_RXERIF) == ESP_OK,
+              "clear EIR.RXERIF failed", out, ESP_FAIL);
+    MAC_CHECK(enc28j60_do_bitwise_set(emac, ENC28J60_ECON1, ECON1_RXEN) == ESP_OK,
+              "set ECON1.RXEN failed", out, ESP_FAIL);
+    portENTER_CRITICAL(&emac->stats_mux);
+    emac->irq_stats.rx_resets++;
+    portEXIT_CRITICAL(&emac->stats_mux);
+    ENC28J60_STAT_INC(emac, rx_errors);
 out:
     return ret;
 }
 
 /**
- * @brief Verify chip ID
+ * @brief Recover from a transmit error
+ * @note the transmit logic may stall after an error (e.g. late collision), reset it before the next frame is started
  */
-static esp_err_t enc28j60_verify_id(emac_enc28j60_t *emac)
+static esp_err_t enc28j60_tx_error(emac_enc28j60_t *emac)
 {
     esp_err_t ret = ESP_OK;
-    uint8_t id;
-    MAC_CHECK(enc28j60_register_read(emac, ENC28J60_EREVID, &id) == ESP_OK,
-              "read EREVID failed", out, ESP_FAIL);
-    ESP_LOGI(TAG, "revision: %d", id);
-    MAC_CHECK(id > 0 && id < 7, "wrong chip ID", out, ESP_ERR_INVALID_VERSION);
+    uint8_t estat = 0;
+    MAC_CHECK(enc28j60_do_register_read(emac, true, ENC28J60_ESTAT, &estat) == ESP_OK,
+              "read ESTAT failed", out, ESP_FAIL);
+    if (estat & ESTAT_LATECOL) {
+        ENC28J60_STAT_INC(emac, tx_late_collisions);
+        emac->tx_late_collision = true;
+    }
+    if (estat & (ESTAT_LATECOL | ESTAT_TXABRT)) {
+        MAC_CHECK(enc28j60_do_bitwise_clr(emac, ENC28J60_ESTAT, ESTAT_LATECOL | ESTAT_TXABRT) == ESP_OK,
+                  "clear ESTAT failed", out, ESP_FAIL);
+    }
+    MAC_CHECK(enc28j60_do_bitwise_set(emac, ENC28J60_ECON1, ECON1_TXRST) == ESP_OK,
+              "set ECON1.TXRST failed", out, ESP_FAIL);
+    MAC_CHECK(enc28j60_do_bitwise_clr(emac, ENC28J60_ECON1, ECON1_TXRST) == ESP_OK,
+              "clear ECON1.TXRST failed", out, ESP_FAIL);
 out:
     return ret;
 }
 
 /**
- * @brief Write mac address to internal registers
+ * @brief Re-add the SPI device at another clock
+ * @note the spi master driver fixes the clock when a device is added, so the device has to be replaced
  */
-static esp_err_t enc28j60_set_mac_addr(emac_enc28j60_t *emac)
+static esp_err_t enc28j60_spi_set_clock(emac_enc28j60_t *emac, uint32_t clock_hz)
 {
     esp_err_t ret = ESP_OK;
-
-    MAC_CHECK(enc28j60_register_write(emac, ENC28J60_MAADR6, emac->addr[5]) == ESP_OK,
-              "write MAADR6 failed", out, ESP_FAIL);
-    MAC_CHECK(enc28j60_register_write(emac, ENC28J60_MAADR5, emac->addr[4]) == ESP_OK,
-              "write MAADR5 failed", out, ESP_FAIL);
-    MAC_CHECK(enc28j60_register_write(emac, ENC28J60_MAADR4, emac->addr[3]) == ESP_OK,
-              "write MAADR4 failed", out, ESP_FAIL);
-    MAC_CHECK(enc28j60_register_write(emac, ENC28J60_MAADR3, emac->addr[2]) == ESP_OK,
-              "write MAADR3 failed", out, ESP_FAIL);
-    MAC_CHECK(enc28j60_register_write(emac, ENC28J60_MAADR2, emac->addr[1]) == ESP_OK,
-              "write MAADR2 failed", out, ESP_FAIL);
-    MAC_CHECK(enc28j60_register_write(emac, ENC28J60_MAADR1, emac->addr[0]) == ESP_OK,
-              "write MAADR1 failed", out, ESP_FAIL);
+    uint32_t old_hz = emac->spi_devcfg.clock_speed_hz;
+
+    MAC_CHECK(emac->spi_host_id >= 0 && emac->spi_clock_min_hz, "SPI device config unknown, can't change clock", out,
+              ESP_ERR_NOT_SUPPORTED);
+    MAC_CHECK(clock_hz <= ENC28J60_SPI_CLOCK_MAX_HZ, "invalid SPI clock: %d", out, ESP_ERR_INVALID_ARG, clock_hz);
+    /* try the new clock on a device without CS first: removing a device releases its CS GPIO, so the old device
+       must be gone before the new one is added, and then there must be no reason left for adding to fail */
+    spi_device_interface_config_t probe_cfg = emac->spi_devcfg;
+    spi_device_handle_t probe = NULL;
+    probe_cfg.clock_speed_hz = clock_hz;
+    probe_cfg.spics_io_num = -1;
+    MAC_CHECK(spi_bus_add_device(emac->spi_host_id, &probe_cfg, &probe) == ESP_OK,
+              "add SPI device at %d Hz failed", out, ESP_FAIL, clock_hz);
+    spi_bus_remove_device(probe);
+
+    MAC_CHECK(enc28j60_lock_take(emac), "lock SPI device failed", out, ESP_ERR_TIMEOUT);
+    if (spi_bus_remove_device(emac->spi_hdl) == ESP_OK) {
+        emac->spi_devcfg.clock_speed_hz = clock_hz;
+        if (spi_bus_add_device(emac->spi_host_id, &emac->spi_devcfg, &emac->spi_hdl) != ESP_OK) {
+            ESP_LOGE(TAG, "add SPI device at %d Hz failed", clock_hz);
+            ret = ESP_FAIL;
+            /* get the device back at the old clock, other tasks are waiting for the lock to use it */
+            emac->spi_devcfg.clock_speed_hz = old_hz;
+            int retries = ENC28J60_SPI_READD_RETRIES;
+            while (spi_bus_add_device(emac->spi_host_id, &emac->spi_devcfg, &emac->spi_hdl) != ESP_OK) {
+                if (--retries == 0) {
+                    /* no device left, the controller can't be used any more: refuse all further SPI access */
+                    ESP_LOGE(TAG, "SPI device lost, controller failed");
+                    emac->spi_hdl = NULL;
+                    emac->spi_failed = true;
+                    ret = ESP_ERR_INVALID_STATE;
+                    break;
+                }
+                vTaskDelay(pdMS_TO_TICKS(10));
+            }
+        }
+    } else {
+        ret = ESP_FAIL;
+    }
+    enc28j60_lock_give(emac);
 out:
     return ret;
 }
 
 /**
- * @brief   Clear multicast hash table
+ * @brief Write test patterns into the transmit buffer and read them back at the current SPI clock
+ * @note the transmit buffer must be idle
  */
-static esp_err_t enc28j60_clear_multicast_table(emac_enc28j60_t *emac)
+static esp_err_t enc28j60_spi_verify(emac_enc28j60_t *emac, uint32_t rounds)
 {
     esp_err_t ret = ESP_OK;
-
-    for (int i = 0; i < 7; i++) {
-        MAC_CHECK(enc28j60_register_write(emac, ENC28J60_EHT0 + i, 0x00) == ESP_OK,
-                  "write ENC28J60_EHT%d failed", out, ESP_FAIL, i);
+    enc28j60_batch_t batch;
+    uint8_t *tx = heap_caps_malloc(ENC28J60_SPI_CALIB_LEN, MALLOC_CAP_DMA);
+    uint8_t *rx = heap_caps_malloc(ENC28J60_SPI_CALIB_LEN, MALLOC_CAP_DMA);
+
+    MAC_CHECK(tx && rx, "no mem for SPI test patterns", out, ESP_ERR_NO_MEM);
+    MAC_CHECK(enc28j60_frame_begin(emac) == ESP_OK, "begin frame transaction failed", out, ESP_ERR_TIMEOUT);
+    for (uint32_t r = 0; r < rounds && ret == ESP_OK; r++) {
+        /* alternating bits, all zeros/ones, walking one and a pseudo random sequence */
+        for (uint32_t i = 0; i < ENC28J60_SPI_CALIB_LEN; i++) {
+            switch (r % 4) {
+            case 0:
+                tx[i] = (i & 1) ? 0xAA : 0x55;
+                break;
+            case 1:
+                tx[i] = (i & 1) ? 0xFF : 0x00;
+                break;
+            case 2:
+                tx[i] = 1 << ((i + r) & 0x07);
+                break;
+            default:
+                tx[i] = (i * 0x9D + r * 0x3B) ^ (i >> 3);
+                break;
+            }
+        }
+        uint8_t values[] = {emac->tx_start & 0xFF, (emac->tx_start & 0xFF00) >> 8};
+        enc28j60_batch_init(&batch);
+        enc28j60_batch_add_seq(&batch, enc28j60_tx_write_ptr_seq, 2, values);
+        if (enc28j60_batch_submit(emac, &batch) != ESP_OK ||
+                enc28j60_do_memory_write(emac, tx, ENC28J60_SPI_CALIB_LEN) != ESP_OK ||
+                enc28j60_read_packet(emac, emac->tx_start, rx, ENC28J60_SPI_CALIB_LEN) != ESP_OK ||
+                memcmp(tx, rx, ENC28J60_SPI_CALIB_LEN)) {
+            ret = ESP_ERR_INVALID_RESPONSE;
+        }
     }
+    enc28j60_frame_end(emac);
 out:
+    heap_caps_free(tx);
+    heap_caps_free(rx);
     return ret;
 }
 
 /**
- * @brief Default setup for ENC28J60 internal registers
+ * @brief Find the fastest SPI clock that passes the memory loopback and settle one step below it
+ * @note clocks are tried in increasing order up to the first failure, the configured clock is the fallback
  */
-static esp_err_t enc28j60_setup_default(emac_enc28j60_t *emac)
+static esp_err_t enc28j60_spi_calibrate(emac_enc28j60_t *emac, uint32_t *clock_hz)
 {
     esp_err_t ret = ESP_OK;
+    int best = -1;
 
-    // set up receive buffer start + end
-    MAC_CHECK(enc28j60_register_write(emac, ENC28J60_ERXSTL, ENC28J60_BUF_RX_START & 0xFF) == ESP_OK,
-              "write ERXSTL failed", out, ESP_FAIL);
-    MAC_CHECK(enc28j60_register_write(emac, ENC28J60_ERXSTH, (ENC28J60_BUF_RX_START & 0xFF00) >> 8) == ESP_OK,
-              "write ERXSTH failed", out, ESP_FAIL);
-    MAC_CHECK(enc28j60_register_write(emac, ENC28J60_ERXNDL, ENC28J60_BUF_RX_END & 0xFF) == ESP_OK,
-              "write ERXNDL failed", out, ESP_FAIL);
-    MAC_CHECK(enc28j60_register_write(emac, ENC28J60_ERXNDH, (ENC28J60_BUF_RX_END & 0xFF00) >> 8) == ESP_OK,
-              "write ERXNDH failed", out, ESP_FAIL);
-    uint32_t erxrdpt = enc28j60_next_ptr_align_odd(ENC28J60_BUF_RX_START, ENC28J60_BUF_RX_START, ENC28J60_BUF_RX_END);
-    MAC_CHECK(enc28j60_register_write(emac, ENC28J60_ERXRDPTL, erxrdpt & 0xFF) == ESP_OK,
-              "write ERXRDPTL failed", out, ESP_FAIL);
-    MAC_CHECK(enc28j60_register_write(emac, ENC28J60_ERXRDPTH, (erxrdpt & 0xFF00) >> 8) == ESP_OK,
-              "write ERXRDPTH failed", out, ESP_FAIL);
-
-    // set up transmit buffer start + end
-    MAC_CHECK(enc28j60_register_write(emac, ENC28J60_ETXSTL, ENC28J60_BUF_TX_START & 0xFF) == ESP_OK,
-              "write ETXSTL failed", out, ESP_FAIL);
-    MAC_CHECK(enc28j60_register_write(emac, ENC28J60_ETXSTH, (ENC28J60_BUF_TX_START & 0xFF00) >> 8) == ESP_OK,
-              "write ETXSTH failed", out, ESP_FAIL);
-
-    // set up default filter mode: (unicast OR broadcast) AND crc valid
-    MAC_CHECK(enc28j60_register_write(emac, ENC28J60_ERXFCON, ERXFCON_UCEN | ERXFCON_CRCEN | ERXFCON_BCEN) == ESP_OK,
-              "write ERXFCON failed", out, ESP_FAIL);
-
-    // enable MAC receive, enable pause control frame on Tx and Rx path
-    MAC_CHECK(enc28j60_register_write(emac, ENC28J60_MACON1, MACON1_MARXEN | MACON1_RXPAUS | MACON1_TXPAUS) == ESP_OK,
-              "write MACON1 failed", out, ESP_FAIL);
-    // enable automatic padding, append CRC, check frame length, half duplex by default (can update at runtime)
-    MAC_CHECK(enc28j60_register_write(emac, ENC28J60_MACON3, MACON3_PADCFG0 | MACON3_TXCRCEN | MACON3_FRMLNEN) == ESP_OK, "write MACON3 failed", out, ESP_FAIL);
-    // enable defer transmission (effective only in half duplex)
-    MAC_CHECK(enc28j60_register_write(emac, ENC28J60_MACON4, MACON4_DEFER) == ESP_OK,
-              "write MACON4 failed", out, ESP_FAIL);
-    // set inter-frame gap (back-to-back)
-    MAC_CHECK(enc28j60_register_write(emac, ENC28J60_MABBIPG, 0x12) == ESP_OK,
-              "write MABBIPG failed", out, ESP_FAIL);
-    // set inter-frame gap (non-back-to-back)
-    MAC_CHECK(enc28j60_register_write(emac, ENC28J60_MAIPGL, 0x12) == ESP_OK,
-              "write MAIPGL failed", out, ESP_FAIL);
-    MAC_CHECK(enc28j60_register_write(emac, ENC28J60_MAIPGH, 0x0C) == ESP_OK,
-              "write MAIPGH failed", out, ESP_FAIL);
-
+    MAC_CHECK(emac->spi_host_id >= 0 && emac->spi_clock_min_hz, "SPI device config unknown, can't change clock", out,
+              ESP_ERR_NOT_SUPPORTED);
+    for (int i = 0; i < ENC28J60_SPI_CLOCKS_NUM; i++) {
+        if (enc28j60_spi_clocks[i] <= emac->spi_clock_min_hz) {
+            continue;
+        }
+        MAC_CHECK(enc28j60_spi_set_clock(emac, enc28j60_spi_clocks[i]) == ESP_OK, "set SPI clock failed", out, ESP_FAIL);
+        if (enc28j60_spi_verify(emac, ENC28J60_SPI_CALIB_ROUNDS) != ESP_OK) {
+            break;
+        }
+        best = i;
+    }
+    /* margin: one step below the fastest passing clock, but never below the configured one */
+    uint32_t chosen = emac->spi_clock_min_hz;
+    if (best > 0 && enc28j60_spi_clocks[best - 1] > chosen) {
+        chosen = enc28j60_spi_clocks[best - 1];
+    }
+    MAC_CHECK(enc28j60_spi_set_clock(emac, chosen) == ESP_OK, "set SPI clock failed", out, ESP_FAIL);
+    MAC_CHECK(enc28j60_spi_verify(emac, ENC28J60_SPI_CALIB_ROUNDS) == ESP_OK,
+              "memory loopback fails at %d Hz", out, ESP_ERR_INVALID_RESPONSE, chosen);
+    ESP_LOGI(TAG, "SPI clock calibrated to %d Hz", chosen);
+    *clock_hz = chosen;
 out:
     return ret;
 }
 
 /**
- * @brief Start enc28j60: enable interrupt and start receive
+ * @brief Step the SPI clock down after a read back error, the configured clock is the lowest it goes
+ * @note a single bad frame header is no proof of a bad clock (the chip may also have been reset or written a
+ *       corrupt frame), so the clock only drops if the memory loopback fails at the current clock as well. The
+ *       loopback uses the transmit buffer, it runs only while no frame is queued
  */
-static esp_err_t emac_enc28j60_start(esp_eth_mac_t *mac)
+static void enc28j60_spi_fallback(emac_enc28j60_t *emac)
 {
-    esp_err_t ret = ESP_OK;
-    emac_enc28j60_t *emac = __containerof(mac, emac_enc28j60_t, parent);
-    /* enable interrupt */
-    MAC_CHECK(enc28j60_do_bitwise_clr(emac, ENC28J60_EIR, 0xFF) == ESP_OK,
-              "clear EIR failed", out, ESP_FAIL);
-    MAC_CHECK(enc28j60_do_bitwise_set(emac, ENC28J60_EIE, EIE_PKTIE | EIE_INTIE) == ESP_OK,
-              "set EIE.[PKTIE|INTIE] failed", out, ESP_FAIL);
-    /* enable rx logic */
-    MAC_CHECK(enc28j60_do_bitwise_set(emac, ENC28J60_ECON1, ECON1_RXEN) == ESP_OK,
-              "set ECON1.RXEN failed", out, ESP_FAIL);
-
-    MAC_CHECK(enc28j60_register_write(emac, ENC28J60_ERDPTL, 0x00) == ESP_OK,
-              "write ERDPTL failed", out, ESP_FAIL);
-    MAC_CHECK(enc28j60_register_write(emac, ENC28J60_ERDPTH, 0x00) == ESP_OK,
-              "write ERDPTH failed", out, ESP_FAIL);
-out:
-    return ret;
+    uint32_t clock_hz = emac->spi_clock_min_hz;
+    uint32_t current_hz = emac->spi_devcfg.clock_speed_hz;
+    if (emac->spi_host_id < 0 || !clock_hz || current_hz <= clock_hz) {
+        return;
+    }
+    for (int i = 0; i < ENC28J60_SPI_CLOCKS_NUM; i++) {
+        if (enc28j60_spi_clocks[i] < current_hz && enc28j60_spi_clocks[i] > clock_hz) {
+            clock_hz = enc28j60_spi_clocks[i];
+        }
+    }
+    xSemaphoreTake(emac->tx_lock, portMAX_DELAY);
+    if (emac->tx_ring.count) {
+        ESP_LOGW(TAG, "read back error, transmit buffer busy, SPI clock stays at %d Hz", current_hz);
+    } else if (enc28j60_spi_verify(emac, ENC28J60_SPI_CONFIRM_ROUNDS) == ESP_OK) {
+        ESP_LOGW(TAG, "read back error, memory loopback passes, SPI clock stays at %d Hz", current_hz);
+    } else {
+        ESP_LOGW(TAG, "read back error, lower SPI clock from %d to %d Hz", current_hz, clock_hz);
+        if (enc28j60_spi_set_clock(emac, clock_hz) == ESP_OK) {
+            emac->spi_fallbacks++;
+        }
+    }
+    xSemaphoreGive(emac->tx_lock);
 }
 
 /**
- * @brief   Stop enc28j60: disable interrupt and stop receiving packets
+ * @brief Acknowledge a PHY link change and pass it on to the registered handler
  */
-static esp_err_t emac_enc28j60_stop(esp_eth_mac_t *mac)
+static esp_err_t enc28j60_link_changed(emac_enc28j60_t *emac)
 {
     esp_err_t ret = ESP_OK;
-    emac_enc28j60_t *emac = __containerof(mac, emac_enc28j60_t, parent);
-    /* disable interrupt */
-    MAC_CHECK(enc28j60_do_bitwise_clr(emac, ENC28J60_EIE, 0xFF) == ESP_OK,
-              "clear EIE failed", out, ESP_FAIL);
-    /* disable rx */
-    MAC_CHECK(enc28j60_do_bitwise_clr(emac, ENC28J60_ECON1, ECON1_RXEN) == ESP_OK,
-              "clear ECON1.RXEN failed", out, ESP_FAIL);
+    uint32_t phir = 0;
+    /* reading PHIR clears PGIF and PLNKIF, LINKIF follows */
+    MAC_CHECK(emac->parent.read_phy_reg(&emac->parent, 0, ENC28J60_PHIR, &phir) == ESP_OK,
+              "read PHIR failed", out, ESP_FAIL);
+    if (emac->link_handler.handler) {
+        emac->link_handler.handler(emac->link_handler.arg);
+    }
 out:
     return ret;
 }
 
-static esp_err_t emac_enc28j60_set_addr(esp_eth_mac_t *mac, uint8_t *addr)
+/**
+ * @brief Service all pending interrupt flags
+ * @note INT is asserted till all enabled flags are cleared, so keep going till then, otherwise no new edge arrives
+ */
+static esp_err_t enc28j60_service_irq(emac_enc28j60_t *emac)
 {
     esp_err_t ret = ESP_OK;
-    MAC_CHECK(addr, "can't set mac addr to null", out, ESP_ERR_INVALID_ARG);
-    emac_enc28j60_t *emac = __containerof(mac, emac_enc28j60_t, parent);
-    memcpy(emac->addr, addr, 6);
-    MAC_CHECK(enc28j60_set_mac_addr(emac) == ESP_OK, "set mac address failed", out, ESP_FAIL);
-out:
-    return ret;
-}
+    uint8_t status = 0;
 
-static esp_err_t emac_enc28j60_get_addr(esp_eth_mac_t *mac, uint8_t *addr)
-{
-    esp_err_t ret = ESP_OK;
-    MAC_CHECK(addr, "can't set mac addr to null", out, ESP_ERR_INVALID_ARG);
-    emac_enc28j60_t *emac = __containerof(mac, emac_enc28j60_t, parent);
-    memcpy(addr, emac->addr, 6);
-out:
+    while (enc28j60_do_register_read(emac, true, ENC28J60_EIR, &status) == ESP_OK &&
+            (status & ENC28J60_EIR_HANDLED)) {
+        /* link changed, LINKIF is cleared by reading PHIR */
+        if (status & EIR_LINKIF) {
+            portENTER_CRITICAL(&emac->stats_mux);
+            emac->irq_stats.linkif++;
+            portEXIT_CRITICAL(&emac->stats_mux);
+            enc28j60_link_changed(emac);
+        }
+        /* transmit aborted, the transmit logic needs a reset */
+        if (status & EIR_TXERIF) {
+            portENTER_CRITICAL(&emac->stats_mux);
+            emac->irq_stats.txerif++;
+            portEXIT_CRITICAL(&emac->stats_mux);
+            ENC28J60_STAT_INC(emac, tx_aborts);
+            enc28j60_tx_error(emac);
+        }
+        /* transmit done (or aborted), the next queued frame can go and blocked transmitters wake up */
+        if (status & (EIR_TXIF | EIR_TXERIF)) {
+            portENTER_CRITICAL(&emac->stats_mux);
+            emac->irq_stats.txif += (status & EIR_TXIF) ? 1 : 0;
+            portEXIT_CRITICAL(&emac->stats_mux);
+            enc28j60_do_bitwise_clr(emac, ENC28J60_EIR, status & (EIR_TXIF | EIR_TXERIF));
+            enc28j60_tx_complete(emac);
+        }
+        /* packet received, PKTIF clears itself once EPKTCNT gets zero */
+        if (status & EIR_PKTIF) {
+            portENTER_CRITICAL(&emac->stats_mux);
+            emac->irq_stats.pktif++;
+            portEXIT_CRITICAL(&emac->stats_mux);
+            ret = enc28j60_rx_drain(emac);
+            if (ret == ESP_ERR_INVALID_RESPONSE) {
+                enc28j60_spi_fallback(emac);
+                ret = enc28j60_rx_reset(emac);
+            }
+            if (ret != ESP_OK) {
+                break;
+            }
+        }
+        /* receive buffer was full, the chip dropped frames; draining above made room again */
+        if (status & EIR_RXERIF) {
+            portENTER_CRITICAL(&emac->stats_mux);
+            emac->irq_stats.rxerif++;
+            portEXIT_CRITICAL(&emac->stats_mux);
+            ENC28J60_STAT_INC(emac, rx_overflows);
+            enc28j60_do_bitwise_clr(emac, ENC28J60_EIR, EIR_RXERIF);
+        }
+    }
     return ret;
 }
 
-static void enc28j60_isr_handler(void *arg)
+/**
+ * @brief Keep servicing the chip with the GPIO interrupt masked while frames keep coming
+ * @note leaves poll mode when a round finds no frame, the budget is used up or the time window is over
+ */
+static void enc28j60_poll(emac_enc28j60_t *emac)
 {
-    emac_enc28j60_t *emac = (emac_enc28j60_t *)arg;
-    BaseType_t high_task_wakeup = pdFALSE;
-    /* notify enc28j60 task */
-    vTaskNotifyGiveFromISR(emac->rx_task_hdl, &high_task_wakeup);
-    if (high_task_wakeup != pdFALSE) {
-        portYIELD_FROM_ISR();
+    uint32_t polled = 0;
+    uint32_t frames = 0;
+    uint32_t *exit_count = NULL;
+    int64_t start = esp_timer_get_time();
+
+    gpio_intr_disable(emac->int_gpio_num);
+    while (1) {
+        /* let other tasks of the same priority run between rounds */
+        taskYIELD();
+        enc28j60_rx_lat_wakeup(emac, false);
+        frames = emac->rx_perf.frames;
+        if (enc28j60_service_irq(emac) != ESP_OK) {
+            break;
+        }
+        frames = emac->rx_perf.frames - frames;
+        polled += frames;
+        if (!frames) {
+            exit_count = &emac->napi_stats.exits_idle;
+            break;
+        }
+        if (polled >= emac->napi_budget) {
+            exit_count = &emac->napi_stats.exits_budget;
+            break;
+        }
+        if (esp_timer_get_time() - start >= emac->napi_window_us) {
+            exit_count = &emac->napi_stats.exits_window;
+            break;
+        }
+    }
+    gpio_intr_enable(emac->int_gpio_num);
+    /* an edge while the interrupt was masked is lost, INT is active low and stays asserted till serviced */
+    bool rearm = !gpio_get_level(emac->int_gpio_num);
+    portENTER_CRITICAL(&emac->stats_mux);
+    emac->napi_stats.poll_entries++;
+    if (exit_count) {
+        (*exit_count)++;
+    }
+    emac->napi_stats.frames_polled += polled;
+    if (rearm) {
+        emac->napi_stats.rearm_pending++;
+    }
+    portEXIT_CRITICAL(&emac->stats_mux);
+    if (rearm) {
+        xTaskNotifyGive(emac->rx_task_hdl);
     }
 }
 
 static void emac_enc28j60_task(void *arg)
 {
     emac_enc28j60_t *emac = (emac_enc28j60_t *)arg;
-    uint8_t status = 0;
-    uint8_t *buffer = NULL;
-    uint32_t length = 0;
 
     while (1) {
         // block indefinitely until some task notifies me
         ulTaskNotifyTake(pdFALSE, portMAX_DELAY);
-        /* clear interrupt status */
-        enc28j60_do_register_read(emac, true, ENC28J60_EIR, &status);
-        /* packet received */
-        if (status & EIR_PKTIF) {
-            do {
-                length = ETH_MAX_PACKET_SIZE;
-                buffer = heap_caps_malloc(length, MALLOC_CAP_DMA);
-                if (!buffer) {
-                    ESP_LOGE(TAG, "no mem for receive buffer");
-                } else if (emac->parent.receive(&emac->parent, buffer, &length) == ESP_OK) {
-                    /* pass the buffer to stack (e.g. TCP/IP layer) */
-                    if (length) {
-                        emac->eth->stack_input(emac->eth, buffer, length);
-                    } else {
-                        free(buffer);
-                    }
-                } else {
-                    free(buffer);
-                }
-            } while (emac->packets_remain);
+        enc28j60_rx_lat_wakeup(emac, true);
+        uint32_t frames = emac->rx_perf.frames;
+        if (enc28j60_service_irq(emac) != ESP_OK) {
+            continue;
+        }
+        /* burst in progress, switch to polling to save interrupts and context switches */
+        if (emac->napi_threshold && emac->rx_perf.frames - frames >= emac->napi_threshold) {
+            enc28j60_poll(emac);
         }
     }
     vTaskDelete(NULL);
@@ -719,7 +3105,7 @@ static esp_err_t emac_enc28j60_set_duplex(esp_eth_mac_t *mac, eth_duplex_t duple
     esp_err_t ret = ESP_OK;
     emac_enc28j60_t *emac = __containerof(mac, emac_enc28j60_t, parent);
     uint8_t mac3 = 0;
-    MAC_CHECK(enc28j60_register_read(emac, ENC28J60_MACON3, &mac3) == ESP_OK,
+    MAC_CHECK(enc28j60_register_read_cached(emac, ENC28J60_MACON3, &mac3) == ESP_OK,
               "read MACON3 failed", out, ESP_FAIL);
     switch (duplex) {
     case ETH_DUPLEX_HALF:
@@ -738,6 +3124,11 @@ static esp_err_t emac_enc28j60_set_duplex(esp_eth_mac_t *mac, eth_duplex_t duple
         MAC_CHECK(false, "unknown duplex", out, ESP_ERR_INVALID_ARG);
         break;
     }
+    MAC_CHECK(enc28j60_register_write(emac, ENC28J60_MAIPGL, 0x12) == ESP_OK,
+              "write MAIPGL failed", out, ESP_FAIL);
+    /* MAIPGH only applies to half duplex */
+    MAC_CHECK(enc28j60_register_write(emac, ENC28J60_MAIPGH, duplex == ETH_DUPLEX_HALF ? 0x0C : 0x00) == ESP_OK,
+              "write MAIPGH failed", out, ESP_FAIL);
     MAC_CHECK(enc28j60_register_write(emac, ENC28J60_MACON3, mac3) == ESP_OK,
               "write MACON3 failed", out, ESP_FAIL);
 out:
@@ -748,10 +3139,9 @@ static esp_err_t emac_enc28j60_set_promiscuous(esp_eth_mac_t *mac, bool enable)
 {
     esp_err_t ret = ESP_OK;
     emac_enc28j60_t *emac = __containerof(mac, emac_enc28j60_t, parent);
-    if (enable) {
-        MAC_CHECK(enc28j60_register_write(emac, ENC28J60_ERXFCON, 0x00) == ESP_OK,
-                  "write ERXFCON failed", out, ESP_FAIL);
-    }
+    /* all filters off lets every frame pass, leaving promiscuous mode restores the selected filters */
+    MAC_CHECK(enc28j60_register_write(emac, ENC28J60_ERXFCON, enable ? 0x00 : emac->rx_filter) == ESP_OK,
+              "write ERXFCON failed", out, ESP_FAIL);
 out:
     return ret;
 }
@@ -760,35 +3150,73 @@ static esp_err_t emac_enc28j60_transmit(esp_eth_mac_t *mac, uint8_t *buf, uint32
 {
     esp_err_t ret = ESP_OK;
     emac_enc28j60_t *emac = __containerof(mac, emac_enc28j60_t, parent);
-    uint8_t econ1 = 0;
-
-    /* Check if last transmit complete */
-    MAC_CHECK(enc28j60_do_register_read(emac, true, ENC28J60_ECON1, &econ1) == ESP_OK,
-              "read ECON1 failed", out, ESP_FAIL);
-    MAC_CHECK(!(econ1 & ECON1_TXRTS), "last transmit still in progress", out, ESP_ERR_INVALID_STATE);
-
-    /* Set the write pointer to start of transmit buffer area */
-    MAC_CHECK(enc28j60_register_write(emac, ENC28J60_EWRPTL, ENC28J60_BUF_TX_START & 0xFF) == ESP_OK,
-              "write EWRPTL failed", out, ESP_FAIL);
-    MAC_CHECK(enc28j60_register_write(emac, ENC28J60_EWRPTH, (ENC28J60_BUF_TX_START & 0xFF00) >> 8) == ESP_OK,
-              "write EWRPTH failed", out, ESP_FAIL);
-
-    /* Set the end pointer to correspond to the packet size given */
-    MAC_CHECK(enc28j60_register_write(emac, ENC28J60_ETXNDL, (ENC28J60_BUF_TX_START + length) & 0xFF) == ESP_OK,
-              "write ETXNDL failed", out, ESP_FAIL);
-    MAC_CHECK(enc28j60_register_write(emac, ENC28J60_ETXNDH, ((ENC28J60_BUF_TX_START + length) & 0xFF00) >> 8) == ESP_OK,
-              "write ETXNDH failed", out, ESP_FAIL);
+    enc28j60_tx_ring_t *ring = &emac->tx_ring;
+    uint32_t bank_switches = emac->bank_switches;
+    uint32_t spi_transactions = emac->spi_transactions;
+    bool locked = false;
+    int start = -1;
+    enc28j60_batch_t batch;
+    TickType_t wait_start = xTaskGetTickCount();
+    TickType_t wait_ticks = pdMS_TO_TICKS(emac->tx_wait_ms);
+
+    MAC_CHECK(length && length <= ENC28J60_TX_MAX_FRAME_LEN, "invalid frame length: %d", out, ESP_ERR_INVALID_ARG, length);
+    /* wait for room in the transmit buffer, each completed frame frees a slot and wakes one waiting transmitter,
+       which retries till the frame fits or the wait time is used up */
+    while (1) {
+        xSemaphoreTake(emac->tx_lock, portMAX_DELAY);
+        locked = true;
+        start = enc28j60_tx_ring_alloc(emac, length);
+        if (start >= 0) {
+            break;
+        }
+        xSemaphoreGive(emac->tx_lock);
+        locked = false;
+        TickType_t waited = xTaskGetTickCount() - wait_start;
+        if (waited >= wait_ticks || xSemaphoreTake(emac->tx_sem, wait_ticks - waited) != pdTRUE) {
+            ENC28J60_STAT_INC(emac, tx_timeouts);
+            MAC_CHECK(false, "wait for transmit buffer timeout", out, ESP_ERR_TIMEOUT);
+        }
+    }
 
-    /* copy data to tx memory */
+    MAC_CHECK(enc28j60_frame_begin(emac) == ESP_OK, "begin frame transaction failed", out, ESP_ERR_TIMEOUT);
+    ENC28J60_TRACE_MARK(emac, ENC28J60_TRACE_TX_BEGIN);
+    /* copy control byte and frame to tx memory */
+    uint8_t values[] = {start & 0xFF, (start & 0xFF00) >> 8};
+    enc28j60_batch_init(&batch);
+    enc28j60_batch_add_seq(&batch, enc28j60_tx_write_ptr_seq, 2, values);
+    MAC_CHECK(enc28j60_batch_submit(emac, &batch) == ESP_OK,
+              "write EWRPT failed", out, ESP_FAIL);
     uint8_t per_pkt_control = 0; // MACON3 will be used to determine how the packet will be transmitted
     MAC_CHECK(enc28j60_do_memory_write(emac, &per_pkt_control, 1) == ESP_OK,
               "write packet control byte failed", out, ESP_FAIL);
     MAC_CHECK(enc28j60_do_memory_write(emac, buf, length) == ESP_OK,
               "buffer memory write failed", out, ESP_FAIL);
-    /* issue tx polling command */
-    MAC_CHECK(enc28j60_do_bitwise_set(emac, ENC28J60_ECON1, ECON1_TXRTS) == ESP_OK,
-              "set ECON1.TXRTS failed", out, ESP_FAIL);
+    if (emac->csum_offload & ENC28J60_CSUM_OFFLOAD_TX) {
+        MAC_CHECK(enc28j60_tx_checksum(emac, start + 1, buf, length) == ESP_OK,
+                  "checksum offload failed", out, ESP_FAIL);
+    }
+
+    /* queue the frame, transmission starts right away if the transmit logic is idle */
+    uint32_t tail = (ring->head + ring->count) % ENC28J60_TX_RING_SLOTS;
+    ring->desc[tail].start = start;
+    ring->desc[tail].len = length;
+    ring->count++;
+    ring->wr_addr = start + 1 + length + ENC28J60_TSV_SIZE;
+    if (!ring->busy) {
+        MAC_CHECK(enc28j60_tx_kick(emac) == ESP_OK, "start transmit failed", out, ESP_FAIL);
+    }
+    ENC28J60_STAT_INC(emac, tx_frames);
+    ENC28J60_STAT_ADD(emac, tx_bytes, length);
+    portENTER_CRITICAL(&emac->stats_mux);
+    emac->bank_stats.tx_frames++;
+    emac->bank_stats.tx_bank_switches += emac->bank_switches - bank_switches;
+    emac->bank_stats.tx_spi_transactions += emac->spi_transactions - spi_transactions;
+    portEXIT_CRITICAL(&emac->stats_mux);
 out:
+    enc28j60_frame_end(emac);
+    if (locked) {
+        xSemaphoreGive(emac->tx_lock);
+    }
     return ret;
 }
 
@@ -796,38 +3224,26 @@ static esp_err_t emac_enc28j60_receive(esp_eth_mac_t *mac, uint8_t *buf, uint32_
 {
     esp_err_t ret = ESP_OK;
     emac_enc28j60_t *emac = __containerof(mac, emac_enc28j60_t, parent);
-    uint8_t pk_counter = 0;
-    uint16_t rx_len = 0;
+    uint32_t rx_len = 0;
     uint32_t next_packet_addr = 0;
-    __attribute__((aligned(4))) enc28j60_rx_header_t header; // SPI driver needs the rx buffer 4 byte align
+    uint32_t bank_switches = emac->bank_switches;
+    uint32_t spi_transactions = emac->spi_transactions;
 
     // read packet header
-    MAC_CHECK(enc28j60_read_packet(emac, emac->next_packet_ptr, (uint8_t *)&header, sizeof(header)) == ESP_OK,
-              "read header failed", out, ESP_FAIL);
-
-    // get packets' length, address
-    rx_len = header.length_low + (header.length_high << 8);
-    next_packet_addr = header.next_packet_low + (header.next_packet_high << 8);
-
+    ret = enc28j60_rx_peek(emac, &rx_len, &next_packet_addr);
+    MAC_CHECK(ret == ESP_OK, "peek frame failed", out, ret);
     // read packet content
-    MAC_CHECK(enc28j60_read_packet(emac, enc28j60_rx_packet_start(emac->next_packet_ptr, ENC28J60_RSV_SIZE), buf, rx_len) == ESP_OK,
+    MAC_CHECK(enc28j60_rx_payload(emac, buf, rx_len) == ESP_OK,
               "read packet content failed", out, ESP_FAIL);
-
-    // free receive buffer space
-    uint32_t erxrdpt = enc28j60_next_ptr_align_odd(next_packet_addr, ENC28J60_BUF_RX_START, ENC28J60_BUF_RX_END);
-    MAC_CHECK(enc28j60_register_write(emac, ENC28J60_ERXRDPTL, (erxrdpt & 0xFF)) == ESP_OK,
-              "write ERXRDPTL failed", out, ESP_FAIL);
-    MAC_CHECK(enc28j60_register_write(emac, ENC28J60_ERXRDPTH, (erxrdpt & 0xFF00) >> 8) == ESP_OK,
-              "write ERXRDPTH failed", out, ESP_FAIL);
-    emac->next_packet_ptr = next_packet_addr;
-
-    MAC_CHECK(enc28j60_do_bitwise_set(emac, ENC28J60_ECON2, ECON2_PKTDEC) == ESP_OK,
-              "set ECON2.PKTDEC failed", out, ESP_FAIL);
-    MAC_CHECK(enc28j60_register_read(emac, ENC28J60_EPKTCNT, &pk_counter) == ESP_OK,
-              "read EPKTCNT failed", out, ESP_FAIL);
+    // free receive buffer space and decrement packet counter
+    MAC_CHECK(enc28j60_rx_release(emac, next_packet_addr) == ESP_OK, "release frame failed", out, ESP_FAIL);
 
     *length = rx_len - 4; // substract the CRC length
-    emac->packets_remain = pk_counter > 0;
+    portENTER_CRITICAL(&emac->stats_mux);
+    emac->bank_stats.rx_frames++;
+    emac->bank_stats.rx_bank_switches += emac->bank_switches - bank_switches;
+    emac->bank_stats.rx_spi_transactions += emac->spi_transactions - spi_transactions;
+    portEXIT_CRITICAL(&emac->stats_mux);
 out:
     return ret;
 }
@@ -852,10 +3268,15 @@ static esp_err_t emac_enc28j60_init(esp_eth_mac_t *mac)
     MAC_CHECK(enc28j60_do_reset(emac) == ESP_OK, "reset enc28j60 failed", out, ESP_FAIL);
     /* verify chip id */
     MAC_CHECK(enc28j60_verify_id(emac) == ESP_OK, "vefiry chip ID failed", out, ESP_FAIL);
+    /* load reset values of control registers into shadow cache */
+    MAC_CHECK(enc28j60_shadow_resync(emac, NULL) == ESP_OK, "load shadow registers failed", out, ESP_FAIL);
     /* default setup of internal registers */
     MAC_CHECK(enc28j60_setup_default(emac) == ESP_OK, "enc28j60 default setup failed", out, ESP_FAIL);
     /* clear multicast hash table */
     MAC_CHECK(enc28j60_clear_multicast_table(emac) == ESP_OK, "clear multicast table failed", out, ESP_FAIL);
+    /* link change interrupt stays enabled while the MAC is stopped, the PHY side is enabled by the PHY driver */
+    MAC_CHECK(enc28j60_do_bitwise_set(emac, ENC28J60_EIE, EIE_LINKIE | EIE_INTIE) == ESP_OK,
+              "set EIE failed", out, ESP_FAIL);
 
     return ESP_OK;
 out:
@@ -870,6 +3291,7 @@ static esp_err_t emac_enc28j60_deinit(esp_eth_mac_t *mac)
     emac_enc28j60_t *emac = __containerof(mac, emac_enc28j60_t, parent);
     esp_eth_mediator_t *eth = emac->eth;
     mac->stop(mac);
+    enc28j60_do_bitwise_clr(emac, ENC28J60_EIE, 0xFF);
     gpio_isr_handler_remove(emac->int_gpio_num);
     gpio_reset_pin(emac->int_gpio_num);
     eth->on_state_changed(eth, ETH_STATE_DEINIT, NULL);
@@ -881,10 +3303,354 @@ static esp_err_t emac_enc28j60_del(esp_eth_mac_t *mac)
     emac_enc28j60_t *emac = __containerof(mac, emac_enc28j60_t, parent);
     vTaskDelete(emac->rx_task_hdl);
     vSemaphoreDelete(emac->spi_lock);
+    vSemaphoreDelete(emac->bus_turn);
+    vSemaphoreDelete(emac->tx_lock);
+    vSemaphoreDelete(emac->tx_sem);
+    for (int i = 0; i < ENC28J60_RX_POOL_CLASSES; i++) {
+        enc28j60_rx_pool_deinit(&emac->rx_pool[i]);
+    }
+    free(emac->trace.entries);
     free(emac);
     return ESP_OK;
 }
 
+
+/**
+ * @brief Receive hook while the duplex test runs: note the test frame and drop whatever we sent ourselves,
+ *        so the stack doesn't see its own frames looped back. Pass everything else on.
+ */
+static bool enc28j60_loopback_hook(void *arg, uint8_t *frame, uint32_t *len)
+{
+    emac_enc28j60_t *emac = (emac_enc28j60_t *)arg;
+    if (*len >= ENC28J60_ETH_HDR_LEN && !memcmp(frame + 6, emac->addr, 6)) {
+        if (frame[12] == (ENC28J60_LOOPBACK_ETHERTYPE >> 8) && frame[13] == (ENC28J60_LOOPBACK_ETHERTYPE & 0xFF)) {
+            __atomic_store_n(&emac->loopback_seen, true, __ATOMIC_RELAXED);
+        }
+        return false;
+    }
+    eth_enc28j60_rx_hook_t *chained = &emac->loopback_chained_hook;
+    return !chained->hook || chained->hook(chained->arg, frame, len);
+}
+
+/**
+ * @brief Send a frame to ourselves with the PHY in loopback
+ * @note PHY loopback needs full duplex in both PHCON1.PDPXMD and MACON3.FULDPX, so the frame only comes back if the
+ *       forced duplex mode is in effect. The MAC is set to the duplex mode of the PHY first, as on link up.
+ *       Meant to run before esp_eth_start(): nothing is sent to or received from the wire during the test, the MAC
+ *       is started for it if it is stopped, and the link change the test causes is not reported.
+ */
+static esp_err_t enc28j60_duplex_test(emac_enc28j60_t *emac, eth_enc28j60_duplex_test_t *result)
+{
+    esp_err_t ret = ESP_OK;
+    esp_eth_mac_t *mac = &emac->parent;
+    uint32_t phcon1 = 0;
+    uint32_t phcon2 = 0;
+    uint32_t phir = 0;
+    uint8_t mac3 = 0;
+    uint8_t econ1 = 0;
+    uint8_t frame[60] = {0};
+    bool started = false;
+    bool looping = false;
+    eth_enc28j60_rx_hook_t test_hook = {
+        .hook = enc28j60_loopback_hook,
+        .arg = emac
+    };
+
+    memset(result, 0, sizeof(eth_enc28j60_duplex_test_t));
+    MAC_CHECK(emac_enc28j60_read_phy_reg(mac, 0, ENC28J60_PHCON1, &phcon1) == ESP_OK,
+              "read PHCON1 failed", out, ESP_FAIL);
+    MAC_CHECK(emac_enc28j60_read_phy_reg(mac, 0, ENC28J60_PHCON2, &phcon2) == ESP_OK,
+              "read PHCON2 failed", out, ESP_FAIL);
+    result->phy_full_duplex = phcon1 & PHCON1_PDPXMD;
+    MAC_CHECK(mac->set_duplex(mac, result->phy_full_duplex ? ETH_DUPLEX_FULL : ETH_DUPLEX_HALF) == ESP_OK,
+              "set duplex failed", out, ESP_FAIL);
+    MAC_CHECK(enc28j60_register_read_cached(emac, ENC28J60_MACON3, &mac3) == ESP_OK,
+              "read MACON3 failed", out, ESP_FAIL);
+    result->mac_full_duplex = mac3 & MACON3_FULDPX;
+    MAC_CHECK(enc28j60_do_register_read(emac, true, ENC28J60_ECON1, &econ1) == ESP_OK,
+              "read ECON1 failed", out, ESP_FAIL);
+    if (!(econ1 & ECON1_RXEN)) {
+        MAC_CHECK(mac->start(mac) == ESP_OK, "start MAC failed", out, ESP_FAIL);
+        started = true;
+    }
+
+    emac->loopback_chained_hook = emac->rx_hook;
+    emac->loopback_seen = false;
+    emac->rx_hook = test_hook;
+    looping = true;
+    /* forcing the link and the loopback change the link status, keep it from the link handler */
+    MAC_CHECK(enc28j60_do_bitwise_clr(emac, ENC28J60_EIE, EIE_LINKIE) == ESP_OK,
+              "clear EIE.LINKIE failed", out, ESP_FAIL);
+    MAC_CHECK(emac_enc28j60_write_phy_reg(mac, 0, ENC28J60_PHCON2, phcon2 | PHCON2_FRCLNK) == ESP_OK,
+              "write PHCON2 failed", out, ESP_FAIL);
+    MAC_CHECK(emac_enc28j60_write_phy_reg(mac, 0, ENC28J60_PHCON1, phcon1 | PHCON1_PLOOPBK) == ESP_OK,
+              "write PHCON1 failed", out, ESP_FAIL);
+    memcpy(frame, emac->addr, 6);
+    memcpy(frame + 6, emac->addr, 6);
+    frame[12] = ENC28J60_LOOPBACK_ETHERTYPE >> 8;
+    frame[13] = ENC28J60_LOOPBACK_ETHERTYPE & 0xFF;
+    MAC_CHECK(mac->transmit(mac, frame, sizeof(frame)) == ESP_OK, "send test frame failed", out, ESP_FAIL);
+    for (uint32_t i = 0; i < ENC28J60_LOOPBACK_TIMEOUT_MS / 10; i++) {
+        if (__atomic_load_n(&emac->loopback_seen, __ATOMIC_RELAXED)) {
+            break;
+        }
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    result->looped_back = __atomic_load_n(&emac->loopback_seen, __ATOMIC_RELAXED);
+out:
+    if (looping) {
+        emac_enc28j60_write_phy_reg(mac, 0, ENC28J60_PHCON1, phcon1);
+        emac_enc28j60_write_phy_reg(mac, 0, ENC28J60_PHCON2, phcon2);
+        /* reading PHIR drops the link change of the test */
+        emac_enc28j60_read_phy_reg(mac, 0, ENC28J60_PHIR, &phir);
+        enc28j60_do_bitwise_set(emac, ENC28J60_EIE, EIE_LINKIE);
+        emac->rx_hook = emac->loopback_chained_hook;
+    }
+    if (started) {
+        mac->stop(mac);
+    }
+    return ret;
+}
+
+/**
+ * @brief Copy the driver counters, counter by counter, optionally resetting each one as it is read
+ * @note stats may be NULL when only resetting
+ */
+static void enc28j60_stats_read(emac_enc28j60_t *emac, eth_enc28j60_stats_t *stats, bool reset)
+{
+    uint32_t *counters = (uint32_t *)&emac->stats;
+    uint32_t *out = (uint32_t *)stats;
+    for (uint32_t i = 0; i < sizeof(eth_enc28j60_stats_t) / sizeof(uint32_t); i++) {
+        uint32_t value = reset ? __atomic_exchange_n(&counters[i], 0, __ATOMIC_RELAXED) :
+                         __atomic_load_n(&counters[i], __ATOMIC_RELAXED);
+        if (out) {
+            out[i] = value;
+        }
+    }
+}
+
+esp_err_t esp_eth_mac_enc28j60_ioctl(esp_eth_mac_t *mac, eth_enc28j60_io_cmd_t cmd, void *data)
+{
+    esp_err_t ret = ESP_OK;
+    MAC_CHECK(mac, "can't set mac to null", out, ESP_ERR_INVALID_ARG);
+    emac_enc28j60_t *emac = __containerof(mac, emac_enc28j60_t, parent);
+    switch (cmd) {
+    case ENC28J60_CMD_G_BANK_STATS:
+        MAC_CHECK(data, "can't set bank stats to null", out, ESP_ERR_INVALID_ARG);
+        portENTER_CRITICAL(&emac->stats_mux);
+        *(eth_enc28j60_bank_stats_t *)data = emac->bank_stats;
+        portEXIT_CRITICAL(&emac->stats_mux);
+        break;
+    case ENC28J60_CMD_SHADOW_RESYNC:
+        MAC_CHECK(enc28j60_shadow_resync(emac, (uint32_t *)data) == ESP_OK, "resync shadow registers failed", out, ESP_FAIL);
+        break;
+    case ENC28J60_CMD_G_RX_POOL_STATS: {
+        MAC_CHECK(data, "can't set rx pool stats to null", out, ESP_ERR_INVALID_ARG);
+        eth_enc28j60_rx_pool_stats_t *stats = (eth_enc28j60_rx_pool_stats_t *)data;
+        enc28j60_rx_pool_t *small = &emac->rx_pool[ENC28J60_RX_POOL_SMALL];
+        enc28j60_rx_pool_t *large = &emac->rx_pool[ENC28J60_RX_POOL_LARGE];
+        stats->small_num = small->num;
+        stats->small_free = __atomic_load_n(&small->num_free, __ATOMIC_RELAXED);
+        stats->small_min_free = small->min_free;
+        stats->large_num = large->num;
+        stats->large_free = __atomic_load_n(&large->num_free, __ATOMIC_RELAXED);
+        stats->large_min_free = large->min_free;
+        stats->drops = emac->rx_drops;
+        break;
+    }
+    case ENC28J60_CMD_G_RX_ALLOC_STATS: {
+        MAC_CHECK(data, "can't set rx alloc stats to null", out, ESP_ERR_INVALID_ARG);
+        eth_enc28j60_rx_alloc_stats_t *stats = (eth_enc28j60_rx_alloc_stats_t *)data;
+        portENTER_CRITICAL(&emac->stats_mux);
+        *stats = emac->rx_alloc_stats;
+        stats->drops = emac->rx_drops;
+        portEXIT_CRITICAL(&emac->stats_mux);
+        stats->dma_free = heap_caps_get_free_size(MALLOC_CAP_DMA);
+        stats->dma_min_free = heap_caps_get_minimum_free_size(MALLOC_CAP_DMA);
+        break;
+    }
+    case ENC28J60_CMD_S_PARTITION:
+        MAC_CHECK(data, "can't set rx buffer size to null", out, ESP_ERR_INVALID_ARG);
+        ret = enc28j60_set_partition(emac, *(uint32_t *)data);
+        break;
+    case ENC28J60_CMD_G_BUF_USAGE: {
+        MAC_CHECK(data, "can't set buffer usage to null", out, ESP_ERR_INVALID_ARG);
+        eth_enc28j60_buf_usage_t *usage = (eth_enc28j60_buf_usage_t *)data;
+        usage->rx_size = emac->rx_end - ENC28J60_BUF_RX_START + 1;
+        usage->tx_size = ENC28J60_BUF_TX_END - emac->tx_start + 1;
+        MAC_CHECK(enc28j60_rx_occupancy(emac, &usage->rx_occupancy) == ESP_OK, "read rx occupancy failed", out, ESP_FAIL);
+        usage->rx_occupancy_hwm = emac->rx_occupancy_hwm;
+        break;
+    }
+    case ENC28J60_CMD_RESET_BUF_USAGE:
+        emac->rx_occupancy_hwm = 0;
+        break;
+    case ENC28J60_CMD_G_LOCK_STATS:
+        MAC_CHECK(data, "can't set lock stats to null", out, ESP_ERR_INVALID_ARG);
+        portENTER_CRITICAL(&emac->stats_mux);
+        *(eth_enc28j60_lock_stats_t *)data = emac->lock_stats;
+        portEXIT_CRITICAL(&emac->stats_mux);
+        break;
+    case ENC28J60_CMD_RESET_LOCK_STATS:
+        portENTER_CRITICAL(&emac->stats_mux);
+        memset(&emac->lock_stats, 0, sizeof(emac->lock_stats));
+        portEXIT_CRITICAL(&emac->stats_mux);
+        break;
+    case ENC28J60_CMD_S_LINK_HANDLER:
+        MAC_CHECK(data, "can't set link handler to null", out, ESP_ERR_INVALID_ARG);
+        emac->link_handler = *(eth_enc28j60_link_handler_t *)data;
+        break;
+    case ENC28J60_CMD_G_IRQ_STATS:
+        MAC_CHECK(data, "can't set irq stats to null", out, ESP_ERR_INVALID_ARG);
+        portENTER_CRITICAL(&emac->stats_mux);
+        *(eth_enc28j60_irq_stats_t *)data = emac->irq_stats;
+        portEXIT_CRITICAL(&emac->stats_mux);
+        break;
+    case ENC28J60_CMD_G_NAPI_STATS:
+        MAC_CHECK(data, "can't set napi stats to null", out, ESP_ERR_INVALID_ARG);
+        portENTER_CRITICAL(&emac->stats_mux);
+        *(eth_enc28j60_napi_stats_t *)data = emac->napi_stats;
+        portEXIT_CRITICAL(&emac->stats_mux);
+        break;
+    case ENC28J60_CMD_S_RX_FILTER:
+        MAC_CHECK(data, "can't set rx filter to null", out, ESP_ERR_INVALID_ARG);
+        MAC_CHECK(enc28j60_set_rx_filter(emac, *(uint8_t *)data) == ESP_OK, "set rx filter failed", out, ESP_FAIL);
+        break;
+    case ENC28J60_CMD_G_RX_FILTER:
+        MAC_CHECK(data, "can't set rx filter to null", out, ESP_ERR_INVALID_ARG);
+        *(uint8_t *)data = emac->rx_filter;
+        break;
+    case ENC28J60_CMD_S_PATTERN:
+        MAC_CHECK(data, "can't set pattern to null", out, ESP_ERR_INVALID_ARG);
+        ret = enc28j60_set_pattern(emac, (eth_enc28j60_pattern_t *)data);
+        break;
+    case ENC28J60_CMD_ADD_MAC_FILTER:
+        MAC_CHECK(data, "can't set mac address to null", out, ESP_ERR_INVALID_ARG);
+        ret = enc28j60_hash_update(emac, (uint8_t *)data, true);
+        break;
+    case ENC28J60_CMD_DEL_MAC_FILTER:
+        MAC_CHECK(data, "can't set mac address to null", out, ESP_ERR_INVALID_ARG);
+        ret = enc28j60_hash_update(emac, (uint8_t *)data, false);
+        break;
+    case ENC28J60_CMD_G_CSUM_STATS:
+        MAC_CHECK(data, "can't set checksum stats to null", out, ESP_ERR_INVALID_ARG);
+        portENTER_CRITICAL(&emac->stats_mux);
+        *(eth_enc28j60_csum_stats_t *)data = emac->csum_stats;
+        portEXIT_CRITICAL(&emac->stats_mux);
+        break;
+    case ENC28J60_CMD_RESET_CSUM_STATS:
+        portENTER_CRITICAL(&emac->stats_mux);
+        memset(&emac->csum_stats, 0, sizeof(emac->csum_stats));
+        portEXIT_CRITICAL(&emac->stats_mux);
+        break;
+    case ENC28J60_CMD_CSUM_BENCH:
+        MAC_CHECK(data, "can't set checksum benchmark to null", out, ESP_ERR_INVALID_ARG);
+        /* the benchmark runs the DMA over the transmit buffer, keep transmitters out */
+        xSemaphoreTake(emac->tx_lock, portMAX_DELAY);
+        if (emac->tx_ring.count) {
+            ret = ESP_ERR_INVALID_STATE;
+        } else if ((ret = enc28j60_frame_begin(emac)) == ESP_OK) {
+            ret = enc28j60_csum_bench(emac, (eth_enc28j60_csum_bench_t *)data);
+            enc28j60_frame_end(emac);
+        }
+        xSemaphoreGive(emac->tx_lock);
+        break;
+    case ENC28J60_CMD_SPI_CALIBRATE:
+        MAC_CHECK(data, "can't set SPI clock to null", out, ESP_ERR_INVALID_ARG);
+        /* the loopback uses the transmit buffer, keep transmitters out */
+        xSemaphoreTake(emac->tx_lock, portMAX_DELAY);
+        if (emac->tx_ring.count) {
+            ret = ESP_ERR_INVALID_STATE;
+        } else {
+            ret = enc28j60_spi_calibrate(emac, (uint32_t *)data);
+        }
+        xSemaphoreGive(emac->tx_lock);
+        break;
+    case ENC28J60_CMD_S_SPI_CLOCK:
+        MAC_CHECK(data, "can't set SPI clock to null", out, ESP_ERR_INVALID_ARG);
+        xSemaphoreTake(emac->tx_lock, portMAX_DELAY);
+        uint32_t old_hz = emac->spi_devcfg.clock_speed_hz;
+        if (emac->tx_ring.count) {
+            ret = ESP_ERR_INVALID_STATE;
+        } else if ((ret = enc28j60_spi_set_clock(emac, *(uint32_t *)data)) == ESP_OK &&
+                   (ret = enc28j60_spi_verify(emac, ENC28J60_SPI_CALIB_ROUNDS)) != ESP_OK) {
+            ESP_LOGE(TAG, "memory loopback fails at %d Hz, back to %d Hz", *(uint32_t *)data, old_hz);
+            enc28j60_spi_set_clock(emac, old_hz);
+        }
+        xSemaphoreGive(emac->tx_lock);
+        break;
+    case ENC28J60_CMD_G_SPI_CLOCK:
+        MAC_CHECK(data, "can't set SPI clock to null", out, ESP_ERR_INVALID_ARG);
+        ((eth_enc28j60_spi_clock_t *)data)->clock_hz = emac->spi_devcfg.clock_speed_hz;
+        ((eth_enc28j60_spi_clock_t *)data)->min_clock_hz = emac->spi_clock_min_hz;
+        ((eth_enc28j60_spi_clock_t *)data)->fallbacks = emac->spi_fallbacks;
+        break;
+    case ENC28J60_CMD_S_RX_HOOK:
+        MAC_CHECK(data, "can't set rx hook to null", out, ESP_ERR_INVALID_ARG);
+        emac->rx_hook = *(eth_enc28j60_rx_hook_t *)data;
+        break;
+    case ENC28J60_CMD_G_RX_PERF:
+        MAC_CHECK(data, "can't set rx perf to null", out, ESP_ERR_INVALID_ARG);
+        portENTER_CRITICAL(&emac->stats_mux);
+        *(eth_enc28j60_rx_perf_t *)data = emac->rx_perf;
+        portEXIT_CRITICAL(&emac->stats_mux);
+        break;
+    case ENC28J60_CMD_RESET_RX_PERF:
+        portENTER_CRITICAL(&emac->stats_mux);
+        memset(&emac->rx_perf, 0, sizeof(emac->rx_perf));
+        emac->rx_perf.mode = emac->rx_mode;
+        portEXIT_CRITICAL(&emac->stats_mux);
+        break;
+    case ENC28J60_CMD_S_SPI_TRACE:
+        MAC_CHECK(data, "can't set SPI trace state to null", out, ESP_ERR_INVALID_ARG);
+        MAC_CHECK(emac->trace.entries, "SPI trace is disabled", out, ESP_ERR_INVALID_STATE);
+        emac->trace.enabled = *(bool *)data;
+        break;
+    case ENC28J60_CMD_G_SPI_TRACE:
+        MAC_CHECK(data, "can't set SPI trace dump to null", out, ESP_ERR_INVALID_ARG);
+        ret = enc28j60_trace_dump(emac, (eth_enc28j60_trace_dump_t *)data);
+        break;
+    case ENC28J60_CMD_G_RX_LATENCY:
+        MAC_CHECK(data, "can't set rx latency to null", out, ESP_ERR_INVALID_ARG);
+        portENTER_CRITICAL(&emac->stats_mux);
+        *(eth_enc28j60_rx_latency_t *)data = emac->rx_lat.stats;
+        portEXIT_CRITICAL(&emac->stats_mux);
+        break;
+    case ENC28J60_CMD_RESET_RX_LATENCY:
+        portENTER_CRITICAL(&emac->stats_mux);
+        memset(&emac->rx_lat.stats, 0, sizeof(emac->rx_lat.stats));
+        portEXIT_CRITICAL(&emac->stats_mux);
+        break;
+    case ENC28J60_CMD_G_STATS:
+        MAC_CHECK(data, "can't set stats to null", out, ESP_ERR_INVALID_ARG);
+        enc28j60_stats_read(emac, (eth_enc28j60_stats_t *)data, false);
+        break;
+    case ENC28J60_CMD_RESET_STATS:
+        enc28j60_stats_read(emac, (eth_enc28j60_stats_t *)data, true);
+        break;
+    case ENC28J60_CMD_G_TX_STATUS:
+        MAC_CHECK(data, "can't set tx status to null", out, ESP_ERR_INVALID_ARG);
+        portENTER_CRITICAL(&emac->stats_mux);
+        *(eth_enc28j60_tx_status_t *)data = emac->tx_status;
+        portEXIT_CRITICAL(&emac->stats_mux);
+        break;
+    case ENC28J60_CMD_RESET_TX_STATUS:
+        portENTER_CRITICAL(&emac->stats_mux);
+        memset(&emac->tx_status, 0, sizeof(emac->tx_status));
+        portEXIT_CRITICAL(&emac->stats_mux);
+        break;
+    case ENC28J60_CMD_DUPLEX_TEST:
+        MAC_CHECK(data, "can't set duplex test result to null", out, ESP_ERR_INVALID_ARG);
+        ret = enc28j60_duplex_test(emac, (eth_enc28j60_duplex_test_t *)data);
+        break;
+    default:
+        MAC_CHECK(false, "unknown io command: %d", out, ESP_ERR_INVALID_ARG, cmd);
+        break;
+    }
+out:
+    return ret;
+}
+
 esp_eth_mac_t *esp_eth_mac_new_enc28j60(const eth_enc28j60_config_t *enc28j60_config, const eth_mac_config_t *mac_config)
 {
     esp_eth_mac_t *ret = NULL;
@@ -893,14 +3659,50 @@ esp_eth_mac_t *esp_eth_mac_new_enc28j60(const eth_enc28j60_config_t *enc28j60_co
     MAC_CHECK(mac_config, "can't set mac config to null", err, NULL);
     emac = calloc(1, sizeof(emac_enc28j60_t));
     MAC_CHECK(emac, "calloc emac failed", err, NULL);
+    emac->stats_mux = (portMUX_TYPE)portMUX_INITIALIZER_UNLOCKED;
     /* enc28j60 driver is interrupt driven */
     MAC_CHECK(enc28j60_config->int_gpio_num >= 0, "error interrupt gpio number", err, NULL);
     emac->last_bank = 0xFF;
     emac->next_packet_ptr = ENC28J60_BUF_RX_START;
+    uint32_t rx_size = enc28j60_config->rx_buf_size ? enc28j60_config->rx_buf_size : ENC28J60_BUF_RX_SIZE_DEFAULT;
+    MAC_CHECK(enc28j60_partition_valid(rx_size), "invalid rx buffer size: %d", err, NULL, rx_size);
+    emac->rx_end = ENC28J60_BUF_RX_START + rx_size - 1;
+    emac->tx_start = ENC28J60_BUF_RX_START + rx_size;
     /* bind methods and attributes */
     emac->sw_reset_timeout_ms = mac_config->sw_reset_timeout_ms;
     emac->int_gpio_num = enc28j60_config->int_gpio_num;
     emac->spi_hdl = enc28j60_config->spi_hdl;
+    emac->spi_host_id = enc28j60_config->spi_host_id < ENC28J60_SPI_HOST_NUM ? enc28j60_config->spi_host_id : -1;
+    if (enc28j60_config->spi_devcfg) {
+        emac->spi_devcfg = *enc28j60_config->spi_devcfg;
+        emac->spi_clock_min_hz = emac->spi_devcfg.clock_speed_hz;
+    }
+    emac->spi_dma_threshold = enc28j60_config->spi_dma_threshold;
+    emac->rx_batch_max = enc28j60_config->rx_batch_max ? enc28j60_config->rx_batch_max : 1;
+    emac->napi_threshold = enc28j60_config->napi_threshold;
+    emac->napi_budget = enc28j60_config->napi_budget;
+    emac->napi_window_us = enc28j60_config->napi_window_us;
+    emac->netif = enc28j60_config->netif;
+    emac->rx_mode = enc28j60_config->rx_mode;
+    emac->rx_perf.mode = enc28j60_config->rx_mode;
+    emac->csum_offload = enc28j60_config->csum_offload;
+    if (enc28j60_config->spi_trace_depth) {
+        emac->trace.entries = calloc(enc28j60_config->spi_trace_depth, sizeof(eth_enc28j60_trace_entry_t));
+        MAC_CHECK(emac->trace.entries, "calloc SPI trace failed", err, NULL);
+        emac->trace.depth = enc28j60_config->spi_trace_depth;
+        emac->trace.enabled = true;
+    }
+    emac->rx_lat.enabled = enc28j60_config->rx_latency;
+    emac->tx_status_capture = enc28j60_config->tx_status;
+    emac->tx_wait_ms = enc28j60_config->tx_wait_ms;
+    emac->tx_latecol_retries = enc28j60_config->tx_latecol_retries < ENC28J60_TX_RETRANSMIT_MAX ?
+                               enc28j60_config->tx_latecol_retries : ENC28J60_TX_RETRANSMIT_MAX;
+    if (emac->rx_mode == ENC28J60_RX_MODE_POOL) {
+        MAC_CHECK(enc28j60_rx_pool_init(&emac->rx_pool[ENC28J60_RX_POOL_SMALL], enc28j60_config->rx_pool_small_num,
+                                         ENC28J60_RX_POOL_SMALL_SIZE) == ESP_OK, "create small rx pool failed", err, NULL);
+        MAC_CHECK(enc28j60_rx_pool_init(&emac->rx_pool[ENC28J60_RX_POOL_LARGE], enc28j60_config->rx_pool_large_num,
+                                         ENC28J60_RX_POOL_LARGE_SIZE) == ESP_OK, "create large rx pool failed", err, NULL);
+    }
     emac->parent.set_mediator = emac_enc28j60_set_mediator;
     emac->parent.init = emac_enc28j60_init;
     emac->parent.deinit = emac_enc28j60_deinit;
@@ -920,12 +3722,22 @@ esp_eth_mac_t *esp_eth_mac_new_enc28j60(const eth_enc28j60_config_t *enc28j60_co
     /* create mutex */
     emac->spi_lock = xSemaphoreCreateMutex();
     MAC_CHECK(emac->spi_lock, "create lock failed", err, NULL);
+    emac->bus_turn = xSemaphoreCreateBinary();
+    MAC_CHECK(emac->bus_turn, "create bus semaphore failed", err, NULL);
+    emac->tx_lock = xSemaphoreCreateMutex();
+    MAC_CHECK(emac->tx_lock, "create tx lock failed", err, NULL);
+    emac->tx_sem = xSemaphoreCreateCounting(ENC28J60_TX_RING_SLOTS, 0);
+    MAC_CHECK(emac->tx_sem, "create tx semaphore failed", err, NULL);
+    emac->tx_ring.wr_addr = emac->tx_start;
     /* create enc28j60 task */
     BaseType_t core_num = tskNO_AFFINITY;
     if (mac_config->flags & ETH_MAC_FLAG_PIN_TO_CORE) {
         core_num = cpu_hal_get_core_id();
     }
-    BaseType_t xReturned = xTaskCreatePinnedToCore(emac_enc28j60_task, "enc28j60_tsk", mac_config->rx_task_stack_size, emac,
+    /* one task per controller, numbered in creation order */
+    char task_name[configMAX_TASK_NAME_LEN];
+    snprintf(task_name, sizeof(task_name), "enc28j60_tsk%d", __atomic_fetch_add(&s_enc28j60_instances, 1, __ATOMIC_RELAXED));
+    BaseType_t xReturned = xTaskCreatePinnedToCore(emac_enc28j60_task, task_name, mac_config->rx_task_stack_size, emac,
                            mac_config->rx_task_prio, &emac->rx_task_hdl, core_num);
     MAC_CHECK(xReturned == pdPASS, "create enc28j60 task failed", err, NULL);
 
@@ -938,6 +3750,19 @@ err:
         if (emac->spi_lock) {
             vSemaphoreDelete(emac->spi_lock);
         }
+        if (emac->bus_turn) {
+            vSemaphoreDelete(emac->bus_turn);
+        }
+        if (emac->tx_lock) {
+            vSemaphoreDelete(emac->tx_lock);
+        }
+        if (emac->tx_sem) {
+            vSemaphoreDelete(emac->tx_sem);
+        }
+        for (int i = 0; i < ENC28J60_RX_POOL_CLASSES; i++) {
+            enc28j60_rx_pool_deinit(&emac->rx_pool[i]);
+        }
+        free(emac->trace.entries);
         free(emac);
     }
     return ret;
@@ -0,0 +1,658 @@
+// Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <string.h>
+#include <stdlib.h>
+#include <sys/cdefs.h>
+#include "esp_log.h"
+#include "esp_eth.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "enc28j60.h"
+
+static const char *TAG = "enc28j60_prp";
+#define MAC_CHECK(a, str, goto_tag, ret_value, ...)                               \
+    do                                                                            \
+    {                                                                             \
+        if (!(a))                                                                 \
+        {                                                                         \
+            ESP_LOGE(TAG, "%s(%d): " str, __FUNCTION__, __LINE__, ##__VA_ARGS__); \
+            ret = ret_value;                                                      \
+            goto goto_tag;                                                        \
+        }                                                                         \
+    } while (0)
+
+#define PRP_LAN_NUM (2)
+#define PRP_RCT_SIZE (6)         // sequence number, LAN id and LSDU size, suffix
+#define PRP_SUFFIX (0x88FB)
+#define PRP_LAN_ID(lan) (0x0A + (lan)) // LAN A: 1010b, LAN B: 1011b
+#define PRP_ADDR_HDR_LEN (12)    // destination and source address, not part of the LSDU
+#define PRP_MIN_FRAME_LEN (60)   // frames are padded to this length before the trailer is appended
+#define PRP_MAX_FRAME_LEN (ETH_MAX_PACKET_SIZE - 4 + PRP_RCT_SIZE)
+
+/**
+ * @brief Duplicate table entry, the last frame seen with this slot's hash
+ */
+typedef struct {
+    uint8_t src[6];
+    uint16_t seq;
+    uint8_t lan;
+    bool valid;
+    int64_t time_us;
+} prp_entry_t;
+
+typedef struct prp_s prp_t;
+
+/**
+ * @brief One LAN: argument of its receive hook and mediator of its MAC and PHY
+ * @note the mediator routes PHY register access to the MAC of this LAN and keeps link changes of this LAN
+ *       to itself, only the link of the pair is reported to the Ethernet driver
+ */
+typedef struct {
+    esp_eth_mediator_t mediator;
+    prp_t *prp;
+    uint8_t lan;
+    eth_link_t link;
+    eth_duplex_t duplex;
+} prp_port_t;
+
+struct prp_s {
+    esp_eth_mac_t parent;
+    esp_eth_phy_t phy;        // both PHYs, given to the Ethernet driver
+    esp_eth_mediator_t *eth;
+    esp_eth_mac_t *mac[PRP_LAN_NUM];
+    esp_eth_phy_t *lan_phy[PRP_LAN_NUM];
+    prp_port_t port[PRP_LAN_NUM];
+    SemaphoreHandle_t link_lock;
+    portMUX_TYPE table_lock; // guards the duplicate table and stats, updated by both MAC tasks and transmitting tasks
+    prp_entry_t *table;
+    uint32_t table_mask;
+    int64_t forget_us;
+    uint16_t seq;
+    SemaphoreHandle_t tx_lock;
+    uint8_t tx_buf[PRP_MAX_FRAME_LEN];
+    eth_enc28j60_prp_stats_t stats;
+};
+
+/**
+ * @brief Duplicate table slot of a frame: source address and sequence number
+ */
+static inline uint32_t prp_slot(const prp_t *prp, const uint8_t *src, uint16_t seq)
+{
+    uint32_t node = (src[3] << 16) | (src[4] << 8) | src[5];
+    return ((node * 2654435761u) ^ seq) & prp->table_mask;
+}
+
+/**
+ * @brief Check the redundancy trailer of a received frame and discard the second copy
+ * @note one table slot per (source, sequence number) hash, so this is O(1) per frame. A collision just
+ *       overwrites the slot, at worst letting a duplicate through, which the upper layers tolerate anyway
+ */
+static bool prp_rx_hook(void *arg, uint8_t *frame, uint32_t *len)
+{
+    prp_port_t *port = (prp_port_t *)arg;
+    prp_t *prp = port->prp;
+    bool accept = true;
+
+    const uint8_t *rct = frame + *len - PRP_RCT_SIZE;
+    if (*len < PRP_ADDR_HDR_LEN + 2 + PRP_RCT_SIZE || ((rct[4] << 8) | rct[5]) != PRP_SUFFIX ||
+            (((rct[2] & 0x0F) << 8) | rct[3]) != *len - PRP_ADDR_HDR_LEN) {
+        portENTER_CRITICAL(&prp->table_lock);
+        prp->stats.rx_frames[port->lan]++;
+        prp->stats.rx_untagged++;
+        portEXIT_CRITICAL(&prp->table_lock);
+        return true;
+    }
+    uint16_t seq = (rct[0] << 8) | rct[1];
+    bool wrong_lan = (rct[2] >> 4) != PRP_LAN_ID(port->lan);
+    *len -= PRP_RCT_SIZE;
+
+    const uint8_t *src = frame + 6;
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&prp->table_lock);
+    prp->stats.rx_frames[port->lan]++;
+    if (wrong_lan) {
+        prp->stats.rx_wrong_lan++;
+    }
+    prp_entry_t *entry = &prp->table[prp_slot(prp, src, seq)];
+    if (entry->valid && entry->seq == seq && entry->lan != port->lan && !memcmp(entry->src, src, 6) &&
+            now - entry->time_us < prp->forget_us) {
+        /* each frame has one duplicate at most, the slot is free again */
+        entry->valid = false;
+        accept = false;
+    } else {
+        memcpy(entry->src, src, 6);
+        entry->seq = seq;
+        entry->lan = port->lan;
+        entry->time_us = now;
+        entry->valid = true;
+    }
+    if (!accept) {
+        prp->stats.rx_duplicates++;
+    }
+    portEXIT_CRITICAL(&prp->table_lock);
+    return accept;
+}
+
+static esp_err_t prp_lan_phy_reg_read(esp_eth_mediator_t *eth, uint32_t phy_addr, uint32_t phy_reg,
+                                      uint32_t *reg_value)
+{
+    prp_port_t *port = __containerof(eth, prp_port_t, mediator);
+    esp_eth_mac_t *mac = port->prp->mac[port->lan];
+    return mac->read_phy_reg(mac, phy_addr, phy_reg, reg_value);
+}
+
+static esp_err_t prp_lan_phy_reg_write(esp_eth_mediator_t *eth, uint32_t phy_addr, uint32_t phy_reg,
+                                       uint32_t reg_value)
+{
+    prp_port_t *port = __containerof(eth, prp_port_t, mediator);
+    esp_eth_mac_t *mac = port->prp->mac[port->lan];
+    return mac->write_phy_reg(mac, phy_addr, phy_reg, reg_value);
+}
+
+static esp_err_t prp_lan_stack_input(esp_eth_mediator_t *eth, uint8_t *buffer, uint32_t length)
+{
+    prp_port_t *port = __containerof(eth, prp_port_t, mediator);
+    esp_eth_mediator_t *driver = port->prp->eth;
+    return driver->stack_input(driver, buffer, length);
+}
+
+static eth_link_t prp_link(const prp_t *prp)
+{
+    for (int i = 0; i < PRP_LAN_NUM; i++) {
+        if (prp->port[i].link == ETH_LINK_UP) {
+            return ETH_LINK_UP;
+        }
+    }
+    return ETH_LINK_DOWN;
+}
+
+/**
+ * @brief Start or stop the MAC of one LAN on its own link, the pair is up while either LAN is up
+ */
+static esp_err_t prp_lan_set_link(prp_port_t *port, eth_link_t link)
+{
+    esp_err_t ret = ESP_OK;
+    prp_t *prp = port->prp;
+    esp_eth_mac_t *mac = prp->mac[port->lan];
+    esp_eth_mediator_t *driver = prp->eth;
+
+    xSemaphoreTake(prp->link_lock, portMAX_DELAY);
+    eth_link_t pair_link = prp_link(prp);
+    if (port->link != link) {
+        ESP_LOGI(TAG, "LAN %c link %s", 'A' + port->lan, link == ETH_LINK_UP ? "up" : "down");
+    }
+    port->link = link;
+    if (mac->set_link(mac, link) != ESP_OK) {
+        ESP_LOGE(TAG, "set link of LAN %c failed", 'A' + port->lan);
+        ret = ESP_FAIL;
+    }
+    if (prp_link(prp) != pair_link) {
+        if (link == ETH_LINK_UP) {
+            /* the pair reports the speed and duplex of the LAN that brought it up */
+            driver->on_state_changed(driver, ETH_STATE_SPEED, (void *)ETH_SPEED_10M);
+            driver->on_state_changed(driver, ETH_STATE_DUPLEX, (void *)port->duplex);
+        }
+        if (driver->on_state_changed(driver, ETH_STATE_LINK, (void *)prp_link(prp)) != ESP_OK) {
+            ret = ESP_FAIL;
+        }
+    }
+    xSemaphoreGive(prp->link_lock);
+    return ret;
+}
+
+static esp_err_t prp_lan_on_state_changed(esp_eth_mediator_t *eth, esp_eth_state_t state, void *args)
+{
+    prp_port_t *port = __containerof(eth, prp_port_t, mediator);
+    esp_eth_mac_t *mac = port->prp->mac[port->lan];
+    esp_eth_mediator_t *driver = port->prp->eth;
+
+    switch (state) {
+    case ETH_STATE_LINK:
+        return prp_lan_set_link(port, (eth_link_t)args);
+    case ETH_STATE_SPEED:
+        return mac->set_speed(mac, (eth_speed_t)args);
+    case ETH_STATE_DUPLEX:
+        port->duplex = (eth_duplex_t)args;
+        return mac->set_duplex(mac, (eth_duplex_t)args);
+    default:
+        return driver->on_state_changed(driver, state, args);
+    }
+}
+
+static esp_err_t prp_set_mediator(esp_eth_mac_t *mac, esp_eth_mediator_t *eth)
+{
+    esp_err_t ret = ESP_OK;
+    MAC_CHECK(eth, "can't set mac's mediator to null", out, ESP_ERR_INVALID_ARG);
+    prp_t *prp = __containerof(mac, prp_t, parent);
+    prp->eth = eth;
+    /* each MAC talks to the mediator of its LAN, which passes frames on to the driver's */
+    for (int i = 0; i < PRP_LAN_NUM; i++) {
+        MAC_CHECK(prp->mac[i]->set_mediator(prp->mac[i], &prp->port[i].mediator) == ESP_OK,
+                  "set mediator of LAN %c failed", out, ESP_FAIL, 'A' + i);
+    }
+out:
+    return ret;
+}
+
+static esp_err_t prp_init(esp_eth_mac_t *mac)
+{
+    esp_err_t ret = ESP_OK;
+    prp_t *prp = __containerof(mac, prp_t, parent);
+    MAC_CHECK(prp->mac[0]->init(prp->mac[0]) == ESP_OK, "init LAN A failed", out, ESP_FAIL);
+    if (prp->mac[1]->init(prp->mac[1]) != ESP_OK) {
+        prp->mac[0]->deinit(prp->mac[0]);
+        MAC_CHECK(false, "init LAN B failed", out, ESP_FAIL);
+    }
+out:
+    return ret;
+}
+
+static esp_err_t prp_deinit(esp_eth_mac_t *mac)
+{
+    prp_t *prp = __containerof(mac, prp_t, parent);
+    prp->mac[1]->deinit(prp->mac[1]);
+    prp->mac[0]->deinit(prp->mac[0]);
+    return ESP_OK;
+}
+
+/**
+ * @brief Start the MACs of the LANs with link, the others start on their own link up
+ */
+static esp_err_t prp_start(esp_eth_mac_t *mac)
+{
+    esp_err_t ret = ESP_OK;
+    prp_t *prp = __containerof(mac, prp_t, parent);
+    portENTER_CRITICAL(&prp->table_lock);
+    memset(prp->table, 0, (prp->table_mask + 1) * sizeof(prp_entry_t));
+    portEXIT_CRITICAL(&prp->table_lock);
+    for (int i = 0; i < PRP_LAN_NUM; i++) {
+        if (prp->port[i].link == ETH_LINK_UP) {
+            MAC_CHECK(prp->mac[i]->start(prp->mac[i]) == ESP_OK, "start LAN %c failed", out, ESP_FAIL, 'A' + i);
+        }
+    }
+out:
+    return ret;
+}
+
+static esp_err_t prp_stop(esp_eth_mac_t *mac)
+{
+    esp_err_t ret = ESP_OK;
+    prp_t *prp = __containerof(mac, prp_t, parent);
+    for (int i = 0; i < PRP_LAN_NUM; i++) {
+        if (prp->mac[i]->stop(prp->mac[i]) != ESP_OK) {
+            ESP_LOGE(TAG, "stop LAN %c failed", 'A' + i);
+            ret = ESP_FAIL;
+        }
+    }
+    return ret;
+}
+
+/**
+ * @brief Send the frame on both LANs, each copy with its own LAN id in the trailer
+ * @note short frames are padded before the trailer, so the controller doesn't pad behind it. A LAN without link
+ *       is skipped: its MAC is stopped, so its transmit ring would never drain and block every frame
+ */
+static esp_err_t prp_transmit(esp_eth_mac_t *mac, uint8_t *buf, uint32_t length)
+{
+    esp_err_t ret = ESP_OK;
+    prp_t *prp = __containerof(mac, prp_t, parent);
+    bool sent = false;
+
+    MAC_CHECK(length > PRP_ADDR_HDR_LEN && length + PRP_RCT_SIZE <= PRP_MAX_FRAME_LEN, "invalid frame length: %d", out,
+              ESP_ERR_INVALID_ARG, length);
+    xSemaphoreTake(prp->tx_lock, portMAX_DELAY);
+    memcpy(prp->tx_buf, buf, length);
+    if (length < PRP_MIN_FRAME_LEN) {
+        memset(prp->tx_buf + length, 0, PRP_MIN_FRAME_LEN - length);
+        length = PRP_MIN_FRAME_LEN;
+    }
+    uint16_t seq = prp->seq++;
+    uint32_t lsdu_size = length + PRP_RCT_SIZE - PRP_ADDR_HDR_LEN;
+    uint8_t *rct = prp->tx_buf + length;
+    rct[0] = seq >> 8;
+    rct[1] = seq & 0xFF;
+    rct[3] = lsdu_size & 0xFF;
+    rct[4] = PRP_SUFFIX >> 8;
+    rct[5] = PRP_SUFFIX & 0xFF;
+    uint32_t errors[PRP_LAN_NUM] = {0};
+    uint32_t no_link[PRP_LAN_NUM] = {0};
+    for (int i = 0; i < PRP_LAN_NUM; i++) {
+        if (prp->port[i].link != ETH_LINK_UP) {
+            no_link[i]++;
+            continue;
+        }
+        rct[2] = (PRP_LAN_ID(i) << 4) | ((lsdu_size >> 8) & 0x0F);
+        if (prp->mac[i]->transmit(prp->mac[i], prp->tx_buf, length + PRP_RCT_SIZE) == ESP_OK) {
+            sent = true;
+        } else {
+            errors[i]++;
+        }
+    }
+    portENTER_CRITICAL(&prp->table_lock);
+    prp->stats.tx_frames++;
+    for (int i = 0; i < PRP_LAN_NUM; i++) {
+        prp->stats.tx_errors[i] += errors[i];
+        prp->stats.tx_no_link[i] += no_link[i];
+    }
+    portEXIT_CRITICAL(&prp->table_lock);
+    xSemaphoreGive(prp->tx_lock);
+    /* one LAN is enough, that is the point of redundancy */
+    MAC_CHECK(sent, "transmit failed on both LANs", out, ESP_FAIL);
+out:
+    return ret;
+}
+
+static esp_err_t prp_receive(esp_eth_mac_t *mac, uint8_t *buf, uint32_t *length)
+{
+    /* frames are passed on by the tasks of the two MACs */
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+/**
+ * @brief PHY registers of LAN A, the PHY of each LAN reaches its own through the mediator of its LAN
+ */
+static esp_err_t prp_read_phy_reg(esp_eth_mac_t *mac, uint32_t phy_addr, uint32_t phy_reg, uint32_t *reg_value)
+{
+    prp_t *prp = __containerof(mac, prp_t, parent);
+    return prp->mac[0]->read_phy_reg(prp->mac[0], phy_addr, phy_reg, reg_value);
+}
+
+static esp_err_t prp_write_phy_reg(esp_eth_mac_t *mac, uint32_t phy_addr, uint32_t phy_reg, uint32_t reg_value)
+{
+    prp_t *prp = __containerof(mac, prp_t, parent);
+    return prp->mac[0]->write_phy_reg(prp->mac[0], phy_addr, phy_reg, reg_value);
+}
+
+/**
+ * @brief Both LANs use the same MAC address
+ */
+static esp_err_t prp_set_addr(esp_eth_mac_t *mac, uint8_t *addr)
+{
+    esp_err_t ret = ESP_OK;
+    prp_t *prp = __containerof(mac, prp_t, parent);
+    for (int i = 0; i < PRP_LAN_NUM; i++) {
+        MAC_CHECK(prp->mac[i]->set_addr(prp->mac[i], addr) == ESP_OK, "set address of LAN %c failed", out,
+                  ESP_FAIL, 'A' + i);
+    }
+out:
+    return ret;
+}
+
+static esp_err_t prp_get_addr(esp_eth_mac_t *mac, uint8_t *addr)
+{
+    prp_t *prp = __containerof(mac, prp_t, parent);
+    return prp->mac[0]->get_addr(prp->mac[0], addr);
+}
+
+/**
+ * @brief Speed, duplex and link of the pair as reported to the Ethernet driver, nothing to do:
+ *        the MAC of each LAN already follows its own PHY
+ */
+static esp_err_t prp_set_speed(esp_eth_mac_t *mac, eth_speed_t speed)
+{
+    return ESP_OK;
+}
+
+static esp_err_t prp_set_duplex(esp_eth_mac_t *mac, eth_duplex_t duplex)
+{
+    return ESP_OK;
+}
+
+static esp_err_t prp_set_link(esp_eth_mac_t *mac, eth_link_t link)
+{
+    return ESP_OK;
+}
+
+static esp_err_t prp_set_promiscuous(esp_eth_mac_t *mac, bool enable)
+{
+    prp_t *prp = __containerof(mac, prp_t, parent);
+    esp_err_t ret = prp->mac[0]->set_promiscuous(prp->mac[0], enable);
+    esp_err_t ret_b = prp->mac[1]->set_promiscuous(prp->mac[1], enable);
+    return ret == ESP_OK ? ret_b : ret;
+}
+
+static esp_err_t prp_phy_set_mediator(esp_eth_phy_t *phy, esp_eth_mediator_t *eth)
+{
+    esp_err_t ret = ESP_OK;
+    MAC_CHECK(eth, "can't set phy's mediator to null", out, ESP_ERR_INVALID_ARG);
+    prp_t *prp = __containerof(phy, prp_t, phy);
+    for (int i = 0; i < PRP_LAN_NUM; i++) {
+        MAC_CHECK(prp->lan_phy[i]->set_mediator(prp->lan_phy[i], &prp->port[i].mediator) == ESP_OK,
+                  "set mediator of LAN %c PHY failed", out, ESP_FAIL, 'A' + i);
+    }
+out:
+    return ret;
+}
+
+/**
+ * @brief Reset both PHYs, the links are reported again afterwards
+ */
+static esp_err_t prp_phy_reset(esp_eth_phy_t *phy)
+{
+    esp_err_t ret = ESP_OK;
+    prp_t *prp = __containerof(phy, prp_t, phy);
+    for (int i = 0; i < PRP_LAN_NUM; i++) {
+        MAC_CHECK(prp->lan_phy[i]->reset(prp->lan_phy[i]) == ESP_OK, "reset LAN %c PHY failed", out,
+                  ESP_FAIL, 'A' + i);
+    }
+out:
+    return ret;
+}
+
+static esp_err_t prp_phy_reset_hw(esp_eth_phy_t *phy)
+{
+    prp_t *prp = __containerof(phy, prp_t, phy);
+    esp_err_t ret = prp->lan_phy[0]->reset_hw(prp->lan_phy[0]);
+    esp_err_t ret_b = prp->lan_phy[1]->reset_hw(prp->lan_phy[1]);
+    return ret == ESP_OK ? ret_b : ret;
+}
+
+static esp_err_t prp_phy_init(esp_eth_phy_t *phy)
+{
+    esp_err_t ret = ESP_OK;
+    prp_t *prp = __containerof(phy, prp_t, phy);
+    MAC_CHECK(prp->lan_phy[0]->init(prp->lan_phy[0]) == ESP_OK, "init LAN A PHY failed", out, ESP_FAIL);
+    if (prp->lan_phy[1]->init(prp->lan_phy[1]) != ESP_OK) {
+        prp->lan_phy[0]->deinit(prp->lan_phy[0]);
+        MAC_CHECK(false, "init LAN B PHY failed", out, ESP_FAIL);
+    }
+out:
+    return ret;
+}
+
+static esp_err_t prp_phy_deinit(esp_eth_phy_t *phy)
+{
+    prp_t *prp = __containerof(phy, prp_t, phy);
+    esp_err_t ret = prp->lan_phy[1]->deinit(prp->lan_phy[1]);
+    esp_err_t ret_a = prp->lan_phy[0]->deinit(prp->lan_phy[0]);
+    return ret == ESP_OK ? ret_a : ret;
+}
+
+static esp_err_t prp_phy_negotiate(esp_eth_phy_t *phy)
+{
+    prp_t *prp = __containerof(phy, prp_t, phy);
+    esp_err_t ret = prp->lan_phy[0]->negotiate(prp->lan_phy[0]);
+    esp_err_t ret_b = prp->lan_phy[1]->negotiate(prp->lan_phy[1]);
+    return ret == ESP_OK ? ret_b : ret;
+}
+
+/**
+ * @brief Periodic link check of the Ethernet driver, each PHY reports to the mediator of its LAN
+ */
+static esp_err_t prp_phy_get_link(esp_eth_phy_t *phy)
+{
+    prp_t *prp = __containerof(phy, prp_t, phy);
+    esp_err_t ret = prp->lan_phy[0]->get_link(prp->lan_phy[0]);
+    esp_err_t ret_b = prp->lan_phy[1]->get_link(prp->lan_phy[1]);
+    return ret == ESP_OK ? ret_b : ret;
+}
+
+static esp_err_t prp_phy_pwrctl(esp_eth_phy_t *phy, bool enable)
+{
+    prp_t *prp = __containerof(phy, prp_t, phy);
+    esp_err_t ret = prp->lan_phy[0]->pwrctl(prp->lan_phy[0], enable);
+    esp_err_t ret_b = prp->lan_phy[1]->pwrctl(prp->lan_phy[1], enable);
+    return ret == ESP_OK ? ret_b : ret;
+}
+
+static esp_err_t prp_phy_set_addr(esp_eth_phy_t *phy, uint32_t addr)
+{
+    prp_t *prp = __containerof(phy, prp_t, phy);
+    esp_err_t ret = prp->lan_phy[0]->set_addr(prp->lan_phy[0], addr);
+    esp_err_t ret_b = prp->lan_phy[1]->set_addr(prp->lan_phy[1], addr);
+    return ret == ESP_OK ? ret_b : ret;
+}
+
+static esp_err_t prp_phy_get_addr(esp_eth_phy_t *phy, uint32_t *addr)
+{
+    prp_t *prp = __containerof(phy, prp_t, phy);
+    return prp->lan_phy[0]->get_addr(prp->lan_phy[0], addr);
+}
+
+/**
+ * @brief The PHYs belong to the redundant MAC, they are deleted with it
+ */
+static esp_err_t prp_phy_del(esp_eth_phy_t *phy)
+{
+    return ESP_OK;
+}
+
+static esp_err_t prp_del(esp_eth_mac_t *mac)
+{
+    prp_t *prp = __containerof(mac, prp_t, parent);
+    for (int i = 0; i < PRP_LAN_NUM; i++) {
+        eth_enc28j60_rx_hook_t no_hook = {0};
+        esp_eth_mac_enc28j60_ioctl(prp->mac[i], ENC28J60_CMD_S_RX_HOOK, &no_hook);
+        prp->mac[i]->del(prp->mac[i]);
+        prp->lan_phy[i]->del(prp->lan_phy[i]);
+    }
+    vSemaphoreDelete(prp->link_lock);
+    vSemaphoreDelete(prp->tx_lock);
+    free(prp->table);
+    free(prp);
+    return ESP_OK;
+}
+
+esp_err_t esp_eth_mac_enc28j60_prp_get_stats(esp_eth_mac_t *mac, eth_enc28j60_prp_stats_t *stats)
+{
+    esp_err_t ret = ESP_OK;
+    MAC_CHECK(mac && stats, "can't set mac or stats to null", out, ESP_ERR_INVALID_ARG);
+    prp_t *prp = __containerof(mac, prp_t, parent);
+    portENTER_CRITICAL(&prp->table_lock);
+    *stats = prp->stats;
+    portEXIT_CRITICAL(&prp->table_lock);
+out:
+    return ret;
+}
+
+esp_eth_phy_t *esp_eth_mac_enc28j60_prp_get_phy(esp_eth_mac_t *mac)
+{
+    esp_eth_phy_t *ret = NULL;
+    MAC_CHECK(mac, "can't set mac to null", out, NULL);
+    prp_t *prp = __containerof(mac, prp_t, parent);
+    ret = &prp->phy;
+out:
+    return ret;
+}
+
+esp_eth_mac_t *esp_eth_mac_new_enc28j60_prp(const eth_enc28j60_prp_config_t *config)
+{
+    esp_eth_mac_t *ret = NULL;
+    prp_t *prp = NULL;
+    MAC_CHECK(config && config->mac_a && config->mac_b && config->phy_a && config->phy_b,
+              "can't set config, MACs or PHYs to null", err, NULL);
+    MAC_CHECK(config->dup_table_size >= 2, "duplicate table too small: %d", err, NULL, config->dup_table_size);
+    prp = calloc(1, sizeof(prp_t));
+    MAC_CHECK(prp, "calloc prp failed", err, NULL);
+    uint32_t size = 1;
+    while (size * 2 <= config->dup_table_size) {
+        size *= 2;
+    }
+    prp->table = calloc(size, sizeof(prp_entry_t));
+    MAC_CHECK(prp->table, "calloc duplicate table failed", err, NULL);
+    prp->table_mask = size - 1;
+    prp->forget_us = (int64_t)config->entry_forget_ms * 1000;
+    prp->table_lock = (portMUX_TYPE)portMUX_INITIALIZER_UNLOCKED;
+    prp->tx_lock = xSemaphoreCreateMutex();
+    MAC_CHECK(prp->tx_lock, "create tx lock failed", err, NULL);
+    prp->link_lock = xSemaphoreCreateMutex();
+    MAC_CHECK(prp->link_lock, "create link lock failed", err, NULL);
+    prp->mac[0] = config->mac_a;
+    prp->mac[1] = config->mac_b;
+    prp->lan_phy[0] = config->phy_a;
+    prp->lan_phy[1] = config->phy_b;
+    for (int i = 0; i < PRP_LAN_NUM; i++) {
+        prp->port[i].prp = prp;
+        prp->port[i].lan = i;
+        prp->port[i].link = ETH_LINK_DOWN;
+        prp->port[i].duplex = ETH_DUPLEX_HALF;
+        prp->port[i].mediator.phy_reg_read = prp_lan_phy_reg_read;
+        prp->port[i].mediator.phy_reg_write = prp_lan_phy_reg_write;
+        prp->port[i].mediator.stack_input = prp_lan_stack_input;
+        prp->port[i].mediator.on_state_changed = prp_lan_on_state_changed;
+        eth_enc28j60_rx_hook_t hook = {
+            .hook = prp_rx_hook,
+            .arg = &prp->port[i]
+        };
+        MAC_CHECK(esp_eth_mac_enc28j60_ioctl(prp->mac[i], ENC28J60_CMD_S_RX_HOOK, &hook) == ESP_OK,
+                  "set rx hook of LAN %c failed", err, NULL, 'A' + i);
+    }
+    prp->parent.set_mediator = prp_set_mediator;
+    prp->parent.init = prp_init;
+    prp->parent.deinit = prp_deinit;
+    prp->parent.start = prp_start;
+    prp->parent.stop = prp_stop;
+    prp->parent.del = prp_del;
+    prp->parent.write_phy_reg = prp_write_phy_reg;
+    prp->parent.read_phy_reg = prp_read_phy_reg;
+    prp->parent.set_addr = prp_set_addr;
+    prp->parent.get_addr = prp_get_addr;
+    prp->parent.set_speed = prp_set_speed;
+    prp->parent.set_duplex = prp_set_duplex;
+    prp->parent.set_link = prp_set_link;
+    prp->parent.set_promiscuous = prp_set_promiscuous;
+    prp->parent.transmit = prp_transmit;
+    prp->parent.receive = prp_receive;
+    prp->phy.set_mediator = prp_phy_set_mediator;
+    prp->phy.reset = prp_phy_reset;
+    prp->phy.reset_hw = prp_phy_reset_hw;
+    prp->phy.init = prp_phy_init;
+    prp->phy.deinit = prp_phy_deinit;
+    prp->phy.negotiate = prp_phy_negotiate;
+    prp->phy.get_link = prp_phy_get_link;
+    prp->phy.pwrctl = prp_phy_pwrctl;
+    prp->phy.set_addr = prp_phy_set_addr;
+    prp->phy.get_addr = prp_phy_get_addr;
+    prp->phy.del = prp_phy_del;
+    return &(prp->parent);
+err:
+    if (prp) {
+        for (int i = 0; i < PRP_LAN_NUM; i++) {
+            eth_enc28j60_rx_hook_t no_hook = {0};
+            if (prp->mac[i]) {
+                esp_eth_mac_enc28j60_ioctl(prp->mac[i], ENC28J60_CMD_S_RX_HOOK, &no_hook);
+            }
+        }
+        if (prp->tx_lock) {
+            vSemaphoreDelete(prp->tx_lock);
+        }
+        if (prp->link_lock) {
+            vSemaphoreDelete(prp->link_lock);
+        }
+        free(prp->table);
+        free(prp);
+    }
+    return ret;
+}
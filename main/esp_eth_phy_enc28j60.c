@@ -73,6 +73,38 @@ typedef union {
 } phstat2_reg_t;
 #define ETH_PHY_PHSTAT2_REG_ADDR (0x11)
 
+/**
+ * @brief PHIE(PHY Interrupt Enable Register)
+ *
+ */
+typedef union {
+    struct {
+        uint32_t reserved_0 : 1;     // Reserved
+        uint32_t pgeie : 1;          // PHY Global Interrupt Enable
+        uint32_t reserved_3_2 : 2;   // Reserved
+        uint32_t plnkie : 1;         // PHY Link Change Interrupt Enable
+        uint32_t reserved_15_5 : 11; // Reserved
+    };
+    uint32_t val;
+} phie_reg_t;
+#define ETH_PHY_PHIE_REG_ADDR (0x12)
+
+/**
+ * @brief PHIR(PHY Interrupt Request Register), flags are cleared by reading
+ *
+ */
+typedef union {
+    struct {
+        uint32_t reserved_1_0 : 2;   // Reserved
+        uint32_t pgif : 1;           // PHY Global Interrupt Flag
+        uint32_t reserved_3 : 1;     // Reserved
+        uint32_t plnkif : 1;         // PHY Link Change Interrupt Flag
+        uint32_t reserved_15_5 : 11; // Reserved
+    };
+    uint32_t val;
+} phir_reg_t;
+#define ETH_PHY_PHIR_REG_ADDR (0x13)
+
 typedef struct {
     esp_eth_phy_t parent;
     esp_eth_mediator_t *eth;
@@ -80,6 +112,10 @@ typedef struct {
     uint32_t reset_timeout_ms;
     eth_link_t link_status;
     int reset_gpio_num;
+    bool link_known;   // link_status was read from the PHY at least once since reset
+    bool link_polling; // get_link reads the link status, otherwise link changes come from the PHY interrupt
+    bool duplex_forced; // duplex is set by PHCON1.PDPXMD after each reset, otherwise it is left to the LEDB strap
+    eth_duplex_t duplex;
 } phy_enc28j60_t;
 
 static esp_err_t enc28j60_update_link_duplex_speed(phy_enc28j60_t *enc28j60)
@@ -109,6 +145,7 @@ static esp_err_t enc28j60_update_link_duplex_speed(phy_enc28j60_t *enc28j60)
                   "change link failed", err);
         enc28j60->link_status = link;
     }
+    enc28j60->link_known = true;
     return ESP_OK;
 err:
     return ESP_FAIL;
@@ -127,6 +164,11 @@ err:
 static esp_err_t enc28j60_get_link(esp_eth_phy_t *phy)
 {
     phy_enc28j60_t *enc28j60 = __containerof(phy, phy_enc28j60_t, parent);
+    /* with link interrupts, an up link is only read once, afterwards the interrupt reports changes.
+       A down link is still polled at the link check period, in case an interrupt got lost */
+    if (!enc28j60->link_polling && enc28j60->link_known && enc28j60->link_status == ETH_LINK_UP) {
+        return ESP_OK;
+    }
     /* Updata information about link, speed, duplex */
     PHY_CHECK(enc28j60_update_link_duplex_speed(enc28j60) == ESP_OK, "update link duplex speed failed", err);
     return ESP_OK;
@@ -134,10 +176,36 @@ err:
     return ESP_FAIL;
 }
 
+/**
+ * @brief Settings the PHY loses on reset: half duplex loopback off, link change interrupt on
+ */
+static esp_err_t enc28j60_setup(phy_enc28j60_t *enc28j60)
+{
+    esp_eth_mediator_t *eth = enc28j60->eth;
+    /* Disable half duplex loopback */
+    phcon2_reg_t phcon2;
+    PHY_CHECK(eth->phy_reg_read(eth, enc28j60->addr, ETH_PHY_PHCON2_REG_ADDR, &(phcon2.val)) == ESP_OK,
+              "read PHCON2 failed", err);
+    phcon2.hdldis = 1;
+    PHY_CHECK(eth->phy_reg_write(eth, enc28j60->addr, ETH_PHY_PHCON2_REG_ADDR, phcon2.val) == ESP_OK,
+              "write PHCON2 failed", err);
+    /* Enable link change interrupt, reported to the MAC through EIR.LINKIF */
+    phir_reg_t phir;
+    PHY_CHECK(eth->phy_reg_read(eth, enc28j60->addr, ETH_PHY_PHIR_REG_ADDR, &(phir.val)) == ESP_OK,
+              "read PHIR failed", err);
+    phie_reg_t phie = {.pgeie = 1, .plnkie = 1};
+    PHY_CHECK(eth->phy_reg_write(eth, enc28j60->addr, ETH_PHY_PHIE_REG_ADDR, phie.val) == ESP_OK,
+              "write PHIE failed", err);
+    return ESP_OK;
+err:
+    return ESP_FAIL;
+}
+
 static esp_err_t enc28j60_reset(esp_eth_phy_t *phy)
 {
     phy_enc28j60_t *enc28j60 = __containerof(phy, phy_enc28j60_t, parent);
     enc28j60->link_status = ETH_LINK_DOWN;
+    enc28j60->link_known = false;
     esp_eth_mediator_t *eth = enc28j60->eth;
     bmcr_reg_t bmcr = {.reset = 1};
     PHY_CHECK(eth->phy_reg_write(eth, enc28j60->addr, ETH_PHY_BMCR_REG_ADDR, bmcr.val) == ESP_OK,
@@ -153,6 +221,14 @@ static esp_err_t enc28j60_reset(esp_eth_phy_t *phy)
         }
     }
     PHY_CHECK(to < enc28j60->reset_timeout_ms / 10, "PHY reset timeout", err);
+    /* reset loads the duplex mode from the LEDB strap, restore a forced one (PDPXMD is BMCR duplex_mode) */
+    if (enc28j60->duplex_forced) {
+        bmcr.duplex_mode = enc28j60->duplex == ETH_DUPLEX_FULL;
+        PHY_CHECK(eth->phy_reg_write(eth, enc28j60->addr, ETH_PHY_BMCR_REG_ADDR, bmcr.val) == ESP_OK,
+                  "write BMCR failed", err);
+    }
+    /* reset clears the other PHY settings too */
+    PHY_CHECK(enc28j60_setup(enc28j60) == ESP_OK, "PHY setup failed", err);
     return ESP_OK;
 err:
     return ESP_FAIL;
@@ -178,7 +254,7 @@ static esp_err_t enc28j60_negotiate(esp_eth_phy_t *phy)
      * If it is connected to an automatic duplex negotiation enabled network switch,
      * ENC28J60 will be detected as a half-duplex device.
      * To communicate in Full-Duplex mode, ENC28J60 and the remote node
-     * must be manually configured for full-duplex operation.
+     * must be manually configured for full-duplex operation (see esp_eth_phy_enc28j60_set_duplex).
      */
     phy_enc28j60_t *enc28j60 = __containerof(phy, phy_enc28j60_t, parent);
     /* Updata information about link, speed, duplex */
@@ -257,13 +333,6 @@ static esp_err_t enc28j60_init(esp_eth_phy_t *phy)
               "read ID2 failed", err);
     PHY_CHECK(id1.oui_msb == 0x0083 && id2.oui_lsb == 0x05 && id2.vendor_model == 0x00,
               "wrong chip ID", err);
-    /* Disable half duplex loopback */
-    phcon2_reg_t phcon2;
-    PHY_CHECK(eth->phy_reg_read(eth, enc28j60->addr, ETH_PHY_PHCON2_REG_ADDR, &(phcon2.val)) == ESP_OK,
-              "read PHCON2 failed", err);
-    phcon2.hdldis = 1;
-    PHY_CHECK(eth->phy_reg_write(eth, enc28j60->addr, ETH_PHY_PHCON2_REG_ADDR, phcon2.val) == ESP_OK,
-              "write PHCON2 failed", err);
     return ESP_OK;
 err:
     return ESP_FAIL;
@@ -278,6 +347,38 @@ err:
     return ESP_FAIL;
 }
 
+esp_err_t esp_eth_phy_enc28j60_update_link(esp_eth_phy_t *phy)
+{
+    PHY_CHECK(phy, "can't set phy to null", err);
+    phy_enc28j60_t *enc28j60 = __containerof(phy, phy_enc28j60_t, parent);
+    PHY_CHECK(enc28j60_update_link_duplex_speed(enc28j60) == ESP_OK, "update link duplex speed failed", err);
+    return ESP_OK;
+err:
+    return ESP_FAIL;
+}
+
+esp_err_t esp_eth_phy_enc28j60_set_link_polling(esp_eth_phy_t *phy, bool enable)
+{
+    PHY_CHECK(phy, "can't set phy to null", err);
+    phy_enc28j60_t *enc28j60 = __containerof(phy, phy_enc28j60_t, parent);
+    enc28j60->link_polling = enable;
+    return ESP_OK;
+err:
+    return ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t esp_eth_phy_enc28j60_set_duplex(esp_eth_phy_t *phy, eth_duplex_t duplex)
+{
+    PHY_CHECK(phy, "can't set phy to null", err);
+    PHY_CHECK(duplex == ETH_DUPLEX_HALF || duplex == ETH_DUPLEX_FULL, "unknown duplex", err);
+    phy_enc28j60_t *enc28j60 = __containerof(phy, phy_enc28j60_t, parent);
+    enc28j60->duplex_forced = true;
+    enc28j60->duplex = duplex;
+    return ESP_OK;
+err:
+    return ESP_ERR_INVALID_ARG;
+}
+
 esp_eth_phy_t *esp_eth_phy_new_enc28j60(const eth_phy_config_t *config)
 {
     PHY_CHECK(config, "can't set phy config to null", err);
@@ -287,6 +388,7 @@ esp_eth_phy_t *esp_eth_phy_new_enc28j60(const eth_phy_config_t *config)
     enc28j60->reset_timeout_ms = config->reset_timeout_ms;
     enc28j60->reset_gpio_num = config->reset_gpio_num;
     enc28j60->link_status = ETH_LINK_DOWN;
+    enc28j60->link_polling = true;
     enc28j60->parent.reset = enc28j60_reset;
     enc28j60->parent.reset_hw = enc28j60_reset_hw;
     enc28j60->parent.init = enc28j60_init;
@@ -5,6 +5,7 @@
    CONDITIONS OF ANY KIND, either express or implied.
 */
 #include <stdio.h>
+#include <string.h>
 #include "esp_err.h"
 #include "sdkconfig.h"
 #include "esp_log.h"
@@ -152,6 +153,19 @@ void mb_setup_input_data(float Temp, float Wet, short int pressure, short int no
     input_reg_params.c4h10 = c4h10;
 }
 
+#if CONFIG_EXAMPLE_ENC28J60_RX_LATENCY
+// Publish the Ethernet receive latency histograms in the data input registers
+static void mb_setup_latency_data(void)
+{
+    uint16_t regs[sizeof(input_reg_params.data) / sizeof(uint16_t)];
+    int num = ethernet_rx_latency_regs(regs, sizeof(regs) / sizeof(regs[0]));
+    // input_reg_params is packed, data may be unaligned
+    portENTER_CRITICAL(&param_lock);
+    memcpy(input_reg_params.data, regs, num * sizeof(uint16_t));
+    portEXIT_CRITICAL(&param_lock);
+}
+#endif
+
 // Set register values into known state
 static void setup_reg_data(void)
 {
@@ -230,6 +244,8 @@ void app_main(void)
 #endif
     comm_info.ip_mode = MB_MODE_TCP;
     comm_info.ip_addr = NULL;
+    // The Modbus controller is a single instance listening on all interfaces,
+    // so it serves every Ethernet port, the netif of the first port is only used for its address info
     comm_info.ip_netif_ptr = (void *)get_netif(); //(void*)get_example_netif();
     // Setup communication parameters and start stack
     ESP_ERROR_CHECK(mbc_slave_setup((void *)&comm_info));
@@ -280,6 +296,9 @@ void app_main(void)
     for (; holding_reg_params.holding_data0 < MB_CHAN_DATA_MAX_VAL;)
     {
         mb_setup_input_data(23.4, 3.3, 4, 23, 100, i, 100, 43, 252, 1300, 32, 88.2, 1, 2, 2, 1.4, 52.2, 99.2, 32.2, 42.3, 32.1, 4.5, 32.3, 2.3);
+#if CONFIG_EXAMPLE_ENC28J60_RX_LATENCY
+        mb_setup_latency_data();
+#endif
         // Check for read/write events of Modbus master for certain events
         mb_event_group_t event = mbc_slave_check_event(MB_READ_WRITE_MASK);
         const char *rw_str = (event & MB_READ_MASK) ? "READ" : "WRITE";
@@ -0,0 +1,623 @@
+// Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdlib.h>
+#include <pthread.h>
+#include <string.h>
+#include "enc28j60.h"
+#include "enc28j60_sim.h"
+
+#define SIM_REG_NUM      (0x20)
+#define SIM_SHARED_NUM   (SIM_REG_NUM - ENC28J60_EIE)
+#define SIM_PHY_REG_NUM  (0x20)
+#define SIM_ADDR_MASK    (ENC28J60_SIM_MEM_SIZE - 1)
+#define SIM_RSV_SIZE     (6)
+#define SIM_CRC_SIZE     (4)
+#define SIM_TSV_SIZE     (7)
+#define SIM_REVID        (0x06) // silicon rev B7
+
+/* PHY registers and bits, as seen through MIREGADR */
+#define SIM_PHCON1       (0x00)
+#define SIM_PHSTAT1      (0x01)
+#define SIM_PHID1        (0x02)
+#define SIM_PHID2        (0x03)
+#define SIM_PHCON2       (0x10)
+#define SIM_PHSTAT2      (0x11)
+#define SIM_PHCON1_PRST    (1 << 15)
+#define SIM_PHCON1_PLOOPBK (1 << 14)
+#define SIM_PHCON1_PDPXMD  (1 << 8)
+#define SIM_PHSTAT1_LLSTAT (1 << 2)
+#define SIM_PHSTAT2_LSTAT  (1 << 10)
+#define SIM_PHSTAT2_DPXSTAT (1 << 9)
+
+struct enc28j60_sim_s {
+    uint8_t mem[ENC28J60_SIM_MEM_SIZE];
+    uint8_t regs[4][SIM_REG_NUM];     // per-bank registers, index 0x1B..0x1F unused
+    uint8_t shared[SIM_SHARED_NUM];  // EIE, EIR, ESTAT, ECON2, ECON1
+    uint16_t phy[SIM_PHY_REG_NUM];
+    bool link_up;
+    enc28j60_sim_tx_cb_t tx_cb;
+    void *tx_ctx;
+    enc28j60_sim_int_cb_t int_cb;
+    void *int_ctx;
+    int int_level;
+    enc28j60_sim_stats_t stats;
+    pthread_mutex_t lock; // recursive, the driver task and the test feed the model concurrently
+};
+
+/**
+ * @brief MAC and MII registers shift out a dummy byte before the value
+ */
+static bool sim_is_mac_mii(uint8_t bank, uint8_t idx)
+{
+    return (bank == 2 && idx <= 0x1A) || (bank == 3 && (idx <= 0x05 || idx == 0x0A));
+}
+
+static uint8_t *sim_reg(enc28j60_sim_t *sim, uint8_t bank, uint8_t idx)
+{
+    if (idx >= ENC28J60_EIE) {
+        return &sim->shared[idx - ENC28J60_EIE];
+    }
+    return &sim->regs[bank][idx];
+}
+
+static uint8_t *sim_reg_at(enc28j60_sim_t *sim, uint16_t reg)
+{
+    return sim_reg(sim, ENC28J60_REG_BANK(reg), ENC28J60_REG_INDEX(reg) & 0x1F);
+}
+
+static uint16_t sim_get16(enc28j60_sim_t *sim, uint16_t reg_low)
+{
+    return (*sim_reg_at(sim, reg_low) | (*sim_reg_at(sim, reg_low + 1) << 8)) & SIM_ADDR_MASK;
+}
+
+static void sim_set16(enc28j60_sim_t *sim, uint16_t reg_low, uint16_t value)
+{
+    *sim_reg_at(sim, reg_low) = value & 0xFF;
+    *sim_reg_at(sim, reg_low + 1) = (value >> 8) & 0x1F;
+}
+
+#define SIM_SHARED(sim, reg) ((sim)->shared[(reg) - ENC28J60_EIE])
+
+/**
+ * @brief Drive the INT pin and report the falling edge
+ */
+static void sim_update_int(enc28j60_sim_t *sim)
+{
+    uint8_t eie = SIM_SHARED(sim, ENC28J60_EIE);
+    uint8_t eir = SIM_SHARED(sim, ENC28J60_EIR);
+    bool asserted = (eie & EIE_INTIE) && (eie & eir & 0x7F);
+    if (asserted) {
+        SIM_SHARED(sim, ENC28J60_ESTAT) |= ESTAT_INT;
+    } else {
+        SIM_SHARED(sim, ENC28J60_ESTAT) &= ~ESTAT_INT;
+    }
+    int level = asserted ? 0 : 1;
+    if (level != sim->int_level) {
+        sim->int_level = level;
+        if (!level && sim->int_cb) {
+            sim->int_cb(sim->int_ctx);
+        }
+    }
+}
+
+/**
+ * @brief PKTIF follows EPKTCNT, it can't be cleared directly
+ */
+static void sim_update_pktif(enc28j60_sim_t *sim)
+{
+    if (*sim_reg_at(sim, ENC28J60_EPKTCNT)) {
+        SIM_SHARED(sim, ENC28J60_EIR) |= EIR_PKTIF;
+    } else {
+        SIM_SHARED(sim, ENC28J60_EIR) &= ~EIR_PKTIF;
+    }
+}
+
+static void sim_link_changed(enc28j60_sim_t *sim)
+{
+    uint16_t phie = sim->phy[ENC28J60_PHIE];
+    if ((phie & PHIE_PGEIE) && (phie & PHIE_PLNKIE)) {
+        sim->phy[ENC28J60_PHIR] |= PHIR_PLNKIF | PHIR_PGIF;
+        SIM_SHARED(sim, ENC28J60_EIR) |= EIR_LINKIF;
+    }
+}
+
+static void sim_phy_reset(enc28j60_sim_t *sim)
+{
+    memset(sim->phy, 0, sizeof(sim->phy));
+    sim->phy[SIM_PHID1] = 0x0083;
+    sim->phy[SIM_PHID2] = 0x1400;
+    sim->phy[SIM_PHSTAT1] = 0x1800 | (sim->link_up ? SIM_PHSTAT1_LLSTAT : 0);
+    sim->phy[SIM_PHSTAT2] = sim->link_up ? SIM_PHSTAT2_LSTAT : 0;
+    sim->phy[0x14] = 0x3422; // PHLCON
+}
+
+static uint16_t sim_phy_read(enc28j60_sim_t *sim, uint8_t addr)
+{
+    uint16_t value = sim->phy[addr & (SIM_PHY_REG_NUM - 1)];
+    if (addr == ENC28J60_PHIR) {
+        sim->phy[ENC28J60_PHIR] = 0;
+        SIM_SHARED(sim, ENC28J60_EIR) &= ~EIR_LINKIF;
+    } else if (addr == SIM_PHSTAT1) {
+        /* latching low link status */
+        sim->phy[SIM_PHSTAT1] |= sim->link_up ? SIM_PHSTAT1_LLSTAT : 0;
+    }
+    return value;
+}
+
+static void sim_phy_write(enc28j60_sim_t *sim, uint8_t addr, uint16_t value)
+{
+    addr &= SIM_PHY_REG_NUM - 1;
+    if (addr == SIM_PHCON1 && (value & SIM_PHCON1_PRST)) {
+        sim_phy_reset(sim);
+        return;
+    }
+    if (addr == SIM_PHSTAT1 || addr == SIM_PHSTAT2 || addr == SIM_PHID1 || addr == SIM_PHID2 ||
+            addr == ENC28J60_PHIR) {
+        return; // read only
+    }
+    sim->phy[addr] = value;
+    if (addr == SIM_PHCON1) {
+        /* the PHY reports the duplex mode it was configured for */
+        sim->phy[SIM_PHSTAT2] = (sim->phy[SIM_PHSTAT2] & ~SIM_PHSTAT2_DPXSTAT) |
+                                ((value & SIM_PHCON1_PDPXMD) ? SIM_PHSTAT2_DPXSTAT : 0);
+    }
+}
+
+/**
+ * @brief Next address after addr inside the receive ring, or the whole memory outside of it
+ */
+static uint16_t sim_rx_next(enc28j60_sim_t *sim, uint16_t addr)
+{
+    uint16_t rx_start = sim_get16(sim, ENC28J60_ERXSTL);
+    uint16_t rx_end = sim_get16(sim, ENC28J60_ERXNDL);
+    if (addr == rx_end) {
+        return rx_start;
+    }
+    return (addr + 1) & SIM_ADDR_MASK;
+}
+
+static bool sim_in_rx_ring(enc28j60_sim_t *sim, uint16_t addr)
+{
+    return addr >= sim_get16(sim, ENC28J60_ERXSTL) && addr <= sim_get16(sim, ENC28J60_ERXNDL);
+}
+
+/**
+ * @brief Run the DMA engine to completion, it copies or checksums instantly
+ */
+static void sim_dma(enc28j60_sim_t *sim)
+{
+    uint16_t addr = sim_get16(sim, ENC28J60_EDMASTL);
+    uint16_t end = sim_get16(sim, ENC28J60_EDMANDL);
+    bool wrap = sim_in_rx_ring(sim, addr);
+    uint8_t *econ1 = &SIM_SHARED(sim, ENC28J60_ECON1);
+
+    if (*econ1 & ECON1_CSUMEN) {
+        uint32_t sum = 0;
+        bool high = true;
+        for (uint32_t n = 0; n < ENC28J60_SIM_MEM_SIZE; n++) {
+            sum += high ? (sim->mem[addr] << 8) : sim->mem[addr];
+            high = !high;
+            if (addr == end) {
+                break;
+            }
+            addr = wrap ? sim_rx_next(sim, addr) : (addr + 1) & SIM_ADDR_MASK;
+        }
+        while (sum >> 16) {
+            sum = (sum & 0xFFFF) + (sum >> 16);
+        }
+        sum = ~sum & 0xFFFF;
+        *sim_reg_at(sim, ENC28J60_EDMACSL) = sum & 0xFF;
+        *sim_reg_at(sim, ENC28J60_EDMACSH) = sum >> 8;
+    } else {
+        uint16_t dst = sim_get16(sim, ENC28J60_EDMADSTL);
+        for (uint32_t n = 0; n < ENC28J60_SIM_MEM_SIZE; n++) {
+            sim->mem[dst] = sim->mem[addr];
+            if (addr == end) {
+                break;
+            }
+            addr = wrap ? sim_rx_next(sim, addr) : (addr + 1) & SIM_ADDR_MASK;
+            dst = (dst + 1) & SIM_ADDR_MASK;
+        }
+    }
+    *econ1 &= ~ECON1_DMAST;
+    SIM_SHARED(sim, ENC28J60_EIR) |= EIR_DMAIF;
+}
+
+static bool sim_receive(enc28j60_sim_t *sim, const uint8_t *frame, uint32_t len);
+
+/**
+ * @brief Send the frame between ETXST and ETXND and write the transmit status vector after it
+ * @note with PHCON1.PLOOPBK the frame goes back to the receive side instead of the wire, only in full duplex
+ */
+static void sim_transmit(enc28j60_sim_t *sim)
+{
+    uint16_t start = sim_get16(sim, ENC28J60_ETXSTL);
+    uint16_t end = sim_get16(sim, ENC28J60_ETXNDL);
+    uint32_t len = end >= start ? end - start : 0; // the per packet control byte at ETXST is not sent
+    uint8_t frame[ENC28J60_SIM_MEM_SIZE];
+
+    for (uint32_t i = 0; i < len; i++) {
+        frame[i] = sim->mem[(start + 1 + i) & SIM_ADDR_MASK];
+    }
+    if (sim->phy[SIM_PHCON1] & SIM_PHCON1_PLOOPBK) {
+        if ((sim->phy[SIM_PHCON1] & SIM_PHCON1_PDPXMD) && (*sim_reg_at(sim, ENC28J60_MACON3) & MACON3_FULDPX)) {
+            sim_receive(sim, frame, len);
+        }
+    } else if (sim->tx_cb) {
+        sim->tx_cb(sim->tx_ctx, frame, len);
+    }
+    sim->stats.tx_frames++;
+
+    uint32_t wire_len = (len < 60 ? 60 : len) + SIM_CRC_SIZE;
+    uint8_t tsv[SIM_TSV_SIZE] = {
+        wire_len & 0xFF, (wire_len >> 8) & 0xFF,
+        0x80, // transmit done, no collision
+        (frame[0] & 0x01) ? ((frame[0] == 0xFF) ? 0x02 : 0x01) : 0x00, // multicast / broadcast
+        wire_len & 0xFF, (wire_len >> 8) & 0xFF,
+        0x00
+    };
+    for (uint32_t i = 0; i < SIM_TSV_SIZE; i++) {
+        sim->mem[(end + 1 + i) & SIM_ADDR_MASK] = tsv[i];
+    }
+    SIM_SHARED(sim, ENC28J60_ECON1) &= ~ECON1_TXRTS;
+    SIM_SHARED(sim, ENC28J60_EIR) |= EIR_TXIF;
+}
+
+/**
+ * @brief Store a new register value and run its side effects
+ */
+static void sim_reg_write(enc28j60_sim_t *sim, uint8_t bank, uint8_t idx, uint8_t value)
+{
+    uint8_t *reg = sim_reg(sim, bank, idx);
+    uint8_t old = *reg;
+
+    switch (idx) {
+    case ENC28J60_ESTAT:
+        /* only BUFER and LATECOL can be cleared */
+        *reg = (old & ~(ESTAT_BUFER | ESTAT_LATECOL)) | (old & value & (ESTAT_BUFER | ESTAT_LATECOL));
+        return;
+    case ENC28J60_EIR:
+        *reg = (value & ~EIR_PKTIF) | (old & EIR_PKTIF);
+        return;
+    case ENC28J60_ECON2:
+        *reg = value & ~ECON2_PKTDEC;
+        if (value & ECON2_PKTDEC) {
+            uint8_t *cnt = sim_reg_at(sim, ENC28J60_EPKTCNT);
+            if (*cnt) {
+                (*cnt)--;
+            }
+            sim_update_pktif(sim);
+        }
+        return;
+    case ENC28J60_ECON1:
+        *reg = value;
+        if ((old ^ value) & (ECON1_BSEL1 | ECON1_BSEL0)) {
+            sim->stats.bank_switches++;
+        }
+        if (value & ECON1_RXRST) {
+            *sim_reg_at(sim, ENC28J60_EPKTCNT) = 0;
+            sim_update_pktif(sim);
+        }
+        if ((value & ECON1_TXRTS) && !(old & ECON1_TXRTS) && !(value & ECON1_TXRST)) {
+            sim_transmit(sim);
+        }
+        if ((value & ECON1_DMAST) && !(old & ECON1_DMAST)) {
+            sim_dma(sim);
+        }
+        return;
+    default:
+        break;
+    }
+
+    if (bank == 1 && idx == (ENC28J60_EPKTCNT & 0xFF)) {
+        return; // read only
+    }
+    if (bank == 3 && (idx == (ENC28J60_EREVID & 0xFF) || idx == (ENC28J60_MISTAT & 0xFF))) {
+        return; // read only
+    }
+    *reg = value;
+    if (bank == 0 && (idx == (ENC28J60_ERXSTL & 0xFF) || idx == (ENC28J60_ERXSTH & 0xFF))) {
+        /* writing ERXST moves the hardware write pointer to the start of the receive buffer */
+        sim_set16(sim, ENC28J60_ERXWRPTL, sim_get16(sim, ENC28J60_ERXSTL));
+    } else if (bank == 2 && idx == (ENC28J60_MICMD & 0xFF) && (value & MICMD_MIIRD)) {
+        uint16_t data = sim_phy_read(sim, *sim_reg_at(sim, ENC28J60_MIREGADR));
+        *sim_reg_at(sim, ENC28J60_MIRDL) = data & 0xFF;
+        *sim_reg_at(sim, ENC28J60_MIRDH) = data >> 8;
+    } else if (bank == 2 && idx == (ENC28J60_MIWRH & 0xFF)) {
+        sim_phy_write(sim, *sim_reg_at(sim, ENC28J60_MIREGADR), *sim_reg_at(sim, ENC28J60_MIWRL) | (value << 8));
+    }
+}
+
+enc28j60_sim_t *enc28j60_sim_new(enc28j60_sim_tx_cb_t tx_cb, void *tx_ctx)
+{
+    enc28j60_sim_t *sim = calloc(1, sizeof(enc28j60_sim_t));
+    if (sim) {
+        pthread_mutexattr_t attr;
+        pthread_mutexattr_init(&attr);
+        pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+        pthread_mutex_init(&sim->lock, &attr);
+        pthread_mutexattr_destroy(&attr);
+        sim->tx_cb = tx_cb;
+        sim->tx_ctx = tx_ctx;
+        enc28j60_sim_reset(sim);
+    }
+    return sim;
+}
+
+void enc28j60_sim_del(enc28j60_sim_t *sim)
+{
+    pthread_mutex_destroy(&sim->lock);
+    free(sim);
+}
+
+void enc28j60_sim_reset(enc28j60_sim_t *sim)
+{
+    pthread_mutex_lock(&sim->lock);
+    memset(sim->regs, 0, sizeof(sim->regs));
+    memset(sim->shared, 0, sizeof(sim->shared));
+    sim_set16(sim, ENC28J60_ERDPTL, 0x05FA);
+    sim_set16(sim, ENC28J60_ERXSTL, 0x05FA);
+    sim_set16(sim, ENC28J60_ERXNDL, 0x1FFF);
+    sim_set16(sim, ENC28J60_ERXRDPTL, 0x05FA);
+    sim_set16(sim, ENC28J60_ERXWRPTL, 0x0000);
+    *sim_reg_at(sim, ENC28J60_ERXFCON) = ERXFCON_UCEN | ERXFCON_CRCEN | ERXFCON_BCEN;
+    *sim_reg_at(sim, ENC28J60_MACON2) = 0x80;
+    *sim_reg_at(sim, ENC28J60_MACLCON1) = 0x0F;
+    *sim_reg_at(sim, ENC28J60_MACLCON2) = 0x37;
+    *sim_reg_at(sim, ENC28J60_MAMXFLL) = 0x00;
+    *sim_reg_at(sim, ENC28J60_MAMXFLH) = 0x06;
+    *sim_reg_at(sim, ENC28J60_EREVID) = SIM_REVID;
+    *sim_reg_at(sim, ENC28J60_ECOCON) = 0x04;
+    *sim_reg_at(sim, ENC28J60_EPAUSL) = 0x00;
+    *sim_reg_at(sim, ENC28J60_EPAUSH) = 0x10;
+    SIM_SHARED(sim, ENC28J60_ESTAT) = ESTAT_CLKRDY;
+    SIM_SHARED(sim, ENC28J60_ECON2) = ECON2_AUTOINC;
+    sim_phy_reset(sim);
+    sim->int_level = 1;
+    pthread_mutex_unlock(&sim->lock);
+}
+
+/**
+ * @brief Read or write buffer memory at ERDPT/EWRPT, with auto increment
+ */
+static void sim_buffer_access(enc28j60_sim_t *sim, bool write, const uint8_t *tx, uint8_t *rx, size_t len)
+{
+    uint16_t ptr_reg = write ? ENC28J60_EWRPTL : ENC28J60_ERDPTL;
+    uint16_t addr = sim_get16(sim, ptr_reg);
+    bool autoinc = SIM_SHARED(sim, ENC28J60_ECON2) & ECON2_AUTOINC;
+
+    for (size_t i = 0; i < len; i++) {
+        if (write) {
+            sim->mem[addr] = tx ? tx[i] : 0;
+        } else if (rx) {
+            rx[i] = sim->mem[addr];
+        }
+        if (autoinc) {
+            /* the read pointer wraps inside the receive buffer, the write pointer at the end of memory */
+            addr = write ? (addr + 1) & SIM_ADDR_MASK : sim_rx_next(sim, addr);
+        }
+    }
+    sim_set16(sim, ptr_reg, addr);
+}
+
+void enc28j60_sim_transfer(enc28j60_sim_t *sim, uint8_t cmd, uint8_t arg, const uint8_t *tx, uint8_t *rx, size_t len)
+{
+    uint8_t bank = SIM_SHARED(sim, ENC28J60_ECON1) & (ECON1_BSEL1 | ECON1_BSEL0);
+    uint8_t idx = arg & 0x1F;
+
+    pthread_mutex_lock(&sim->lock);
+    sim->stats.transactions++;
+    sim->stats.cmd[cmd & 0x07]++;
+    sim->stats.bytes += 1 + len;
+    if (rx) {
+        memset(rx, 0, len);
+    }
+
+    switch (cmd & 0x07) {
+    case ENC28J60_SPI_CMD_RCR: {
+        uint8_t value = *sim_reg(sim, bank, idx);
+        bool dummy = idx < ENC28J60_EIE && sim_is_mac_mii(bank, idx);
+        for (size_t i = 0; rx && i < len; i++) {
+            rx[i] = (dummy && i == 0) ? 0x00 : value;
+        }
+        break;
+    }
+    case ENC28J60_SPI_CMD_RBM:
+        sim_buffer_access(sim, false, NULL, rx, len);
+        break;
+    case ENC28J60_SPI_CMD_WCR:
+        if (len) {
+            sim_reg_write(sim, bank, idx, tx[len - 1]);
+        }
+        break;
+    case ENC28J60_SPI_CMD_WBM:
+        sim_buffer_access(sim, true, tx, NULL, len);
+        break;
+    case ENC28J60_SPI_CMD_BFS:
+    case ENC28J60_SPI_CMD_BFC:
+        /* bit field operations only work on ETH registers */
+        if (len && !(idx < ENC28J60_EIE && sim_is_mac_mii(bank, idx))) {
+            uint8_t value = *sim_reg(sim, bank, idx);
+            value = (cmd == ENC28J60_SPI_CMD_BFS) ? value | tx[len - 1] : value & ~tx[len - 1];
+            sim_reg_write(sim, bank, idx, value);
+        }
+        break;
+    case ENC28J60_SPI_CMD_SRC:
+        enc28j60_sim_reset(sim);
+        break;
+    default:
+        break;
+    }
+    sim_update_int(sim);
+    pthread_mutex_unlock(&sim->lock);
+}
+
+int enc28j60_sim_int_level(const enc28j60_sim_t *sim)
+{
+    return sim->int_level;
+}
+
+void enc28j60_sim_set_int_cb(enc28j60_sim_t *sim, enc28j60_sim_int_cb_t cb, void *ctx)
+{
+    sim->int_cb = cb;
+    sim->int_ctx = ctx;
+}
+
+static uint32_t sim_crc32(const uint8_t *data, uint32_t len)
+{
+    uint32_t crc = 0xFFFFFFFF;
+    for (uint32_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int b = 0; b < 8; b++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
+
+/**
+ * @brief Unicast, broadcast and multicast filters, pattern match and hash table let everything through
+ */
+static bool sim_accept(enc28j60_sim_t *sim, const uint8_t *frame)
+{
+    uint8_t erxfcon = *sim_reg_at(sim, ENC28J60_ERXFCON);
+    static const uint16_t maadr[6] = {
+        ENC28J60_MAADR1, ENC28J60_MAADR2, ENC28J60_MAADR3, ENC28J60_MAADR4, ENC28J60_MAADR5, ENC28J60_MAADR6
+    };
+    bool broadcast = true;
+    bool unicast = true;
+
+    if (!(erxfcon & ~(ERXFCON_ANDOR | ERXFCON_CRCEN))) {
+        return true; // promiscuous
+    }
+    for (int i = 0; i < 6; i++) {
+        broadcast &= frame[i] == 0xFF;
+        unicast &= frame[i] == *sim_reg_at(sim, maadr[i]);
+    }
+    if ((erxfcon & ERXFCON_BCEN) && broadcast) {
+        return true;
+    }
+    if ((erxfcon & ERXFCON_MCEN) && (frame[0] & 0x01) && !broadcast) {
+        return true;
+    }
+    if ((erxfcon & ERXFCON_UCEN) && unicast) {
+        return true;
+    }
+    return erxfcon & (ERXFCON_PMEN | ERXFCON_HTEN | ERXFCON_MPEN);
+}
+
+static bool sim_receive(enc28j60_sim_t *sim, const uint8_t *frame, uint32_t len)
+{
+    uint16_t rx_start = sim_get16(sim, ENC28J60_ERXSTL);
+    uint16_t rx_end = sim_get16(sim, ENC28J60_ERXNDL);
+    uint16_t wr = sim_get16(sim, ENC28J60_ERXWRPTL);
+    uint16_t rd = sim_get16(sim, ENC28J60_ERXRDPTL);
+    uint8_t *cnt = sim_reg_at(sim, ENC28J60_EPKTCNT);
+    uint32_t ring = rx_end - rx_start + 1;
+    uint32_t stored = SIM_RSV_SIZE + len + SIM_CRC_SIZE;
+    uint32_t free_space;
+
+    if (!(SIM_SHARED(sim, ENC28J60_ECON1) & ECON1_RXEN) || !sim->link_up || len < 14 ||
+            len + SIM_CRC_SIZE > ENC28J60_SIM_MEM_SIZE || !sim_accept(sim, frame)) {
+        sim->stats.rx_dropped++;
+        return false;
+    }
+    if (wr < rx_start || wr > rx_end) {
+        wr = rx_start;
+    }
+    /* the write pointer may never catch up with ERXRDPT */
+    free_space = (rd > wr) ? (uint32_t)(rd - wr - 1) : ring - (wr - rd) - 1;
+    if (stored + (stored & 1) > free_space || *cnt == 0xFF) {
+        SIM_SHARED(sim, ENC28J60_EIR) |= EIR_RXERIF;
+        SIM_SHARED(sim, ENC28J60_ESTAT) |= ESTAT_BUFER;
+        sim->stats.rx_dropped++;
+        sim_update_int(sim);
+        return false;
+    }
+
+    uint16_t next = wr;
+    for (uint32_t i = 0; i < stored + (stored & 1); i++) {
+        next = (next == rx_end) ? rx_start : next + 1;
+    }
+    uint32_t crc = sim_crc32(frame, len);
+    uint32_t byte_count = len + SIM_CRC_SIZE;
+    bool broadcast = frame[0] == 0xFF && frame[1] == 0xFF && frame[2] == 0xFF;
+    uint8_t rsv[SIM_RSV_SIZE] = {
+        next & 0xFF, next >> 8,
+        byte_count & 0xFF, byte_count >> 8,
+        0x80,  // received ok
+        (broadcast ? 0x02 : ((frame[0] & 0x01) ? 0x01 : 0x00))
+    };
+    uint16_t addr = wr;
+    for (uint32_t i = 0; i < stored; i++) {
+        uint8_t byte;
+        if (i < SIM_RSV_SIZE) {
+            byte = rsv[i];
+        } else if (i < SIM_RSV_SIZE + len) {
+            byte = frame[i - SIM_RSV_SIZE];
+        } else {
+            byte = (crc >> (8 * (i - SIM_RSV_SIZE - len))) & 0xFF;
+        }
+        sim->mem[addr] = byte;
+        addr = (addr == rx_end) ? rx_start : addr + 1;
+    }
+    sim_set16(sim, ENC28J60_ERXWRPTL, next);
+    (*cnt)++;
+    sim_update_pktif(sim);
+    sim->stats.rx_frames++;
+    sim_update_int(sim);
+    return true;
+}
+
+bool enc28j60_sim_receive(enc28j60_sim_t *sim, const uint8_t *frame, uint32_t len)
+{
+    pthread_mutex_lock(&sim->lock);
+    bool stored = sim_receive(sim, frame, len);
+    pthread_mutex_unlock(&sim->lock);
+    return stored;
+}
+
+void enc28j60_sim_set_link(enc28j60_sim_t *sim, bool up)
+{
+    pthread_mutex_lock(&sim->lock);
+    if (sim->link_up == up) {
+        pthread_mutex_unlock(&sim->lock);
+        return;
+    }
+    sim->link_up = up;
+    if (up) {
+        sim->phy[SIM_PHSTAT2] |= SIM_PHSTAT2_LSTAT;
+    } else {
+        sim->phy[SIM_PHSTAT2] &= ~SIM_PHSTAT2_LSTAT;
+        sim->phy[SIM_PHSTAT1] &= ~SIM_PHSTAT1_LLSTAT;
+    }
+    sim_link_changed(sim);
+    sim_update_int(sim);
+    pthread_mutex_unlock(&sim->lock);
+}
+
+uint8_t *enc28j60_sim_mem(enc28j60_sim_t *sim)
+{
+    return sim->mem;
+}
+
+void enc28j60_sim_get_stats(const enc28j60_sim_t *sim, enc28j60_sim_stats_t *stats)
+{
+    *stats = sim->stats;
+}
+
+void enc28j60_sim_reset_stats(enc28j60_sim_t *sim)
+{
+    memset(&sim->stats, 0, sizeof(sim->stats));
+}
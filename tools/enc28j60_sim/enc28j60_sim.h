@@ -0,0 +1,132 @@
+// Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Behavioral model of the ENC28J60, for running the driver on a host.
+ *
+ * The model decodes SPI transactions the way the driver encodes them (3 bit command, 5 bit address, data bytes),
+ * and covers what the driver depends on: register banks, MAC/MII dummy byte, the 8 KB buffer with auto increment
+ * and receive ring wrap, EPKTCNT/PKTDEC, TXRTS with transmit status vector, the DMA checksum, MII access to the
+ * PHY registers with PHY loopback and the interrupt flags with the INT pin. Timing, collisions and the pattern match and hash table
+ * filters are not modeled, those filters let every frame pass.
+ *
+ * spi_master_sim.c routes the ESP-IDF SPI master and GPIO calls of the driver to a model, so
+ * esp_eth_mac_enc28j60.c and esp_eth_phy_enc28j60.c build unchanged. include/ holds host versions of the
+ * ESP-IDF, FreeRTOS and lwIP headers the driver uses, freertos_sim.c, esp_sim.c and lwip_sim.c implement them
+ * on POSIX threads. CMakeLists.txt builds it all with the tests in enc28j60_sim_test.c:
+ *
+ *   cmake -S tools/enc28j60_sim -B build_sim && cmake --build build_sim && ctest --test-dir build_sim
+ *
+ * A test creates a model, binds it to the CS and INT GPIOs the driver is configured with, then drives it:
+ *
+ *   enc28j60_sim_t *sim = enc28j60_sim_new(on_tx, ctx);
+ *   enc28j60_sim_bind(sim, 22, 4);             // before spi_bus_add_device() for CS GPIO 22
+ *   enc28j60_sim_set_link(sim, true);
+ *   enc28j60_sim_receive(sim, frame, len);     // frame from the wire, raises PKTIF
+ *   enc28j60_sim_get_stats(sim, &stats);       // SPI cost so far
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ENC28J60_SIM_MEM_SIZE (0x2000)
+
+typedef struct enc28j60_sim_s enc28j60_sim_t;
+
+/**
+ * @brief Called when the model sends a frame (TXRTS), frame without CRC
+ */
+typedef void (*enc28j60_sim_tx_cb_t)(void *ctx, const uint8_t *frame, uint32_t len);
+
+/**
+ * @brief Called when the INT pin goes low (interrupt asserted)
+ */
+typedef void (*enc28j60_sim_int_cb_t)(void *ctx);
+
+/**
+ * @brief SPI cost counters
+ */
+typedef struct {
+    uint32_t transactions;   /*!< SPI transactions (CS low to CS high) */
+    uint32_t cmd[8];         /*!< Transactions per command (RCR, RBM, WCR, WBM, BFS, BFC, -, SRC) */
+    uint64_t bytes;          /*!< Bytes clocked, including the command byte */
+    uint32_t bank_switches;  /*!< ECON1.BSEL changes */
+    uint32_t rx_frames;      /*!< Frames stored in the receive buffer */
+    uint32_t rx_dropped;     /*!< Frames dropped: receive disabled, buffer full or filtered */
+    uint32_t tx_frames;      /*!< Frames sent */
+} enc28j60_sim_stats_t;
+
+/**
+ * @brief Create a model in its power on reset state, link down
+ */
+enc28j60_sim_t *enc28j60_sim_new(enc28j60_sim_tx_cb_t tx_cb, void *tx_ctx);
+
+void enc28j60_sim_del(enc28j60_sim_t *sim);
+
+/**
+ * @brief Power on reset
+ */
+void enc28j60_sim_reset(enc28j60_sim_t *sim);
+
+/**
+ * @brief One SPI transaction: command, argument (register address) and len data bytes in and out
+ * @note rx may be NULL, rx[i] is what the chip shifts out while tx[i] is shifted in
+ */
+void enc28j60_sim_transfer(enc28j60_sim_t *sim, uint8_t cmd, uint8_t arg, const uint8_t *tx, uint8_t *rx, size_t len);
+
+/**
+ * @brief Level of the INT pin, 0 when an enabled interrupt is pending
+ */
+int enc28j60_sim_int_level(const enc28j60_sim_t *sim);
+
+/**
+ * @brief Call cb whenever INT goes low
+ */
+void enc28j60_sim_set_int_cb(enc28j60_sim_t *sim, enc28j60_sim_int_cb_t cb, void *ctx);
+
+/**
+ * @brief A frame (without CRC) arrives from the wire
+ * @return false if it was dropped
+ */
+bool enc28j60_sim_receive(enc28j60_sim_t *sim, const uint8_t *frame, uint32_t len);
+
+/**
+ * @brief Change the link state, raises LINKIF if enabled in PHIE
+ */
+void enc28j60_sim_set_link(enc28j60_sim_t *sim, bool up);
+
+/**
+ * @brief Direct access to buffer memory, e.g. to check the receive ring
+ */
+uint8_t *enc28j60_sim_mem(enc28j60_sim_t *sim);
+
+void enc28j60_sim_get_stats(const enc28j60_sim_t *sim, enc28j60_sim_stats_t *stats);
+
+void enc28j60_sim_reset_stats(enc28j60_sim_t *sim);
+
+/**
+ * @brief Attach the model to the SPI device with this CS GPIO and to this INT GPIO (spi_master_sim.c)
+ * @note must be called before the SPI device is added
+ */
+void enc28j60_sim_bind(enc28j60_sim_t *sim, int cs_gpio, int int_gpio);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,252 @@
+// Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Replay an SPI trace of the ENC28J60 driver (ENC28J60_CMD_G_SPI_TRACE) against the model and print the SPI cost
+ * per received and sent frame, e.g. to compare firmware versions on the same traffic.
+ *
+ * Input is either the binary stream of the trace TCP port (nc <device> 3334 > trace.bin), or a console log
+ * with "E28T:" hex lines:
+ *
+ *   cmake -S tools/enc28j60_sim -B build_sim && cmake --build build_sim --target enc28j60_trace_replay
+ *   build_sim/enc28j60_trace_replay trace.bin
+ *
+ * Bank switches are counted by the model, as it follows ECON1 through the replayed operations.
+ * Buffer memory transfers are replayed with zero data, the trace does not hold frame content.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "enc28j60.h"
+#include "enc28j60_sim.h"
+
+#define REPLAY_TOP_CALLERS (10)
+#define REPLAY_CALLERS_MAX (256)
+
+typedef enum {
+    REPLAY_RX,
+    REPLAY_TX,
+    REPLAY_OTHER, // operations outside frame transactions: interrupt service, transmit kick, setup
+    REPLAY_CLASSES,
+} replay_class_t;
+
+static const char *const s_class_names[REPLAY_CLASSES] = {"rx", "tx", "other"};
+
+typedef struct {
+    uint32_t frames;
+    uint64_t transactions;
+    uint64_t bytes;
+    uint64_t bank_switches;
+    uint64_t lock_wait_cycles;
+    uint64_t time_us;
+} replay_cost_t;
+
+typedef struct {
+    uint32_t caller;
+    uint64_t transactions;
+    uint64_t bytes;
+} replay_caller_t;
+
+typedef struct {
+    enc28j60_sim_t *sim;
+    replay_class_t current;
+    uint32_t frame_start_us;
+    replay_cost_t cost[REPLAY_CLASSES];
+    replay_caller_t callers[REPLAY_CALLERS_MAX];
+    uint32_t num_callers;
+    uint32_t entries;
+    uint32_t errors;
+} replay_t;
+
+static void replay_count_caller(replay_t *replay, uint32_t caller, uint32_t bytes)
+{
+    for (uint32_t i = 0; i < replay->num_callers; i++) {
+        if (replay->callers[i].caller == caller) {
+            replay->callers[i].transactions++;
+            replay->callers[i].bytes += bytes;
+            return;
+        }
+    }
+    if (replay->num_callers < REPLAY_CALLERS_MAX) {
+        replay_caller_t *entry = &replay->callers[replay->num_callers++];
+        entry->caller = caller;
+        entry->transactions = 1;
+        entry->bytes = bytes;
+    }
+}
+
+static void replay_entry(replay_t *replay, const eth_enc28j60_trace_entry_t *entry)
+{
+    static uint8_t tx[ENC28J60_SIM_MEM_SIZE];
+    static uint8_t rx[ENC28J60_SIM_MEM_SIZE];
+    replay_cost_t *cost = &replay->cost[replay->current];
+    enc28j60_sim_stats_t before;
+    enc28j60_sim_stats_t after;
+
+    replay->entries++;
+    switch (entry->type) {
+    case ENC28J60_TRACE_RX_BEGIN:
+    case ENC28J60_TRACE_TX_BEGIN:
+        replay->current = entry->type == ENC28J60_TRACE_RX_BEGIN ? REPLAY_RX : REPLAY_TX;
+        replay->frame_start_us = entry->timestamp_us;
+        replay->cost[replay->current].frames++;
+        replay->cost[replay->current].lock_wait_cycles += entry->lock_wait_cycles;
+        return;
+    case ENC28J60_TRACE_END:
+        if (replay->current != REPLAY_OTHER) {
+            cost->time_us += entry->timestamp_us - replay->frame_start_us;
+        }
+        replay->current = REPLAY_OTHER;
+        return;
+    case ENC28J60_TRACE_SPI:
+        break;
+    default:
+        replay->errors++;
+        return;
+    }
+
+    uint32_t len = entry->length < sizeof(tx) ? entry->length : sizeof(tx);
+    uint8_t cmd = entry->opcode >> 5;
+    memset(tx, 0, len);
+    if (len && cmd != ENC28J60_SPI_CMD_WBM && cmd != ENC28J60_SPI_CMD_RBM) {
+        tx[len - 1] = entry->value;
+    }
+    enc28j60_sim_get_stats(replay->sim, &before);
+    enc28j60_sim_transfer(replay->sim, cmd, entry->opcode & 0x1F, tx, rx, len);
+    enc28j60_sim_get_stats(replay->sim, &after);
+
+    cost->transactions++;
+    cost->bytes += 1 + entry->length;
+    cost->bank_switches += after.bank_switches - before.bank_switches;
+    cost->lock_wait_cycles += entry->lock_wait_cycles;
+    if (entry->flags & ENC28J60_TRACE_FLAG_ERROR) {
+        replay->errors++;
+    }
+    replay_count_caller(replay, entry->caller, 1 + entry->length);
+}
+
+static int replay_hex_nibble(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+/**
+ * @brief Console log: decode the records of every "E28T:" line, other log lines are skipped
+ */
+static void replay_text(replay_t *replay, FILE *in)
+{
+    char line[4096];
+    eth_enc28j60_trace_entry_t entry;
+    uint8_t *bytes = (uint8_t *)&entry;
+    uint32_t fill = 0;
+
+    while (fgets(line, sizeof(line), in)) {
+        char *hex = strstr(line, "E28T:");
+        if (!hex) {
+            continue;
+        }
+        fill = 0; // records never span lines
+        for (hex += 5; replay_hex_nibble(hex[0]) >= 0 && replay_hex_nibble(hex[1]) >= 0; hex += 2) {
+            bytes[fill++] = (replay_hex_nibble(hex[0]) << 4) | replay_hex_nibble(hex[1]);
+            if (fill == sizeof(entry)) {
+                replay_entry(replay, &entry);
+                fill = 0;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Binary stream: header, then records
+ */
+static int replay_binary(replay_t *replay, FILE *in)
+{
+    uint32_t header[2];
+    eth_enc28j60_trace_entry_t entry;
+
+    if (fread(header, sizeof(header), 1, in) != 1 || header[0] != ENC28J60_TRACE_MAGIC) {
+        return -1;
+    }
+    if ((header[1] & 0xFFFF) != ENC28J60_TRACE_VERSION || (header[1] >> 16) != sizeof(entry)) {
+        fprintf(stderr, "unsupported trace version %u (record size %u)\n", header[1] & 0xFFFF, header[1] >> 16);
+        return -1;
+    }
+    while (fread(&entry, sizeof(entry), 1, in) == 1) {
+        replay_entry(replay, &entry);
+    }
+    return 0;
+}
+
+static int replay_caller_cmp(const void *a, const void *b)
+{
+    const replay_caller_t *ca = a;
+    const replay_caller_t *cb = b;
+    return (cb->transactions > ca->transactions) - (cb->transactions < ca->transactions);
+}
+
+static void replay_report(replay_t *replay)
+{
+    printf("%u records, %u errors\n\n", replay->entries, replay->errors);
+    printf("%-6s %8s %12s %12s %12s %12s %12s\n", "", "frames", "trans/frame", "bytes/frame", "banksw/frame",
+           "us/frame", "lockwait/fr");
+    for (int i = 0; i < REPLAY_CLASSES; i++) {
+        replay_cost_t *cost = &replay->cost[i];
+        double frames = cost->frames ? cost->frames : 1; // "other" is shown as totals
+        printf("%-6s %8u %12.1f %12.1f %12.2f %12.1f %12.0f\n", s_class_names[i], cost->frames,
+               cost->transactions / frames, cost->bytes / frames, cost->bank_switches / frames,
+               cost->time_us / frames, cost->lock_wait_cycles / frames);
+    }
+
+    qsort(replay->callers, replay->num_callers, sizeof(replay_caller_t), replay_caller_cmp);
+    printf("\n%-10s %12s %12s\n", "caller", "transactions", "bytes");
+    for (uint32_t i = 0; i < replay->num_callers && i < REPLAY_TOP_CALLERS; i++) {
+        /* Xtensa return addresses carry the call window size in the top 2 bits */
+        printf("0x%08x %12llu %12llu\n", (replay->callers[i].caller & 0x3FFFFFFF) | 0x40000000,
+               (unsigned long long)replay->callers[i].transactions, (unsigned long long)replay->callers[i].bytes);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <trace.bin | console.log>\n", argv[0]);
+        return 2;
+    }
+    FILE *in = fopen(argv[1], "rb");
+    if (!in) {
+        perror(argv[1]);
+        return 1;
+    }
+    replay_t *replay = calloc(1, sizeof(replay_t));
+    replay->sim = enc28j60_sim_new(NULL, NULL);
+    replay->current = REPLAY_OTHER;
+    if (replay_binary(replay, in) != 0) {
+        rewind(in);
+        replay_text(replay, in);
+    }
+    fclose(in);
+    replay_report(replay);
+    enc28j60_sim_del(replay->sim);
+    free(replay);
+    return 0;
+}
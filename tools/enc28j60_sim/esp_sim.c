@@ -0,0 +1,136 @@
+// Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Host versions of the ESP-IDF system services the driver uses: esp_timer, esp_log, heap_caps, cpu_hal,
+ * esp_rom_delay_us and esp_netif_get_netif_impl.
+ */
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_rom_sys.h"
+#include "esp_heap_caps.h"
+#include "esp_netif.h"
+#include "hal/cpu_hal.h"
+
+static esp_log_level_t s_log_level = ESP_LOG_INFO;
+
+static uint64_t sim_monotonic_ns(void)
+{
+    static uint64_t s_start_ns;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uint64_t ns = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    if (!s_start_ns) {
+        s_start_ns = ns;
+    }
+    return ns - s_start_ns;
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return sim_monotonic_ns() / 1000;
+}
+
+void esp_rom_delay_us(uint32_t us)
+{
+    usleep(us);
+}
+
+int cpu_hal_get_core_id(void)
+{
+    return 0;
+}
+
+uint32_t cpu_hal_get_cycle_count(void)
+{
+    return (uint32_t)(sim_monotonic_ns() * HAL_SIM_CPU_MHZ / 1000);
+}
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    switch (code) {
+    case ESP_OK: return "ESP_OK";
+    case ESP_FAIL: return "ESP_FAIL";
+    case ESP_ERR_NO_MEM: return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG: return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE: return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND: return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_NOT_SUPPORTED: return "ESP_ERR_NOT_SUPPORTED";
+    case ESP_ERR_TIMEOUT: return "ESP_ERR_TIMEOUT";
+    case ESP_ERR_INVALID_RESPONSE: return "ESP_ERR_INVALID_RESPONSE";
+    case ESP_ERR_INVALID_CRC: return "ESP_ERR_INVALID_CRC";
+    case ESP_ERR_INVALID_VERSION: return "ESP_ERR_INVALID_VERSION";
+    case ESP_ERR_INVALID_MAC: return "ESP_ERR_INVALID_MAC";
+    default: return "UNKNOWN ERROR";
+    }
+}
+
+void esp_log_level_set(const char *tag, esp_log_level_t level)
+{
+    s_log_level = level;
+}
+
+uint32_t esp_log_timestamp(void)
+{
+    return (uint32_t)(sim_monotonic_ns() / 1000000);
+}
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...)
+{
+    va_list args;
+    if (level > s_log_level) {
+        return;
+    }
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+}
+
+void *heap_caps_malloc(size_t size, uint32_t caps)
+{
+    return malloc(size);
+}
+
+void *heap_caps_calloc(size_t n, size_t size, uint32_t caps)
+{
+    return calloc(n, size);
+}
+
+void heap_caps_free(void *ptr)
+{
+    free(ptr);
+}
+
+size_t heap_caps_get_free_size(uint32_t caps)
+{
+    return HEAP_SIM_FREE_SIZE;
+}
+
+size_t heap_caps_get_minimum_free_size(uint32_t caps)
+{
+    return HEAP_SIM_FREE_SIZE;
+}
+
+void *esp_netif_get_netif_impl(esp_netif_t *esp_netif)
+{
+    return esp_netif;
+}
@@ -0,0 +1,308 @@
+// Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * FreeRTOS on POSIX threads, the subset declared in include/freertos, for running the driver on a host.
+ */
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+struct sim_task_s {
+    pthread_t thread;
+    TaskFunction_t code;
+    void *arg;
+    pthread_mutex_t lock;
+    pthread_cond_t notified;
+    uint32_t notify_count;
+};
+
+typedef enum {
+    SIM_SEM_MUTEX,
+    SIM_SEM_COUNTING,
+} sim_sem_kind_t;
+
+struct sim_semaphore_s {
+    sim_sem_kind_t kind;
+    pthread_mutex_t lock;
+    pthread_cond_t available;
+    UBaseType_t count;
+    UBaseType_t max_count;
+};
+
+static __thread TaskHandle_t s_current_task;
+static pthread_mutex_t s_critical;
+static pthread_once_t s_critical_once = PTHREAD_ONCE_INIT;
+
+static void sim_unlock(void *lock)
+{
+    pthread_mutex_unlock((pthread_mutex_t *)lock);
+}
+
+/**
+ * @brief Absolute CLOCK_REALTIME deadline ticks from now, as pthread_cond_timedwait() wants it
+ */
+static struct timespec sim_deadline(TickType_t ticks)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    uint64_t ns = (uint64_t)ticks * portTICK_PERIOD_MS * 1000000ULL + ts.tv_nsec;
+    ts.tv_sec += ns / 1000000000ULL;
+    ts.tv_nsec = ns % 1000000000ULL;
+    return ts;
+}
+
+/**
+ * @brief Wait on cond until ready() holds or ticks passed; called and returns with lock held
+ * @return false on timeout
+ */
+static bool sim_wait(pthread_cond_t *cond, pthread_mutex_t *lock, TickType_t ticks, bool (*ready)(void *), void *arg)
+{
+    struct timespec deadline = sim_deadline(ticks == portMAX_DELAY ? 0 : ticks);
+    bool ok = true;
+
+    /* a task deleted while blocked here must not keep the lock */
+    pthread_cleanup_push(sim_unlock, lock);
+    while (!ready(arg)) {
+        if (!ticks) {
+            ok = false;
+            break;
+        }
+        if (ticks == portMAX_DELAY) {
+            pthread_cond_wait(cond, lock);
+        } else if (pthread_cond_timedwait(cond, lock, &deadline) == ETIMEDOUT) {
+            ok = ready(arg);
+            break;
+        }
+    }
+    pthread_cleanup_pop(0);
+    return ok;
+}
+
+static TaskHandle_t sim_task_alloc(TaskFunction_t code, void *arg)
+{
+    TaskHandle_t task = calloc(1, sizeof(struct sim_task_s));
+    if (task) {
+        task->code = code;
+        task->arg = arg;
+        pthread_mutex_init(&task->lock, NULL);
+        pthread_cond_init(&task->notified, NULL);
+    }
+    return task;
+}
+
+static void sim_task_free(TaskHandle_t task)
+{
+    pthread_mutex_destroy(&task->lock);
+    pthread_cond_destroy(&task->notified);
+    free(task);
+}
+
+static void *sim_task_entry(void *arg)
+{
+    TaskHandle_t task = (TaskHandle_t)arg;
+    s_current_task = task;
+    pthread_setcanceltype(PTHREAD_CANCEL_DEFERRED, NULL);
+    task->code(task->arg);
+    return NULL;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task_code, const char *name, uint32_t stack_depth, void *arg,
+                                   UBaseType_t priority, TaskHandle_t *created_task, BaseType_t core_id)
+{
+    TaskHandle_t task = sim_task_alloc(task_code, arg);
+    if (!task) {
+        return pdFAIL;
+    }
+    if (pthread_create(&task->thread, NULL, sim_task_entry, task)) {
+        sim_task_free(task);
+        return pdFAIL;
+    }
+    if (created_task) {
+        *created_task = task;
+    }
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    if (!task || task == s_current_task) {
+        /* the handle is left to the process exit, another thread may still notify it */
+        pthread_exit(NULL);
+    }
+    pthread_cancel(task->thread);
+    pthread_join(task->thread, NULL);
+    sim_task_free(task);
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    usleep((useconds_t)ticks * portTICK_PERIOD_MS * 1000);
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (TickType_t)((ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000) / portTICK_PERIOD_MS);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    /* threads not created by xTaskCreatePinnedToCore (e.g. main) become tasks on first use */
+    if (!s_current_task) {
+        s_current_task = sim_task_alloc(NULL, NULL);
+        if (!s_current_task) {
+            abort();
+        }
+        s_current_task->thread = pthread_self();
+    }
+    return s_current_task;
+}
+
+void taskYIELD(void)
+{
+    sched_yield();
+}
+
+static bool sim_task_notified(void *arg)
+{
+    return ((TaskHandle_t)arg)->notify_count != 0;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks_to_wait)
+{
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    uint32_t count = 0;
+
+    pthread_mutex_lock(&task->lock);
+    if (sim_wait(&task->notified, &task->lock, ticks_to_wait, sim_task_notified, task)) {
+        count = task->notify_count;
+        task->notify_count = clear_on_exit ? 0 : count - 1;
+    }
+    pthread_mutex_unlock(&task->lock);
+    return count;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    pthread_mutex_lock(&task->lock);
+    task->notify_count++;
+    pthread_cond_signal(&task->notified);
+    pthread_mutex_unlock(&task->lock);
+    return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *higher_priority_task_woken)
+{
+    xTaskNotifyGive(task);
+    if (higher_priority_task_woken) {
+        *higher_priority_task_woken = pdFALSE;
+    }
+}
+
+static SemaphoreHandle_t sim_semaphore_new(sim_sem_kind_t kind, UBaseType_t max_count, UBaseType_t initial_count)
+{
+    SemaphoreHandle_t sem = calloc(1, sizeof(struct sim_semaphore_s));
+    if (sem) {
+        sem->kind = kind;
+        sem->count = initial_count;
+        sem->max_count = max_count;
+        pthread_mutex_init(&sem->lock, NULL);
+        pthread_cond_init(&sem->available, NULL);
+    }
+    return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    return sim_semaphore_new(SIM_SEM_MUTEX, 1, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return sim_semaphore_new(SIM_SEM_COUNTING, 1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max_count, UBaseType_t initial_count)
+{
+    return sim_semaphore_new(SIM_SEM_COUNTING, max_count, initial_count);
+}
+
+static bool sim_semaphore_available(void *arg)
+{
+    return ((SemaphoreHandle_t)arg)->count != 0;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks_to_wait)
+{
+    BaseType_t ret = pdFALSE;
+
+    pthread_mutex_lock(&sem->lock);
+    if (sim_wait(&sem->available, &sem->lock, ticks_to_wait, sim_semaphore_available, sem)) {
+        sem->count--;
+        ret = pdTRUE;
+    }
+    pthread_mutex_unlock(&sem->lock);
+    return ret;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+    BaseType_t ret = pdFALSE;
+
+    pthread_mutex_lock(&sem->lock);
+    if (sem->count < sem->max_count) {
+        sem->count++;
+        pthread_cond_signal(&sem->available);
+        ret = pdTRUE;
+    }
+    pthread_mutex_unlock(&sem->lock);
+    return ret;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem)
+{
+    pthread_mutex_destroy(&sem->lock);
+    pthread_cond_destroy(&sem->available);
+    free(sem);
+}
+
+static void sim_critical_init(void)
+{
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&s_critical, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+void vPortEnterCritical(portMUX_TYPE *mux)
+{
+    pthread_once(&s_critical_once, sim_critical_init);
+    pthread_mutex_lock(&s_critical);
+    mux->count++;
+}
+
+void vPortExitCritical(portMUX_TYPE *mux)
+{
+    mux->count--;
+    pthread_mutex_unlock(&s_critical);
+}
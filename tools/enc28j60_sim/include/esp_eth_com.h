@@ -0,0 +1,70 @@
+// Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Host version of esp_eth_com.h (ESP-IDF v4.x), the Ethernet driver mediator between MAC, PHY and stack.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ETH_MAX_PAYLOAD_LEN (1500)
+#define ETH_MIN_PAYLOAD_LEN (46)
+#define ETH_HEADER_LEN (14)
+#define ETH_VLAN_TAG_LEN (4)
+#define ETH_CRC_LEN (4)
+#define ETH_MAX_PACKET_SIZE (ETH_HEADER_LEN + ETH_VLAN_TAG_LEN + ETH_MAX_PAYLOAD_LEN + ETH_CRC_LEN)
+#define ETH_MIN_PACKET_SIZE (ETH_HEADER_LEN + ETH_MIN_PAYLOAD_LEN + ETH_CRC_LEN)
+
+typedef enum {
+    ETH_STATE_LLINIT,
+    ETH_STATE_DEINIT,
+    ETH_STATE_LINK,
+    ETH_STATE_SPEED,
+    ETH_STATE_DUPLEX,
+} esp_eth_state_t;
+
+typedef enum {
+    ETH_LINK_UP,
+    ETH_LINK_DOWN,
+} eth_link_t;
+
+typedef enum {
+    ETH_SPEED_10M,
+    ETH_SPEED_100M,
+} eth_speed_t;
+
+typedef enum {
+    ETH_DUPLEX_HALF,
+    ETH_DUPLEX_FULL,
+} eth_duplex_t;
+
+typedef struct esp_eth_mediator_s esp_eth_mediator_t;
+
+struct esp_eth_mediator_s {
+    esp_err_t (*phy_reg_read)(esp_eth_mediator_t *eth, uint32_t phy_addr, uint32_t phy_reg, uint32_t *reg_value);
+    esp_err_t (*phy_reg_write)(esp_eth_mediator_t *eth, uint32_t phy_addr, uint32_t phy_reg, uint32_t reg_value);
+    esp_err_t (*stack_input)(esp_eth_mediator_t *eth, uint8_t *buffer, uint32_t length);
+    esp_err_t (*on_state_changed)(esp_eth_mediator_t *eth, esp_eth_state_t state, void *args);
+};
+
+#ifdef __cplusplus
+}
+#endif
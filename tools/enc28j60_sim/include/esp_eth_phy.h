@@ -0,0 +1,63 @@
+// Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Host version of esp_eth_phy.h (ESP-IDF v4.x), the PHY driver interface.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_eth_com.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ESP_ETH_PHY_ADDR_AUTO (-1)
+
+typedef struct esp_eth_phy_s esp_eth_phy_t;
+
+struct esp_eth_phy_s {
+    esp_err_t (*set_mediator)(esp_eth_phy_t *phy, esp_eth_mediator_t *mediator);
+    esp_err_t (*reset)(esp_eth_phy_t *phy);
+    esp_err_t (*reset_hw)(esp_eth_phy_t *phy);
+    esp_err_t (*init)(esp_eth_phy_t *phy);
+    esp_err_t (*deinit)(esp_eth_phy_t *phy);
+    esp_err_t (*negotiate)(esp_eth_phy_t *phy);
+    esp_err_t (*get_link)(esp_eth_phy_t *phy);
+    esp_err_t (*pwrctl)(esp_eth_phy_t *phy, bool enable);
+    esp_err_t (*set_addr)(esp_eth_phy_t *phy, uint32_t addr);
+    esp_err_t (*get_addr)(esp_eth_phy_t *phy, uint32_t *addr);
+    esp_err_t (*del)(esp_eth_phy_t *phy);
+};
+
+typedef struct {
+    int32_t phy_addr;
+    uint32_t reset_timeout_ms;
+    uint32_t autonego_timeout_ms;
+    int reset_gpio_num;
+} eth_phy_config_t;
+
+#define ETH_PHY_DEFAULT_CONFIG()           \
+    {                                      \
+        .phy_addr = ESP_ETH_PHY_ADDR_AUTO, \
+        .reset_timeout_ms = 100,           \
+        .autonego_timeout_ms = 4000,       \
+        .reset_gpio_num = 5,               \
+    }
+
+#ifdef __cplusplus
+}
+#endif
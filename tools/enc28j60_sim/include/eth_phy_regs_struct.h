@@ -0,0 +1,63 @@
+// Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Host version of eth_phy_regs_struct.h, the IEEE 802.3 registers used by the ENC28J60 PHY driver.
+ */
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef union {
+    struct {
+        uint32_t reserved : 7;          /*!< Reserved */
+        uint32_t collision_test : 1;    /*!< Collision test */
+        uint32_t duplex_mode : 1;       /*!< Duplex mode: Full Duplex(1) and Half Duplex(0) */
+        uint32_t restart_auto_nego : 1; /*!< Restart auto-negotiation */
+        uint32_t isolate : 1;           /*!< Isolate the PHY from MII except the SMI interface */
+        uint32_t power_down : 1;        /*!< Power off PHY except SMI interface */
+        uint32_t en_auto_nego : 1;      /*!< Enable auto negotiation */
+        uint32_t speed_select : 1;      /*!< Select speed: 100Mbps(1) and 10Mbps(0) */
+        uint32_t en_loopback : 1;       /*!< Enables transmit data to be routed to the receive path */
+        uint32_t reset : 1;             /*!< Reset PHY registers. This bit is self-clearing. */
+    };
+    uint32_t val;
+} bmcr_reg_t;
+#define ETH_PHY_BMCR_REG_ADDR (0x00)
+
+typedef union {
+    struct {
+        uint32_t oui_msb : 16; /*!< Organizationally Unique Identifier(OUI) most significant bits */
+    };
+    uint32_t val;
+} phyidr1_reg_t;
+#define ETH_PHY_IDR1_REG_ADDR (0x02)
+
+typedef union {
+    struct {
+        uint32_t model_revision : 4; /*!< Model revision number */
+        uint32_t vendor_model : 6;   /*!< Vendor model number */
+        uint32_t oui_lsb : 6;        /*!< Organizationally Unique Identifier(OUI) least significant bits */
+    };
+    uint32_t val;
+} phyidr2_reg_t;
+#define ETH_PHY_IDR2_REG_ADDR (0x03)
+
+#ifdef __cplusplus
+}
+#endif
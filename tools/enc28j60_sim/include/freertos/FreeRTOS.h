@@ -0,0 +1,67 @@
+// Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Host version of FreeRTOS, the subset used by the ENC28J60 driver, on POSIX threads (freertos_sim.c).
+ *
+ * Tasks are threads without priorities, a tick is one millisecond of the monotonic clock. Critical sections
+ * share one recursive mutex, so they exclude each other like on a single core; "interrupts" (the GPIO ISR)
+ * run on whichever thread made the model assert INT.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "sdkconfig.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE ((BaseType_t)0)
+#define pdTRUE  ((BaseType_t)1)
+#define pdFAIL  (pdFALSE)
+#define pdPASS  (pdTRUE)
+
+#define configTICK_RATE_HZ      (CONFIG_FREERTOS_HZ)
+#define configMAX_TASK_NAME_LEN (16)
+#define portMAX_DELAY           ((TickType_t)0xFFFFFFFF)
+#define portTICK_PERIOD_MS      ((TickType_t)1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(ms)       ((TickType_t)(((TickType_t)(ms) * (TickType_t)configTICK_RATE_HZ) / (TickType_t)1000))
+#define tskNO_AFFINITY          (0x7FFFFFFF)
+
+typedef struct {
+    uint32_t owner;
+    uint32_t count;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED {.owner = 0, .count = 0}
+
+void vPortEnterCritical(portMUX_TYPE *mux);
+void vPortExitCritical(portMUX_TYPE *mux);
+
+#define portENTER_CRITICAL(mux)     vPortEnterCritical(mux)
+#define portEXIT_CRITICAL(mux)      vPortExitCritical(mux)
+#define portENTER_CRITICAL_ISR(mux) vPortEnterCritical(mux)
+#define portEXIT_CRITICAL_ISR(mux)  vPortExitCritical(mux)
+#define portYIELD_FROM_ISR()        do { } while (0)
+
+#ifdef __cplusplus
+}
+#endif
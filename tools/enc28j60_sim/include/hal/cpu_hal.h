@@ -0,0 +1,33 @@
+// Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Host version of hal/cpu_hal.h: a single core, its cycle counter runs at HAL_SIM_CPU_MHZ off the monotonic clock.
+ */
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HAL_SIM_CPU_MHZ (240)
+
+int cpu_hal_get_core_id(void);
+uint32_t cpu_hal_get_cycle_count(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,28 @@
+// Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Host version of lwip/err.h, the subset used by the ENC28J60 driver.
+ */
+#pragma once
+
+#include <stdint.h>
+
+typedef int8_t err_t;
+
+#define ERR_OK   0
+#define ERR_MEM  -1
+#define ERR_BUF  -2
+#define ERR_VAL  -6
+#define ERR_ARG  -16
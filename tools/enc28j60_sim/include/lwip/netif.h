@@ -0,0 +1,71 @@
+// Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Host version of lwip/netif.h: a test sets up the input function and checksum control of a netif itself.
+ */
+#pragma once
+
+#include <stdint.h>
+#include "lwip/opt.h"
+#include "lwip/err.h"
+#include "lwip/pbuf.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NETIF_CHECKSUM_GEN_IP     0x0001
+#define NETIF_CHECKSUM_GEN_UDP    0x0002
+#define NETIF_CHECKSUM_GEN_TCP    0x0004
+#define NETIF_CHECKSUM_GEN_ICMP   0x0008
+#define NETIF_CHECKSUM_GEN_ICMP6  0x0010
+#define NETIF_CHECKSUM_CHECK_IP   0x0100
+#define NETIF_CHECKSUM_CHECK_UDP  0x0200
+#define NETIF_CHECKSUM_CHECK_TCP  0x0400
+#define NETIF_CHECKSUM_CHECK_ICMP 0x0800
+#define NETIF_CHECKSUM_CHECK_ICMP6 0x1000
+#define NETIF_CHECKSUM_ENABLE_ALL 0xFFFF
+#define NETIF_CHECKSUM_DISABLE_ALL 0x0000
+
+struct netif;
+
+typedef err_t (*netif_input_fn)(struct pbuf *p, struct netif *inp);
+
+struct netif {
+    struct netif *next;
+    netif_input_fn input;
+    void *state;
+#if LWIP_CHECKSUM_CTRL_PER_NETIF
+    uint16_t chksum_flags;
+#endif
+    uint16_t mtu;
+    uint8_t flags;
+};
+
+#define NETIF_FLAG_UP 0x01U
+
+#define netif_is_up(netif) (((netif)->flags & NETIF_FLAG_UP) ? (uint8_t)1 : (uint8_t)0)
+
+#if LWIP_CHECKSUM_CTRL_PER_NETIF
+#define NETIF_SET_CHECKSUM_CTRL(netif, chksumflags) do { \
+        (netif)->chksum_flags = chksumflags;             \
+    } while (0)
+#else
+#define NETIF_SET_CHECKSUM_CTRL(netif, chksumflags)
+#endif
+
+#ifdef __cplusplus
+}
+#endif
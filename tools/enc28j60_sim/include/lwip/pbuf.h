@@ -0,0 +1,71 @@
+// Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Host version of lwip/pbuf.h (lwIP 2.1): single buffer pbufs, chains are not supported.
+ */
+#pragma once
+
+#include <stdint.h>
+#include "lwip/opt.h"
+#include "lwip/err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    PBUF_TRANSPORT = 54, // lwIP header room: link, IP and TCP headers
+    PBUF_IP = 34,
+    PBUF_LINK = 14,
+    PBUF_RAW_TX = 0,
+    PBUF_RAW = 0,
+} pbuf_layer;
+
+typedef enum {
+    PBUF_RAM,
+    PBUF_ROM,
+    PBUF_REF,
+    PBUF_POOL,
+} pbuf_type;
+
+#define PBUF_FLAG_IS_CUSTOM 0x02U
+
+struct pbuf {
+    struct pbuf *next;
+    void *payload;
+    uint16_t tot_len;
+    uint16_t len;
+    uint8_t type_internal;
+    uint8_t flags;
+    uint16_t ref;
+    uint8_t if_idx;
+};
+
+typedef void (*pbuf_free_custom_fn)(struct pbuf *p);
+
+struct pbuf_custom {
+    struct pbuf pbuf;
+    pbuf_free_custom_fn custom_free_function;
+};
+
+struct pbuf *pbuf_alloc(pbuf_layer layer, uint16_t length, pbuf_type type);
+struct pbuf *pbuf_alloced_custom(pbuf_layer l, uint16_t length, pbuf_type type, struct pbuf_custom *p,
+                                 void *payload_mem, uint16_t payload_mem_len);
+void pbuf_realloc(struct pbuf *p, uint16_t size);
+uint8_t pbuf_free(struct pbuf *p);
+
+#ifdef __cplusplus
+}
+#endif
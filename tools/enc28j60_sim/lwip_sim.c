@@ -0,0 +1,96 @@
+// Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Host versions of the lwIP pbuf and checksum functions the driver uses. pbufs are single buffers from the heap,
+ * the test's netif input function owns (and frees) what the driver passes up.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include "lwip/pbuf.h"
+#include "lwip/inet_chksum.h"
+
+struct pbuf *pbuf_alloc(pbuf_layer layer, uint16_t length, pbuf_type type)
+{
+    if (type != PBUF_RAM && type != PBUF_POOL) {
+        return NULL;
+    }
+    /* header and payload in one block, like PBUF_RAM */
+    struct pbuf *p = malloc(sizeof(struct pbuf) + layer + length);
+    if (!p) {
+        return NULL;
+    }
+    memset(p, 0, sizeof(struct pbuf));
+    p->payload = (uint8_t *)(p + 1) + layer;
+    p->tot_len = length;
+    p->len = length;
+    p->type_internal = type;
+    p->ref = 1;
+    return p;
+}
+
+struct pbuf *pbuf_alloced_custom(pbuf_layer l, uint16_t length, pbuf_type type, struct pbuf_custom *p,
+                                 void *payload_mem, uint16_t payload_mem_len)
+{
+    if ((uint32_t)l + length > payload_mem_len) {
+        return NULL;
+    }
+    memset(&p->pbuf, 0, sizeof(struct pbuf));
+    p->pbuf.payload = payload_mem ? (uint8_t *)payload_mem + l : NULL;
+    p->pbuf.tot_len = length;
+    p->pbuf.len = length;
+    p->pbuf.type_internal = type;
+    p->pbuf.flags = PBUF_FLAG_IS_CUSTOM;
+    p->pbuf.ref = 1;
+    return &p->pbuf;
+}
+
+void pbuf_realloc(struct pbuf *p, uint16_t size)
+{
+    if (size < p->tot_len) {
+        p->tot_len = size;
+        p->len = size;
+    }
+}
+
+uint8_t pbuf_free(struct pbuf *p)
+{
+    if (!p || --p->ref) {
+        return 0;
+    }
+    if (p->flags & PBUF_FLAG_IS_CUSTOM) {
+        ((struct pbuf_custom *)p)->custom_free_function(p);
+    } else {
+        free(p);
+    }
+    return 1;
+}
+
+uint16_t inet_chksum(const void *dataptr, uint16_t len)
+{
+    const uint8_t *data = (const uint8_t *)dataptr;
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i + 1 < len; i += 2) {
+        sum += (data[i] << 8) | data[i + 1];
+    }
+    if (len & 1) {
+        sum += data[len - 1] << 8;
+    }
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    /* stored in memory, the checksum reads in network byte order */
+    return htons(~sum & 0xFFFF);
+}
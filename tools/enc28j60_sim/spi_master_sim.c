@@ -0,0 +1,289 @@
+// Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * SPI master and GPIO backend that routes the driver's transactions to ENC28J60 models.
+ * Transactions run synchronously, queued ones complete before spi_device_queue_trans() returns.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "driver/spi_master.h"
+#include "driver/gpio.h"
+#include "enc28j60_sim.h"
+
+#define SIM_BINDINGS_MAX  (4)
+#define SIM_QUEUE_MAX     (32)
+
+typedef struct {
+    enc28j60_sim_t *sim;
+    int cs_gpio;
+    int int_gpio;
+} sim_binding_t;
+
+struct spi_device_t {
+    enc28j60_sim_t *sim;
+    spi_host_device_t host;
+    spi_device_interface_config_t cfg;
+    spi_transaction_t *done[SIM_QUEUE_MAX]; // finished queued transactions, FIFO
+    uint32_t done_head;
+    uint32_t done_count;
+};
+
+typedef struct {
+    gpio_isr_t handler;
+    void *arg;
+    bool enabled;
+} sim_gpio_t;
+
+static sim_binding_t s_bindings[SIM_BINDINGS_MAX];
+static sim_gpio_t s_gpio[GPIO_NUM_MAX];
+
+static sim_binding_t *sim_binding_by_cs(int cs_gpio)
+{
+    for (int i = 0; i < SIM_BINDINGS_MAX; i++) {
+        if (s_bindings[i].sim && s_bindings[i].cs_gpio == cs_gpio) {
+            return &s_bindings[i];
+        }
+    }
+    return NULL;
+}
+
+static sim_binding_t *sim_binding_by_int(int int_gpio)
+{
+    for (int i = 0; i < SIM_BINDINGS_MAX; i++) {
+        if (s_bindings[i].sim && s_bindings[i].int_gpio == int_gpio) {
+            return &s_bindings[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief INT went low: run the ISR registered for the bound GPIO, like a negative edge interrupt
+ */
+static void sim_int_asserted(void *ctx)
+{
+    sim_binding_t *binding = (sim_binding_t *)ctx;
+    sim_gpio_t *gpio = &s_gpio[binding->int_gpio];
+    if (gpio->enabled && gpio->handler) {
+        gpio->handler(gpio->arg);
+    }
+}
+
+void enc28j60_sim_bind(enc28j60_sim_t *sim, int cs_gpio, int int_gpio)
+{
+    for (int i = 0; i < SIM_BINDINGS_MAX; i++) {
+        if (!s_bindings[i].sim || s_bindings[i].cs_gpio == cs_gpio) {
+            s_bindings[i].sim = sim;
+            s_bindings[i].cs_gpio = cs_gpio;
+            s_bindings[i].int_gpio = int_gpio;
+            enc28j60_sim_set_int_cb(sim, sim_int_asserted, &s_bindings[i]);
+            return;
+        }
+    }
+    abort();
+}
+
+esp_err_t spi_bus_initialize(spi_host_device_t host, const spi_bus_config_t *bus_config, int dma_chan)
+{
+    return ESP_OK;
+}
+
+esp_err_t spi_bus_free(spi_host_device_t host)
+{
+    return ESP_OK;
+}
+
+esp_err_t spi_bus_add_device(spi_host_device_t host, const spi_device_interface_config_t *dev_config,
+                             spi_device_handle_t *handle)
+{
+    /* a device without CS talks to no model, transactions on it go nowhere */
+    sim_binding_t *binding = sim_binding_by_cs(dev_config->spics_io_num);
+    if (!binding && dev_config->spics_io_num >= 0) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    struct spi_device_t *dev = calloc(1, sizeof(struct spi_device_t));
+    if (!dev) {
+        return ESP_ERR_NO_MEM;
+    }
+    dev->sim = binding ? binding->sim : NULL;
+    dev->host = host;
+    dev->cfg = *dev_config;
+    *handle = dev;
+    return ESP_OK;
+}
+
+esp_err_t spi_bus_remove_device(spi_device_handle_t handle)
+{
+    if (handle->done_count) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    free(handle);
+    return ESP_OK;
+}
+
+/**
+ * @brief Split the command and address phases into the ENC28J60 opcode (3 bit) and argument (5 bit)
+ * @note devices configured without command/address phases send the opcode as the first data byte
+ */
+static void sim_execute(spi_device_handle_t dev, spi_transaction_t *trans)
+{
+    const uint8_t *tx = (trans->flags & SPI_TRANS_USE_TXDATA) ? trans->tx_data : trans->tx_buffer;
+    uint8_t *rx = (trans->flags & SPI_TRANS_USE_RXDATA) ? trans->rx_data : trans->rx_buffer;
+    size_t len = trans->length / 8;
+    uint32_t phase_bits = dev->cfg.command_bits + dev->cfg.address_bits;
+    uint8_t opcode = 0;
+
+    if (!dev->sim) {
+        return;
+    }
+    if (phase_bits == 8) {
+        opcode = (trans->cmd << dev->cfg.address_bits) | (trans->addr & ((1 << dev->cfg.address_bits) - 1));
+    } else if (len && tx) {
+        opcode = tx[0];
+        tx++;
+        rx = rx ? rx + 1 : NULL;
+        len--;
+    }
+    enc28j60_sim_transfer(dev->sim, opcode >> 5, opcode & 0x1F, tx, rx, len);
+}
+
+esp_err_t spi_device_polling_transmit(spi_device_handle_t handle, spi_transaction_t *trans_desc)
+{
+    sim_execute(handle, trans_desc);
+    return ESP_OK;
+}
+
+esp_err_t spi_device_transmit(spi_device_handle_t handle, spi_transaction_t *trans_desc)
+{
+    return spi_device_polling_transmit(handle, trans_desc);
+}
+
+esp_err_t spi_device_queue_trans(spi_device_handle_t handle, spi_transaction_t *trans_desc, TickType_t ticks_to_wait)
+{
+    uint32_t depth = handle->cfg.queue_size > 0 ? handle->cfg.queue_size : 1;
+    if (depth > SIM_QUEUE_MAX) {
+        depth = SIM_QUEUE_MAX;
+    }
+    if (handle->done_count >= depth) {
+        return ESP_ERR_TIMEOUT;
+    }
+    sim_execute(handle, trans_desc);
+    handle->done[(handle->done_head + handle->done_count) % SIM_QUEUE_MAX] = trans_desc;
+    handle->done_count++;
+    return ESP_OK;
+}
+
+esp_err_t spi_device_get_trans_result(spi_device_handle_t handle, spi_transaction_t **trans_desc,
+                                      TickType_t ticks_to_wait)
+{
+    if (!handle->done_count) {
+        return ESP_ERR_TIMEOUT;
+    }
+    *trans_desc = handle->done[handle->done_head];
+    handle->done_head = (handle->done_head + 1) % SIM_QUEUE_MAX;
+    handle->done_count--;
+    return ESP_OK;
+}
+
+esp_err_t spi_device_acquire_bus(spi_device_handle_t device, TickType_t wait)
+{
+    return ESP_OK;
+}
+
+void spi_device_release_bus(spi_device_handle_t dev)
+{
+}
+
+esp_err_t gpio_reset_pin(gpio_num_t gpio_num)
+{
+    if (gpio_num < 0 || gpio_num >= GPIO_NUM_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(&s_gpio[gpio_num], 0, sizeof(sim_gpio_t));
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_direction(gpio_num_t gpio_num, gpio_mode_t mode)
+{
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_pull_mode(gpio_num_t gpio_num, gpio_pull_mode_t pull)
+{
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_intr_type(gpio_num_t gpio_num, gpio_int_type_t intr_type)
+{
+    return ESP_OK;
+}
+
+esp_err_t gpio_intr_enable(gpio_num_t gpio_num)
+{
+    if (gpio_num < 0 || gpio_num >= GPIO_NUM_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_gpio[gpio_num].enabled = true;
+    return ESP_OK;
+}
+
+esp_err_t gpio_intr_disable(gpio_num_t gpio_num)
+{
+    if (gpio_num < 0 || gpio_num >= GPIO_NUM_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_gpio[gpio_num].enabled = false;
+    return ESP_OK;
+}
+
+esp_err_t gpio_install_isr_service(int intr_alloc_flags)
+{
+    return ESP_OK;
+}
+
+void gpio_uninstall_isr_service(void)
+{
+}
+
+esp_err_t gpio_isr_handler_add(gpio_num_t gpio_num, gpio_isr_t isr_handler, void *args)
+{
+    if (gpio_num < 0 || gpio_num >= GPIO_NUM_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_gpio[gpio_num].handler = isr_handler;
+    s_gpio[gpio_num].arg = args;
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_remove(gpio_num_t gpio_num)
+{
+    if (gpio_num < 0 || gpio_num >= GPIO_NUM_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_gpio[gpio_num].handler = NULL;
+    s_gpio[gpio_num].arg = NULL;
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level)
+{
+    return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t gpio_num)
+{
+    sim_binding_t *binding = sim_binding_by_int(gpio_num);
+    return binding ? enc28j60_sim_int_level(binding->sim) : 1;
+}